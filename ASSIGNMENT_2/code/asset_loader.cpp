@@ -0,0 +1,339 @@
+/* asset_loader.cpp
+   Background loading of textures and meshes, see asset_loader.h
+*/
+
+#include "asset_loader.h"
+#include "tiny_loader.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+using namespace std;
+
+typedef chrono::high_resolution_clock loader_clock;
+
+static double elapsed_ms(loader_clock::time_point start)
+{
+	return chrono::duration<double, milli>(loader_clock::now() - start).count();
+}
+
+
+/* The flip is done while copying out of the stb_image buffer, so this relies on
+   stbi_set_flip_vertically_on_load() being left off */
+bool decode_image(const string& filename, bool flip, decoded_image& out)
+{
+	out.pixels.clear();
+	out.width = out.height = out.channels = 0;
+
+	int width, height, channels;
+	unsigned char* data = stbi_load(filename.c_str(), &width, &height, &channels, 0);
+
+	// Only RGB and RGBA are uploaded, so grey images are decoded again as RGBA
+	if (data && channels < 3)
+	{
+		stbi_image_free(data);
+		data = stbi_load(filename.c_str(), &width, &height, &channels, 4);
+		channels = 4;
+	}
+	if (!data) return false;
+
+	size_t row = size_t(width) * channels;
+	out.pixels.resize(row * height);
+	for (int y = 0; y < height; y++)
+	{
+		memcpy(&out.pixels[y * row], data + (flip ? height - 1 - y : y) * row, row);
+	}
+	stbi_image_free(data);
+
+	out.width = width;
+	out.height = height;
+	out.channels = channels;
+	return true;
+}
+
+
+size_t upload_texture(GLuint texture, const decoded_image& image, bool mipmaps)
+{
+	GLint previous_texture, previous_alignment;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous_texture);
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &previous_alignment);
+	glBindTexture(GL_TEXTURE_2D, texture);
+
+	// The rows of an RGB image are not always a multiple of 4 bytes long
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	GLenum format = image.channels == 3 ? GL_RGB : GL_RGBA;
+	glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, &image.pixels[0]);
+
+	if (mipmaps)
+	{
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
+	}
+	else
+	{
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, previous_alignment);
+	glBindTexture(GL_TEXTURE_2D, previous_texture);
+
+	size_t bytes = 0;
+	for (int w = image.width, h = image.height; ; w = max(1, w / 2), h = max(1, h / 2))
+	{
+		bytes += size_t(w) * h * 4;
+		if (!mipmaps || (w == 1 && h == 1)) break;
+	}
+	return bytes;
+}
+
+
+/* Each decoding thread takes the next image nobody has started, so one big image
+   doesn't hold up the rest. The GL thread waits for the images in order, uploading
+   each as soon as it is decoded while the later ones are still being decoded, and
+   frees its pixels straight away. The decoders keep at most a few images per thread
+   ahead of the uploads so a large batch is never all in memory at once */
+size_t load_textures(vector<texture_request>& requests, unsigned num_threads)
+{
+	size_t count = requests.size();
+	if (num_threads == 0) num_threads = max(1u, thread::hardware_concurrency());
+	num_threads = unsigned(min<size_t>(num_threads, count));
+	size_t ahead = size_t(num_threads) * 4;
+
+	vector<decoded_image> images(count);
+	vector<char> decoded(count, 0);
+	size_t uploaded = 0;
+	atomic<size_t> next(0);
+	mutex batch_mutex;
+	condition_variable image_decoded, image_uploaded;
+
+	auto decode = [&]()
+	{
+		for (size_t i; (i = next++) < count; )
+		{
+			{
+				unique_lock<mutex> lock(batch_mutex);
+				image_uploaded.wait(lock, [&]() { return i < uploaded + ahead; });
+			}
+			decode_image(requests[i].filename, requests[i].flip, images[i]);
+			{
+				lock_guard<mutex> lock(batch_mutex);
+				decoded[i] = 1;
+			}
+			image_decoded.notify_one();
+		}
+	};
+	vector<thread> decoders;
+	for (unsigned t = 0; t < num_threads; t++) decoders.emplace_back(decode);
+
+	size_t loaded = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		{
+			unique_lock<mutex> lock(batch_mutex);
+			image_decoded.wait(lock, [&]() { return decoded[i] != 0; });
+		}
+
+		texture_request& request = requests[i];
+		request.texture = 0;
+		request.bytes = 0;
+		if (images[i].pixels.empty())
+		{
+			cout << "stb_image loading error: filename=" << request.filename << endl;
+		}
+		else
+		{
+			glGenTextures(1, &request.texture);
+			request.bytes = upload_texture(request.texture, images[i], request.mipmaps);
+			vector<unsigned char>().swap(images[i].pixels);
+			loaded++;
+		}
+
+		{
+			lock_guard<mutex> lock(batch_mutex);
+			uploaded = i + 1;
+		}
+		image_uploaded.notify_all();
+	}
+
+	for (size_t t = 0; t < decoders.size(); t++) decoders[t].join();
+	return loaded;
+}
+
+
+asset_loader::asset_loader(unsigned num_threads)
+{
+	textures_loaded = 0;
+	meshes_loaded = 0;
+	failed = 0;
+	upload_time = 0;
+	longest_update = 0;
+	stopping = false;
+	completed = nullptr;
+	outstanding = 0;
+
+	// The GL thread keeps one core to itself
+	if (num_threads == 0) num_threads = min(4u, max(1u, thread::hardware_concurrency() - 1));
+	for (unsigned t = 0; t < num_threads; t++) threads.emplace_back(&asset_loader::worker, this);
+}
+
+
+asset_loader::~asset_loader()
+{
+	{
+		lock_guard<mutex> lock(queue_mutex);
+		stopping = true;
+	}
+	queue_ready.notify_all();
+	for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+
+	for (size_t j = 0; j < queue.size(); j++) delete queue[j];
+	for (size_t j = 0; j < ready.size(); j++) delete ready[j];
+	for (job* j = completed.exchange(nullptr); j; )
+	{
+		job* next = j->next;
+		delete j;
+		j = next;
+	}
+}
+
+
+void asset_loader::worker()
+{
+	for (;;)
+	{
+		job* j;
+		{
+			unique_lock<mutex> lock(queue_mutex);
+			queue_ready.wait(lock, [this]() { return stopping || !queue.empty(); });
+			if (stopping) return;
+			j = queue.front();
+			queue.pop_front();
+		}
+
+		if (j->work) j->work();
+
+		// Push onto the finished list, the release makes what the work wrote visible
+		// to the GL thread once it has taken the list
+		j->next = completed.load(memory_order_relaxed);
+		while (!completed.compare_exchange_weak(j->next, j, memory_order_release, memory_order_relaxed))
+		{
+		}
+	}
+}
+
+
+void asset_loader::submit(function<void()> work, function<void()> finish)
+{
+	job* j = new job;
+	j->work = work;
+	j->finish = finish;
+	j->next = nullptr;
+
+	if (outstanding++ == 0) batch_start = loader_clock::now();
+	{
+		lock_guard<mutex> lock(queue_mutex);
+		queue.push_back(j);
+	}
+	queue_ready.notify_one();
+}
+
+
+/* The texture is created here with a grey placeholder that is replaced in the same
+   name, so anything holding the name sees the image once it has arrived. When the
+   file can't be decoded the placeholder stays */
+GLuint asset_loader::loadTexture(const string& filename, bool mipmaps, bool flip, function<void(bool, size_t)> done)
+{
+	GLuint texture;
+	glGenTextures(1, &texture);
+
+	decoded_image placeholder;
+	placeholder.width = placeholder.height = 2;
+	placeholder.channels = 4;
+	placeholder.pixels.assign(2 * 2 * 4, 128);
+	upload_texture(texture, placeholder, false);
+
+	shared_ptr<decoded_image> image = make_shared<decoded_image>();
+	submit([filename, flip, image]() { decode_image(filename, flip, *image); },
+		[this, texture, filename, mipmaps, image, done]()
+		{
+			if (image->pixels.empty())
+			{
+				cout << "stb_image loading error: filename=" << filename << endl;
+				failed++;
+				if (done) done(false, 0);
+				return;
+			}
+			size_t bytes = upload_texture(texture, *image, mipmaps);
+			textures_loaded++;
+			if (done) done(true, bytes);
+		});
+	return texture;
+}
+
+
+void asset_loader::loadObj(TinyObjLoader& obj, const string& filename, function<void(bool)> done)
+{
+	TinyObjLoader* target = &obj;
+	shared_ptr<TinyObjLoader::prepared_mesh> prepared = make_shared<TinyObjLoader::prepared_mesh>();
+	submit([target, filename, prepared]() { target->prepare(filename, *prepared); },
+		[this, target, prepared, done]()
+		{
+			if (!target->finish(*prepared))
+			{
+				cout << "Error loading mesh: " << prepared->inputfile << endl;
+				failed++;
+				if (done) done(false);
+				return;
+			}
+			meshes_loaded++;
+			if (done) done(true);
+		});
+}
+
+
+GLuint asset_loader::update(double budget_ms)
+{
+	loader_clock::time_point start = loader_clock::now();
+
+	// Take everything the workers have finished and put it in the order it finished
+	vector<job*> taken;
+	for (job* j = completed.exchange(nullptr, memory_order_acquire); j; j = j->next) taken.push_back(j);
+	ready.insert(ready.end(), taken.rbegin(), taken.rend());
+
+	GLuint count = 0;
+	while (!ready.empty())
+	{
+		job* j = ready.front();
+		ready.pop_front();
+		if (j->finish) j->finish();
+		delete j;
+		outstanding--;
+		count++;
+		if (elapsed_ms(start) >= budget_ms) break;
+	}
+
+	if (count)
+	{
+		double time = elapsed_ms(start);
+		upload_time += time;
+		longest_update = max(longest_update, time);
+		if (outstanding == 0)
+		{
+			cout << "Assets loaded in " << elapsed_ms(batch_start) << " ms: " << textures_loaded << " textures, "
+				<< meshes_loaded << " meshes, " << failed << " failed, " << upload_time << " ms uploading, longest frame "
+				<< longest_update << " ms" << endl;
+		}
+	}
+	return count;
+}
+
+
+void asset_loader::finishAll()
+{
+	while (outstanding != 0)
+	{
+		if (update(1e9) == 0) this_thread::sleep_for(chrono::milliseconds(1));
+	}
+}
@@ -0,0 +1,121 @@
+/* asset_loader.h
+   Loads textures and meshes in the background while the scene is already being
+   drawn. Reading the files, parsing OBJ files and decoding images run on worker
+   threads. Each finished job is pushed onto a lock-free list that the GL thread
+   takes whole in update(), which then does the GL uploads at the start of a frame
+   until its time budget is spent, so a burst of arrivals is spread over frames.
+   loadTexture() returns a texture name straight away that holds a small grey
+   placeholder until the image arrives, so it can be bound from the first frame.
+   A mesh has no placeholder of its own: TinyObjLoader::loaded() is false until
+   it is uploaded and the caller can draw something else in its place.
+   Everything except the work functions must be called on the GL thread.
+*/
+
+#pragma once
+
+#include "wrapper_glfw.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class TinyObjLoader;
+
+// Pixels of an image decoded by stb_image with 3 or 4 channels, rows tightly
+// packed from the top, or from the bottom when flipped to match OpenGL texture
+// coordinates. Empty when the file could not be decoded
+struct decoded_image
+{
+	std::vector<unsigned char> pixels;
+	int width, height, channels;
+};
+
+/* Safe to call from any thread, unlike stbi_set_flip_vertically_on_load() the flip
+   is done here for this image only */
+bool decode_image(const std::string& filename, bool flip, decoded_image& out);
+
+/* Replace the contents of a texture with the image. Without mipmaps the min filter is
+   set to GL_NEAREST as the default needs them, with them it is put back to the default.
+   Returns the GPU memory it takes, counting RGB as 4 bytes a texel as drivers pad it */
+size_t upload_texture(GLuint texture, const decoded_image& image, bool mipmaps);
+
+// One texture of a load_textures() batch, texture and bytes are filled in by the load
+struct texture_request
+{
+	texture_request(const std::string& filename, bool mipmaps, bool flip)
+		: filename(filename), mipmaps(mipmaps), flip(flip), texture(0), bytes(0) {}
+
+	std::string filename;
+	bool mipmaps;
+	bool flip;
+	GLuint texture;			// 0 when the file could not be decoded
+	size_t bytes;			// As returned by upload_texture()
+};
+
+/* Load a batch of textures before returning, for loads that can't wait for the
+   placeholders of asset_loader. The images are decoded all at once on threads of
+   its own, 0 meaning one per core, while the calling thread uploads them in order
+   as each is ready. Must be called on the GL thread. Returns the number loaded */
+size_t load_textures(std::vector<texture_request>& requests, unsigned threads = 0);
+
+class asset_loader
+{
+public:
+	asset_loader(unsigned threads = 0);		// 0 uses one less than the number of cores, up to 4
+	~asset_loader();						// Waits for the jobs that are running, drops the rest
+
+	// Run work on a worker thread, then finish on the GL thread in a later update()
+	void submit(std::function<void()> work, std::function<void()> finish);
+
+	// done runs on the GL thread once the load has finished or failed, with the bytes
+	// the texture takes when it succeeded
+	GLuint loadTexture(const std::string& filename, bool mipmaps, bool flip,
+					   std::function<void(bool ok, size_t bytes)> done = nullptr);
+	void loadObj(TinyObjLoader& obj, const std::string& filename, std::function<void(bool ok)> done = nullptr);
+
+	// Run the GL side of finished jobs until budget_ms has passed, at least one if any
+	// are waiting. Returns the number run
+	GLuint update(double budget_ms);
+
+	// Block until every job submitted so far has been finished
+	void finishAll();
+
+	bool idle() const { return outstanding == 0; }
+	GLuint pending() const { return outstanding; }
+
+	// Counters
+	GLuint textures_loaded;
+	GLuint meshes_loaded;
+	GLuint failed;
+	double upload_time;			// Milliseconds spent in finish functions, in total
+	double longest_update;		// Milliseconds of the slowest update()
+
+private:
+	struct job
+	{
+		std::function<void()> work;
+		std::function<void()> finish;
+		job* next;
+	};
+	void worker();
+
+	std::vector<std::thread> threads;
+	std::mutex queue_mutex;
+	std::condition_variable queue_ready;
+	std::deque<job*> queue;		// Submitted jobs waiting for a worker
+	bool stopping;
+
+	// Jobs whose work is done, pushed by the workers with a compare and swap and taken
+	// all at once by update(). They come off newest first and are turned round into ready
+	std::atomic<job*> completed;
+	std::deque<job*> ready;		// Only touched on the GL thread
+	std::atomic<GLuint> outstanding;
+
+	// Time from the first job of a batch to the loader going idle again
+	std::chrono::high_resolution_clock::time_point batch_start;
+};
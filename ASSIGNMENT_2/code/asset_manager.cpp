@@ -0,0 +1,249 @@
+/* asset_manager.cpp
+   Shared, reference counted textures and meshes, see asset_manager.h
+*/
+
+#include "asset_manager.h"
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <iostream>
+
+using namespace std;
+
+texture_asset::texture_asset()
+{
+	texture = 0;
+	ready = false;
+	failed = false;
+	bytes = 0;
+}
+
+texture_asset::~texture_asset()
+{
+	if (texture) glDeleteTextures(1, &texture);
+}
+
+mesh_asset::mesh_asset()
+{
+	ready = false;
+	failed = false;
+	bytes = 0;
+}
+
+
+asset_manager::asset_manager(asset_loader* loader) : loader(loader)
+{
+	loads = 0;
+	shared = 0;
+	evicted = 0;
+}
+
+asset_manager::~asset_manager()
+{
+}
+
+
+string asset_manager::normalizePath(const string& filename)
+{
+	string path = filename;
+	replace(path.begin(), path.end(), '\\', '/');
+
+	error_code ec;
+	filesystem::path absolute = filesystem::absolute(filesystem::path(path), ec);
+	string normal = (ec ? filesystem::path(path) : absolute).lexically_normal().generic_string();
+#ifdef _WIN32
+	transform(normal.begin(), normal.end(), normal.begin(), [](unsigned char c) { return char(tolower(c)); });
+#endif
+	return normal;
+}
+
+
+string asset_manager::textureKey(const string& filename, bool mipmaps, bool flip)
+{
+	return normalizePath(filename) + (mipmaps ? "|mipmaps" : "") + (flip ? "|flip" : "");
+}
+
+
+texture_handle asset_manager::loadTexture(const string& filename, bool mipmaps, bool flip)
+{
+	string key = textureKey(filename, mipmaps, flip);
+
+	lock_guard<mutex> lock(registry_mutex);
+	map<string, texture_handle>::iterator it = textures.find(key);
+	if (it != textures.end())
+	{
+		shared++;
+		return it->second;
+	}
+
+	// The callback holds a handle of its own until the load is over
+	texture_handle handle = make_shared<texture_asset>();
+	handle->key = key;
+	handle->texture = loader->loadTexture(filename, mipmaps, flip, [handle](bool ok, size_t bytes)
+	{
+		handle->ready = ok;
+		handle->failed = !ok;
+		handle->bytes = bytes;
+	});
+	textures[key] = handle;
+	loads++;
+	return handle;
+}
+
+
+/* The new handles are registered before the load so that a file named twice in the
+   batch is only loaded once. Loading is on this thread, so nothing can see them
+   before they are filled in */
+vector<texture_handle> asset_manager::loadTextures(const vector<string>& filenames, bool mipmaps, bool flip)
+{
+	vector<texture_handle> handles(filenames.size());
+	vector<texture_request> requests;
+	vector<texture_handle> requested;
+	{
+		lock_guard<mutex> lock(registry_mutex);
+		for (size_t i = 0; i < filenames.size(); i++)
+		{
+			string key = textureKey(filenames[i], mipmaps, flip);
+			map<string, texture_handle>::iterator it = textures.find(key);
+			if (it != textures.end())
+			{
+				shared++;
+				handles[i] = it->second;
+				continue;
+			}
+
+			handles[i] = make_shared<texture_asset>();
+			handles[i]->key = key;
+			textures[key] = handles[i];
+			requests.push_back(texture_request(filenames[i], mipmaps, flip));
+			requested.push_back(handles[i]);
+			loads++;
+		}
+	}
+
+	load_textures(requests);
+	for (size_t r = 0; r < requests.size(); r++)
+	{
+		requested[r]->texture = requests[r].texture;
+		requested[r]->bytes = requests[r].bytes;
+		requested[r]->ready = requests[r].texture != 0;
+		requested[r]->failed = requests[r].texture == 0;
+	}
+	return handles;
+}
+
+
+mesh_handle asset_manager::loadMesh(const string& filename, const mesh_options& options)
+{
+	string key = normalizePath(filename) + (options.generate_lods ? "|lods" : "") + (options.optimize_indices ? "|optimize" : "")
+		+ (options.quantize_attributes ? "|quantize" : "") + (options.material_textures ? "|textures" : "");
+
+	lock_guard<mutex> lock(registry_mutex);
+	map<string, mesh_handle>::iterator it = meshes.find(key);
+	if (it != meshes.end())
+	{
+		shared++;
+		return it->second;
+	}
+
+	mesh_handle handle = make_shared<mesh_asset>();
+	handle->key = key;
+	handle->mesh.generate_lods = options.generate_lods;
+	handle->mesh.optimize_indices = options.optimize_indices;
+	handle->mesh.quantize_attributes = options.quantize_attributes;
+
+	// Material textures are named relative to the obj file
+	size_t slash = filename.find_last_of("/\\");
+	string folder = slash == string::npos ? string() : filename.substr(0, slash + 1);
+	bool material_textures = options.material_textures;
+
+	loader->loadObj(handle->mesh, filename, [this, handle, folder, material_textures](bool ok)
+	{
+		handle->ready = ok;
+		handle->failed = !ok;
+		if (!ok) return;
+
+		// Materials without a texture are drawn with the one bound when the mesh is drawn.
+		// A file used by several materials comes back as the same handle
+		TinyObjLoader& mesh = handle->mesh;
+		vector<GLuint> names(mesh.materials.size(), 0);
+		for (size_t m = 0; m < mesh.materials.size() && material_textures; m++)
+		{
+			string texname = mesh.materials[m].diffuse_texname;
+			if (texname.empty()) continue;
+			texture_handle texture = loadTexture(folder + texname, true, false);
+			names[m] = texture->texture;
+			if (find(handle->textures.begin(), handle->textures.end(), texture) == handle->textures.end()) handle->textures.push_back(texture);
+		}
+		mesh.setMaterialTextures(names);
+		handle->bytes = mesh.memoryUsage();
+	});
+	meshes[key] = handle;
+	loads++;
+	return handle;
+}
+
+
+/* Meshes go first as they hold handles to their material textures, which can then
+   go in the same call */
+size_t asset_manager::collect()
+{
+	lock_guard<mutex> lock(registry_mutex);
+	size_t freed = 0;
+	for (map<string, mesh_handle>::iterator it = meshes.begin(); it != meshes.end(); )
+	{
+		if (it->second.use_count() > 1)
+		{
+			++it;
+			continue;
+		}
+		freed += it->second->bytes;
+		it = meshes.erase(it);
+		evicted++;
+	}
+	for (map<string, texture_handle>::iterator it = textures.begin(); it != textures.end(); )
+	{
+		if (it->second.use_count() > 1)
+		{
+			++it;
+			continue;
+		}
+		freed += it->second->bytes;
+		it = textures.erase(it);
+		evicted++;
+	}
+	return freed;
+}
+
+
+size_t asset_manager::memoryUsage() const
+{
+	lock_guard<mutex> lock(registry_mutex);
+	size_t bytes = 0;
+	for (map<string, texture_handle>::const_iterator it = textures.begin(); it != textures.end(); ++it) bytes += it->second->bytes;
+	for (map<string, mesh_handle>::const_iterator it = meshes.begin(); it != meshes.end(); ++it) bytes += it->second->bytes;
+	return bytes;
+}
+
+
+void asset_manager::print() const
+{
+	size_t total = memoryUsage();
+	lock_guard<mutex> lock(registry_mutex);
+	cout << "Assets: " << textures.size() << " textures, " << meshes.size() << " meshes, " << total / 1024 << " KB, "
+		<< loads << " loads, " << shared << " shared, " << evicted << " evicted" << endl;
+
+	// The registry's own handle isn't counted
+	for (map<string, mesh_handle>::const_iterator it = meshes.begin(); it != meshes.end(); ++it)
+	{
+		const mesh_asset& a = *it->second;
+		cout << "\t" << a.key << ": " << it->second.use_count() - 1 << " handles, " << a.bytes / 1024 << " KB"
+			<< (a.ready ? "" : a.failed ? ", failed" : ", loading") << endl;
+	}
+	for (map<string, texture_handle>::const_iterator it = textures.begin(); it != textures.end(); ++it)
+	{
+		const texture_asset& a = *it->second;
+		cout << "\t" << a.key << ": " << it->second.use_count() - 1 << " handles, " << a.bytes / 1024 << " KB"
+			<< (a.ready ? "" : a.failed ? ", failed" : ", loading") << endl;
+	}
+}
@@ -0,0 +1,104 @@
+/* asset_manager.h
+   Registry of the textures and meshes in use, so that each file is loaded once
+   however many places ask for it. Assets are keyed by their normalised path and
+   the options that change what the load produces. Asking for a key that is already
+   loaded, or still loading, returns the same shared handle without starting
+   another load. The loads themselves go through asset_loader, so a new handle
+   holds a placeholder (or an unloaded mesh) until the asset arrives, apart from
+   loadTextures() which has them all loaded before it returns.
+   The registry holds a handle to every asset too. collect() evicts the ones that
+   nothing else holds any more; a load in flight holds its own handle so it is never
+   evicted half way. Each asset records the memory it takes.
+   Loading and releasing the last handle make GL calls, so they belong on the GL
+   thread; the registry itself is locked and can be read from any thread.
+*/
+
+#pragma once
+
+#include "wrapper_glfw.h"
+#include "asset_loader.h"
+#include "tiny_loader.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct texture_asset
+{
+	texture_asset();
+	~texture_asset();		// Deletes the texture
+
+	GLuint texture;			// Holds a grey placeholder until ready
+	bool ready;
+	bool failed;			// The placeholder stays
+	size_t bytes;			// GPU memory including the mipmaps
+	std::string key;
+};
+typedef std::shared_ptr<texture_asset> texture_handle;
+
+struct mesh_asset
+{
+	mesh_asset();
+
+	TinyObjLoader mesh;		// Draws nothing until ready
+	std::vector<texture_handle> textures;	// Material textures, held for as long as the mesh
+	bool ready;
+	bool failed;
+	size_t bytes;			// TinyObjLoader::memoryUsage(), the textures are counted on their own
+	std::string key;
+};
+typedef std::shared_ptr<mesh_asset> mesh_handle;
+
+// TinyObjLoader settings that change the mesh that is loaded, so meshes loaded
+// with different ones are kept apart
+struct mesh_options
+{
+	mesh_options() : generate_lods(true), optimize_indices(true), quantize_attributes(true), material_textures(true) {}
+
+	bool generate_lods;
+	bool optimize_indices;
+	bool quantize_attributes;
+	bool material_textures;		// Load the diffuse textures the materials name, from the folder of the obj file
+};
+
+class asset_manager
+{
+public:
+	asset_manager(asset_loader* loader);
+	// Drops the registry's handles, assets still held elsewhere live on. Delete the
+	// loader first, as its unfinished mesh loads call back into the manager
+	~asset_manager();
+
+	texture_handle loadTexture(const std::string& filename, bool mipmaps, bool flip);
+	mesh_handle loadMesh(const std::string& filename, const mesh_options& options = mesh_options());
+
+	// Textures needed from the first frame, loaded before returning with load_textures()
+	// so the images are decoded in parallel. Ones already registered are shared as they
+	// are, a texture that fails has the name 0
+	std::vector<texture_handle> loadTextures(const std::vector<std::string>& filenames, bool mipmaps, bool flip);
+
+	// Evict every asset that only the registry holds. Returns the bytes freed. Nothing
+	// is evicted without it; the app calls it whenever the loader has finished its loads
+	size_t collect();
+
+	size_t memoryUsage() const;
+	void print() const;		// Each asset with the number of handles to it and its memory
+
+	// Separators made forward slashes, . and .. taken out and made absolute, and on
+	// Windows lower case, so that different spellings of a file give the same key
+	static std::string normalizePath(const std::string& filename);
+
+	// Counters
+	GLuint loads;			// Loads started
+	GLuint shared;			// Requests answered with an existing handle
+	GLuint evicted;
+
+private:
+	static std::string textureKey(const std::string& filename, bool mipmaps, bool flip);
+
+	asset_loader* loader;
+	mutable std::mutex registry_mutex;
+	std::map<std::string, texture_handle> textures;
+	std::map<std::string, mesh_handle> meshes;
+};
@@ -0,0 +1,1393 @@
+/* benchmarks.cpp
+   Timing runs for the particle and mesh code, see benchmarks.h
+*/
+
+#include "benchmarks.h"
+#include "snow_cover.h"
+#include "parallel.h"
+#include "points.h"
+#include "wind_field.h"
+#include "spatial_hash.h"
+#include "particle_quads.h"
+#include "obj_parser.h"
+#include "mapped_file.h"
+#include "mesh_cache.h"
+#include "tiny_loader.h"
+#include "mesh_simplify.h"
+#include "mesh_optimize.h"
+#include "meshlet.h"
+#include "mesh_quantize.h"
+#include "mesh_codec.h"
+#include "terrain_object.h"
+#include "asset_loader.h"
+#include "asset_manager.h"
+#include "bounds.h"
+#include "oit_buffer.h"
+#include <filesystem>
+#include "glm/gtc/matrix_transform.hpp"
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+using namespace std;
+using namespace glm;
+
+typedef chrono::high_resolution_clock bench_clock;
+
+/* Milliseconds since start */
+static double elapsed_ms(bench_clock::time_point start)
+{
+	return chrono::duration<double, milli>(bench_clock::now() - start).count();
+}
+
+
+void run_benchmarks(GLWrapper* glw)
+{
+	cout << "Running benchmarks" << endl;
+
+	benchmark_particle_init(1000000);
+
+	benchmark_snow_cover(10000, 100);
+	benchmark_snow_cover(100000, 100);
+	benchmark_snow_cover(1000000, 20);
+
+	benchmark_depth_sort(100000, 20);
+	benchmark_depth_sort(1000000, 20);
+
+	benchmark_wind_field(1000000, 20);
+
+	benchmark_spatial_hash(1000000, 0.5f, 100000);
+	benchmark_spatial_hash(1000000, 1.f, 100000);
+
+	benchmark_culling(1000000, 20);
+
+	benchmark_particle_renderers(glw, 100000, 50);
+	benchmark_particle_renderers(glw, 1000000, 20);
+
+	benchmark_obj_parser(50);
+	benchmark_mesh_cache(50);
+	benchmark_normal_generation(50);
+
+	benchmark_draw_object(100, 100);
+
+	benchmark_lod_forest(32, 400);
+
+	benchmark_vertex_cache(400);
+
+	benchmark_cluster_culling(400);
+
+	benchmark_quantization(400);
+
+	benchmark_mesh_codec(400);
+	benchmark_mesh_codec(1000);
+	benchmark_compressed_cache("..\\ASSIGNMENT_2\\code\\tree.obj", 0);
+	benchmark_compressed_cache(nullptr, 50);
+
+	benchmark_async_loading("..\\ASSIGNMENT_2\\code\\grass.jpg", 30, 2.0);
+	benchmark_asset_manager("..\\ASSIGNMENT_2\\code\\grass.jpg", "..\\ASSIGNMENT_2\\code\\tree.obj", 100);
+
+	benchmark_bounds(1000001, 20);
+
+	benchmark_texture_batch("..\\ASSIGNMENT_2\\code\\grass.jpg", 3);
+	benchmark_texture_batch("..\\ASSIGNMENT_2\\code\\grass.jpg", 30);
+	benchmark_texture_batch("..\\ASSIGNMENT_2\\code\\grass.jpg", 300);
+
+	check_gpu_simulation(glw, 100000, 1000);
+	check_oit(glw);
+}
+
+
+/* Startup cost of the particle positions and velocities: the old loop that made a
+   random_device and mt19937 for every particle against the seeded bulk fill.
+   Two fills with the same seed must give identical particles */
+void benchmark_particle_init(GLuint numpoints)
+{
+	vector<vec3> vertices(numpoints), colours(numpoints), velocity(numpoints);
+	bench_clock::time_point t = bench_clock::now();
+	for (GLuint i = 0; i < numpoints; i++)
+	{
+		random_device rd;
+		mt19937 gen(rd());
+		uniform_real_distribution<> disxz(-50.0, 50.0);
+		uniform_real_distribution<> disy(-50.0, 50.0);
+		uniform_real_distribution<> disv(-0.005, -0.00025);
+
+		vertices[i] = vec3(disxz(gen), disy(gen), disxz(gen));
+		colours[i] = vec3(1.f, 1.f, 1.f);
+		velocity[i] = vec3(0.f, disv(gen), 0.f);
+	}
+	double old_time = elapsed_ms(t);
+
+	points a(numpoints, 1.f, 0.1f), b(numpoints, 1.f, 0.1f);
+	a.seed = b.seed = 1234;
+
+	t = bench_clock::now();
+	a.initialise();
+	double bulk_time = elapsed_ms(t);
+	b.initialise();
+
+	bool same = equal(a.vertices, a.vertices + numpoints, b.vertices) &&
+				equal(a.velocity, a.velocity + numpoints, b.velocity);
+
+	cout << "particle init: " << numpoints << " particles, per particle mt19937 " << old_time
+		<< " ms, seeded bulk fill " << bulk_time << " ms, " << (same ? "reproducible" : "NOT reproducible") << endl;
+}
+
+
+/* Land impacts_per_frame particles on a 256x256 snow grid each frame, binned over
+   the worker threads as the particle update does, then merge and upload the dirty tiles */
+void benchmark_snow_cover(GLuint impacts_per_frame, GLuint frames)
+{
+	snow_cover snow(256, 256, 100.f, 100.f);
+	snow.depth_per_impact = 0.0001f;
+	snow.create();
+
+	unsigned chunks = parallel_chunks(impacts_per_frame);
+	vector<vector<GLuint>> bins(chunks);
+
+	double bin_time = 0, deposit_time = 0, upload_time = 0;
+	GLuint tiles = 0;
+
+	for (GLuint f = 0; f < frames; f++)
+	{
+		bench_clock::time_point start = bench_clock::now();
+		parallel_for(impacts_per_frame, chunks, [&](size_t begin, size_t end, unsigned chunk)
+		{
+			// Impacts are concentrated in one area to mimic a drift
+			mt19937 gen(f * 1000 + chunk);
+			normal_distribution<float> dis(10.f, 15.f);
+			for (size_t i = begin; i < end; i++)
+			{
+				bins[chunk].push_back(snow.cellAtPosition(dis(gen), dis(gen)));
+			}
+		});
+		bin_time += elapsed_ms(start);
+
+		start = bench_clock::now();
+		snow.deposit(bins);
+		deposit_time += elapsed_ms(start);
+
+		start = bench_clock::now();
+		snow.update();
+		glFinish();
+		upload_time += elapsed_ms(start);
+		tiles += snow.tiles_uploaded;
+	}
+
+	double impacts = double(impacts_per_frame) * frames;
+	cout << "snow_cover: " << impacts_per_frame << " impacts/frame over " << chunks << " bins" << endl;
+	cout << "\tbinning " << bin_time / frames << " ms/frame, deposit " << deposit_time / frames
+		<< " ms/frame (" << impacts / (deposit_time * 1000.0) << " M impacts/s)" << endl;
+	cout << "\tupload " << upload_time / frames << " ms/frame, " << double(tiles) / frames
+		<< " of " << snow.xtiles * snow.ztiles << " tiles/frame" << endl;
+}
+
+
+/* Sort numpoints particles by view depth with the camera orbiting the scene */
+void benchmark_depth_sort(GLuint numpoints, GLuint frames)
+{
+	points particles(numpoints, 1.f, 0.1f);
+	particles.create();
+
+	double total = 0;
+	for (GLuint f = 0; f < frames; f++)
+	{
+		float a = radians(360.f * f / frames);
+		mat4 view = lookAt(vec3(60.f * sin(a), 20.f, 60.f * cos(a)), vec3(0, 0, 0), vec3(0, 1, 0));
+		particles.sortByDepth(view);
+		total += particles.sort_time;
+		particles.animate();
+	}
+
+	double ms = total / frames;
+	cout << "depth sort: " << numpoints << " particles " << ms << " ms/frame ("
+		<< ms * 1000000.0 / numpoints << " ms per million)" << endl;
+}
+
+
+/* Cost of the cached curl noise wind: the full grid build, the per frame slice
+   refresh and the extra time the lookups add to the particle update */
+void benchmark_wind_field(GLuint numpoints, GLuint frames)
+{
+	wind_field wind(32, 16, 32, vec3(-50.f, -5.f, -50.f), vec3(50.f, 25.f, 50.f));
+
+	bench_clock::time_point t = bench_clock::now();
+	wind.create();
+	double create_time = elapsed_ms(t);
+
+	double update_time = 0;
+	for (GLuint f = 0; f < frames; f++)
+	{
+		t = bench_clock::now();
+		wind.update();
+		update_time += elapsed_ms(t);
+	}
+
+	points particles(numpoints, 1.f, 0.1f);
+	particles.create();
+
+	t = bench_clock::now();
+	for (GLuint f = 0; f < frames; f++) particles.animate();
+	double still_time = elapsed_ms(t);
+
+	particles.attachWind(&wind);
+	t = bench_clock::now();
+	for (GLuint f = 0; f < frames; f++) particles.animate();
+	double wind_time = elapsed_ms(t);
+
+	GLuint cells = wind.nx * wind.ny * wind.nz;
+	cout << "wind field: " << cells << " cells, full build " << create_time << " ms, "
+		<< wind.slices_per_update << " slices/frame " << update_time / frames << " ms" << endl;
+	cout << "\t" << numpoints << " particles: update " << still_time / frames << " ms/frame without wind, "
+		<< wind_time / frames << " ms/frame with wind" << endl;
+}
+
+
+/* Build a spatial hash over numpoints random particles in the snow volume and
+   run neighbour queries with the radius equal to the cell size */
+void benchmark_spatial_hash(GLuint numpoints, GLfloat cell_size, GLuint queries)
+{
+	vector<vec3> positions(numpoints);
+	mt19937 gen(1);
+	uniform_real_distribution<float> disxz(-50.f, 50.f), disy(-5.f, 25.f);
+	for (GLuint i = 0; i < numpoints; i++) positions[i] = vec3(disxz(gen), disy(gen), disxz(gen));
+
+	spatial_hash hash(cell_size, numpoints);
+
+	const GLuint builds = 10;
+	double build_time = 0;
+	for (GLuint b = 0; b < builds; b++)
+	{
+		hash.build(&positions[0], numpoints);
+		build_time += hash.build_time;
+	}
+
+	bench_clock::time_point t = bench_clock::now();
+	size_t visited = 0, found = 0;
+	for (GLuint q = 0; q < queries; q++)
+	{
+		visited += hash.forEachNeighbour(positions[q % numpoints], cell_size, [&](GLuint /*j*/, const vec3& /*p*/) { found++; });
+	}
+	double query_time = elapsed_ms(t);
+
+	cout << "spatial hash: " << numpoints << " particles, cell size " << cell_size << ", "
+		<< hash.table_size << " buckets, build " << build_time / builds << " ms" << endl;
+	cout << "\t" << double(visited) / queries << " particles visited and " << double(found) / queries
+		<< " neighbours found per query, " << query_time * 1000.0 / queries << " us/query" << endl;
+}
+
+
+/* Compare the particles drawn and the bytes uploaded per frame with and without
+   culling, using the same camera and scale as the scene in lab5solution.cpp */
+void benchmark_culling(GLuint numpoints, GLuint frames)
+{
+	points particles(numpoints, 1.f, 0.1f);
+	particles.create();
+
+	mat4 projection = perspective(radians(30.0f), 1.3333f, 0.1f, 100.0f);
+	mat4 view = lookAt(vec3(0, 2, 5), vec3(0, 0, 0), vec3(0, 1, 0));
+	mat4 model = scale(mat4(1.0f), vec3(0.0125f, 0.0125f, 0.0125f));
+
+	// Close in, so that most of the particles are off screen
+	model = scale(model, vec3(8.f, 8.f, 8.f));
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		particles.culling = (pass == 1);
+		double cull_time = 0;
+		size_t bytes = 0;
+		for (GLuint f = 0; f < frames; f++)
+		{
+			bench_clock::time_point t = bench_clock::now();
+			if (particles.culling) particles.cull(projection, view * model);
+			cull_time += elapsed_ms(t);
+
+			particles.draw();
+			bytes += particles.upload_bytes;
+			particles.animate();
+		}
+		glFinish();
+
+		GLuint drawn = particles.culling ? particles.numvisible : numpoints;
+		cout << "culling " << (particles.culling ? "on: " : "off: ") << drawn << " of " << numpoints
+			<< " particles drawn, " << bytes / frames / 1024 << " KB/frame uploaded";
+		if (particles.culling) cout << ", cull " << cull_time / frames << " ms/frame";
+		cout << endl;
+	}
+}
+
+
+/* Draw the same particles as point sprites and as instanced quads and compare the
+   particles and vertices processed per second. The quad instances are packed once,
+   their build time is reported separately */
+void benchmark_particle_renderers(GLWrapper* glw, GLuint numpoints, GLuint frames)
+{
+	points particles(numpoints, 1.f, 0.1f);
+	particles.create();
+
+	GLuint points_program = glw->LoadShader("..\\ASSIGNMENT_2\\code\\point_sprites.vert", "..\\ASSIGNMENT_2\\code\\point_sprites_analytic.frag");
+	particle_quads quads;
+	quads.create(glw);
+
+	mat4 projection = perspective(radians(30.0f), 1.3333f, 0.1f, 100.0f);
+	mat4 view = lookAt(vec3(0, 0, 4), vec3(0, 0, 0), vec3(0, 1, 0));
+	mat4 model = scale(mat4(1.0f), vec3(0.0125f, 0.0125f, 0.0125f));
+	const GLfloat size = 8.f;
+
+	glEnable(GL_BLEND);
+	glEnable(GL_PROGRAM_POINT_SIZE);
+
+	// Point sprites
+	glUseProgram(points_program);
+	glUniformMatrix4fv(glGetUniformLocation(points_program, "model"), 1, GL_FALSE, &model[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(points_program, "view"), 1, GL_FALSE, &view[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(points_program, "projection"), 1, GL_FALSE, &projection[0][0]);
+	glUniform1f(glGetUniformLocation(points_program, "size"), size);
+	particles.draw();
+	glFinish();
+
+	bench_clock::time_point t = bench_clock::now();
+	for (GLuint f = 0; f < frames; f++) particles.draw();
+	glFinish();
+	double points_time = elapsed_ms(t) / frames;
+
+	// Instanced quads
+	t = bench_clock::now();
+	quads.build(&particles, view * model);
+	double build_time = elapsed_ms(t);
+	quads.draw(model, view, projection, false);
+	glFinish();
+
+	t = bench_clock::now();
+	for (GLuint f = 0; f < frames; f++) quads.draw(model, view, projection, false);
+	glFinish();
+	double quads_time = elapsed_ms(t) / frames;
+
+	glDisable(GL_BLEND);
+	glDeleteProgram(points_program);
+
+	cout << "particle renderers: " << numpoints << " particles" << endl;
+	cout << "\tpoint sprites " << points_time << " ms/frame, " << numpoints / (points_time * 1000.0)
+		<< " M particles/s, " << numpoints / (points_time * 1000.0) << " M vertices/s" << endl;
+	cout << "\tinstanced quads " << quads_time << " ms/frame, " << numpoints / (quads_time * 1000.0)
+		<< " M particles/s, " << 4.0 * numpoints / (quads_time * 1000.0) << " M vertices/s, build "
+		<< build_time << " ms, " << sizeof(quad_instance) << " bytes/instance" << endl;
+}
+
+
+/* Write a height field grid as an OBJ file with positions, texture coords, normals
+   and v/vt/vn triangles, roughly the shape of a scanned mesh. With positions_only
+   there are no vt or vn lines, like a raw scan. Returns the file size */
+static size_t write_test_obj(const char* filename, GLuint n, bool positions_only = false)
+{
+	ofstream file(filename, ios::binary);
+	if (!file) return 0;
+
+	mt19937 gen(1);
+	uniform_real_distribution<float> dis(-1.f, 1.f);
+	char line[256];
+	size_t size = 0;
+	for (GLuint z = 0; z < n; z++)
+	{
+		for (GLuint x = 0; x < n; x++)
+		{
+			int len = positions_only ?
+				snprintf(line, sizeof(line), "v %f %f %f\n", x * 0.01f, dis(gen), z * 0.01f) :
+				snprintf(line, sizeof(line), "v %f %f %f\nvt %f %f\nvn %f %f %f\n", x * 0.01f, dis(gen), z * 0.01f,
+						 float(x) / n, float(z) / n, dis(gen) * 0.1f, 1.f, dis(gen) * 0.1f);
+			file.write(line, len);
+			size += len;
+		}
+	}
+	for (GLuint z = 0; z + 1 < n; z++)
+	{
+		for (GLuint x = 0; x + 1 < n; x++)
+		{
+			GLuint a = z * n + x + 1, b = a + 1, c = a + n, d = c + 1;
+			int len = positions_only ?
+				snprintf(line, sizeof(line), "f %u %u %u\nf %u %u %u\n", a, c, b, b, c, d) :
+				snprintf(line, sizeof(line), "f %u/%u/%u %u/%u/%u %u/%u/%u\nf %u/%u/%u %u/%u/%u %u/%u/%u\n",
+						 a, a, a, c, c, c, b, b, b, b, b, b, c, c, c, d, d, d);
+			file.write(line, len);
+			size += len;
+		}
+	}
+
+	return file ? size : 0;
+}
+
+
+/* Parse a generated OBJ of about size_mb megabytes with tinyobj::LoadObj and
+   with the chunked parser on one thread and on all threads, and report MB/s */
+void benchmark_obj_parser(GLuint size_mb)
+{
+	const char* filename = "benchmark_mesh.obj";
+
+	// About 200 bytes of text per grid point
+	GLuint n = GLuint(sqrt(size_mb * 1024.0 * 1024.0 / 200.0));
+	size_t bytes = write_test_obj(filename, n);
+	if (!bytes)
+	{
+		cout << "obj parser: could not write " << filename << endl;
+		return;
+	}
+	double mb = bytes / (1024.0 * 1024.0);
+
+	tinyobj::attrib_t attrib;
+	vector<tinyobj::shape_t> shapes;
+	vector<tinyobj::material_t> materials;
+	string warn, err;
+
+	bench_clock::time_point t = bench_clock::now();
+	tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filename);
+	double tinyobj_time = elapsed_ms(t);
+	size_t tinyobj_vertices = attrib.vertices.size(), tinyobj_indices = shapes.empty() ? 0 : shapes[0].mesh.indices.size();
+
+	// Reading into a buffer against mapping the file
+	t = bench_clock::now();
+	vector<char> data(bytes);
+	ifstream in(filename, ios::binary);
+	in.read(&data[0], bytes);
+	double copy_time = elapsed_ms(t);
+
+	t = bench_clock::now();
+	mapped_file file;
+	file.open(filename);
+	double map_time = elapsed_ms(t);
+
+	// Single chunk over the mapped bytes, to separate the parser itself from the threading
+	t = bench_clock::now();
+	parse_obj_parallel(file.data, file.size, "", &attrib, &shapes, &materials, &warn, &err, 1);
+	double single_time = elapsed_ms(t);
+	file.close();
+
+	obj_parse_stats stats;
+	t = bench_clock::now();
+	load_obj_parallel(filename, &attrib, &shapes, &materials, &warn, &err, &stats);
+	double parallel_time = elapsed_ms(t);
+
+	bool same = attrib.vertices.size() == tinyobj_vertices && !shapes.empty() && shapes[0].mesh.indices.size() == tinyobj_indices;
+	remove(filename);
+
+	cout << "obj parser: " << mb << " MB, " << tinyobj_vertices / 3 << " vertices, "
+		<< tinyobj_indices / 3 << " triangles" << (same ? "" : " (COUNTS DIFFER)") << endl;
+	cout << "\tread into buffer " << copy_time << " ms, map " << map_time << " ms" << endl;
+	cout << "\ttinyobj::LoadObj " << tinyobj_time << " ms (" << mb * 1000.0 / tinyobj_time << " MB/s)" << endl;
+	cout << "\tchunked, 1 thread " << single_time << " ms (" << mb * 1000.0 / single_time << " MB/s)" << endl;
+	cout << "\tchunked, " << stats.chunks << " threads " << parallel_time << " ms (" << mb * 1000.0 / parallel_time
+		<< " MB/s), read " << stats.read_time << " ms, parse " << stats.parse_time << " ms, merge " << stats.merge_time << " ms" << endl;
+}
+
+
+/* Load a generated OBJ through TinyObjLoader with no cache (parse and write the cache),
+   with the cache, and with the cache after the OBJ's time has changed but not its contents */
+void benchmark_mesh_cache(GLuint size_mb)
+{
+	const char* filename = "benchmark_cache.obj";
+	GLuint n = GLuint(sqrt(size_mb * 1024.0 * 1024.0 / 200.0));
+	size_t bytes = write_test_obj(filename, n);
+	if (!bytes)
+	{
+		cout << "mesh cache: could not write " << filename << endl;
+		return;
+	}
+	TinyObjLoader cold, warm, touched;
+	string cache_path = mesh_cache::cachePath(filename, cold.cacheOptions());
+	remove(cache_path.c_str());
+
+	cold.load_obj(filename);
+	warm.load_obj(filename);
+
+	filesystem::last_write_time(filename, filesystem::file_time_type::clock::now());
+	touched.load_obj(filename);
+
+	error_code ec;
+	uintmax_t cache_bytes = filesystem::file_size(cache_path, ec);
+	remove(filename);
+	remove(cache_path.c_str());
+
+	cout << "mesh cache: " << bytes / (1024.0 * 1024.0) << " MB obj, " << cache_bytes / (1024.0 * 1024.0) << " MB cache" << endl;
+	cout << "\tcold (parse and write cache) " << cold.load_time << " ms, warm " << warm.load_time
+		<< " ms" << (warm.loaded_from_cache ? "" : " (CACHE NOT USED)") << ", touched source " << touched.load_time
+		<< " ms" << (touched.loaded_from_cache ? "" : " (CACHE NOT USED)") << endl;
+}
+
+
+/* Load a generated scan-like OBJ of about size_mb megabytes that has only positions
+   and triangles, so the normals have to be generated. The load prints the time
+   taken by each step */
+void benchmark_normal_generation(GLuint size_mb)
+{
+	const char* filename = "benchmark_scan.obj";
+	GLuint n = GLuint(sqrt(size_mb * 1024.0 * 1024.0 / 60.0));
+	size_t bytes = write_test_obj(filename, n, true);
+	if (!bytes)
+	{
+		cout << "normal generation: could not write " << filename << endl;
+		return;
+	}
+
+	TinyObjLoader scan;
+	scan.use_cache = false;
+	scan.generate_lods = false;
+	scan.load_obj(filename);
+	remove(filename);
+
+	cout << "normal generation: " << bytes / (1024.0 * 1024.0) << " MB obj without normals, " << n * n << " vertices, "
+		<< 2 * (n - 1) * (n - 1) << " triangles, loaded in " << scan.load_time << " ms on "
+		<< parallel_chunks(size_t(n) * n) << " threads" << endl;
+}
+
+
+/* Flat n x n vertex grid in the xz plane with normals, texture coords and colours,
+   used by the mesh benchmarks that need a mesh_data without going through a file */
+static void make_grid_mesh(mesh_data& mesh, GLuint n)
+{
+	mesh = mesh_data();
+	for (GLuint z = 0; z < n; z++)
+	{
+		for (GLuint x = 0; x < n; x++)
+		{
+			GLfloat u = GLfloat(x) / (n - 1), v = GLfloat(z) / (n - 1);
+			mesh.positions.insert(mesh.positions.end(), { u - 0.5f, 0.f, v - 0.5f });
+			mesh.normals.insert(mesh.normals.end(), { 0.f, 1.f, 0.f });
+			mesh.texcoords.insert(mesh.texcoords.end(), { u, v });
+			mesh.colours.insert(mesh.colours.end(), { u, v, 1.f, 1.f });
+		}
+	}
+	for (GLuint z = 0; z + 1 < n; z++)
+	{
+		for (GLuint x = 0; x + 1 < n; x++)
+		{
+			GLuint i = z * n + x;
+			mesh.indices.insert(mesh.indices.end(), { i, i + n, i + 1, i + 1, i + n, i + n + 1 });
+		}
+	}
+	mesh.computeBounds();
+	mesh.computeRanges(vector<GLint>(mesh.indices.size() / 3, -1));
+}
+
+
+/* CPU cost of TinyObjLoader::drawObject. The old path kept four separate vertex
+   buffers and set up every attribute pointer on each draw, it is rebuilt here for
+   comparison with the interleaved buffer and per-mesh VAO. The meshes are small so
+   the time is the driver and state setup, not the GPU */
+void benchmark_draw_object(GLuint meshes, GLuint frames)
+{
+	mesh_data mesh;
+	make_grid_mesh(mesh, 16);
+	mesh_view view = mesh.view();
+
+	// Float vertices, so only the buffer layout differs from the old upload
+	vector<TinyObjLoader> objects(meshes);
+	for (GLuint m = 0; m < meshes; m++)
+	{
+		objects[m].quantize_attributes = false;
+		objects[m].upload(view);
+	}
+
+	// Separate position, colour, normal and texcoord buffers like the old upload
+	struct separate_buffers { GLuint buffers[4]; GLuint elements; };
+	vector<separate_buffers> old_objects(meshes);
+	const vector<GLfloat>* arrays[4] = { &mesh.positions, &mesh.colours, &mesh.normals, &mesh.texcoords };
+	const GLint sizes[4] = { 3, 4, 3, 2 };
+	const GLuint attributes[4] = { 0, 1, 2, 3 };
+	for (GLuint m = 0; m < meshes; m++)
+	{
+		glGenBuffers(4, old_objects[m].buffers);
+		for (int a = 0; a < 4; a++)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, old_objects[m].buffers[a]);
+			glBufferData(GL_ARRAY_BUFFER, arrays[a]->size() * sizeof(GLfloat), &(*arrays[a])[0], GL_STATIC_DRAW);
+		}
+		glGenBuffers(1, &old_objects[m].elements);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, old_objects[m].elements);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(GLuint), &mesh.indices[0], GL_STATIC_DRAW);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	GLint previous_vao;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous_vao);
+	GLuint shared_vao;
+	glGenVertexArrays(1, &shared_vao);
+	glBindVertexArray(shared_vao);
+
+	GLsizei count = GLsizei(mesh.indices.size());
+	auto draw_old = [&](const separate_buffers& b)
+	{
+		for (int a = 0; a < 4; a++)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, b.buffers[a]);
+			glEnableVertexAttribArray(attributes[a]);
+			glVertexAttribPointer(attributes[a], sizes[a], GL_FLOAT, GL_FALSE, 0, 0);
+		}
+		glPointSize(3.f);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, b.elements);
+		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, (GLvoid*)(0));
+	};
+
+	// One untimed frame of each so that the driver has seen all the buffers
+	for (GLuint m = 0; m < meshes; m++) draw_old(old_objects[m]);
+	for (GLuint m = 0; m < meshes; m++) objects[m].drawObject(0);
+	glFinish();
+
+	double old_time = 0, vao_time = 0;
+	for (GLuint f = 0; f < frames; f++)
+	{
+		bench_clock::time_point t = bench_clock::now();
+		for (GLuint m = 0; m < meshes; m++) draw_old(old_objects[m]);
+		old_time += elapsed_ms(t);
+		glFinish();
+
+		t = bench_clock::now();
+		for (GLuint m = 0; m < meshes; m++) objects[m].drawObject(0);
+		vao_time += elapsed_ms(t);
+		glFinish();
+	}
+
+	glBindVertexArray(previous_vao);
+	glDeleteVertexArrays(1, &shared_vao);
+	for (GLuint m = 0; m < meshes; m++)
+	{
+		glDeleteBuffers(4, old_objects[m].buffers);
+		glDeleteBuffers(1, &old_objects[m].elements);
+	}
+
+	double draws = double(meshes) * frames;
+	cout << "drawObject: " << meshes << " meshes of " << count / 3 << " triangles" << endl;
+	cout << "\tseparate buffers, attributes set per draw " << old_time * 1000.0 / draws << " us/draw (CPU)" << endl;
+	cout << "\tinterleaved buffer, per mesh VAO " << vao_time * 1000.0 / draws << " us/draw (CPU), "
+		<< sizeof(mesh_vertex) << " bytes/vertex" << endl;
+}
+
+
+/* Bumpy sphere of radius about 1 made from an n x n latitude and longitude grid, with
+   a texture seam down one side and the top and bottom halves in different materials */
+static void make_blob_mesh(mesh_data& mesh, GLuint n)
+{
+	mesh = mesh_data();
+	const GLfloat pi = 3.14159265f;
+	for (GLuint j = 0; j <= n; j++)
+	{
+		for (GLuint i = 0; i <= n; i++)
+		{
+			GLfloat theta = pi * j / n, phi = 2.f * pi * (i % n) / n;
+			GLfloat r = 1.f + 0.05f * sin(5.f * theta) * sin(4.f * phi) + 0.02f * sin(23.f * theta) * sin(17.f * phi);
+			vec3 p(r * sin(theta) * cos(phi), r * cos(theta), r * sin(theta) * sin(phi));
+			if (j == 0 || j == n) p = vec3(0.f, r * cos(theta), 0.f);
+			mesh.positions.insert(mesh.positions.end(), { p.x, p.y, p.z });
+			mesh.normals.insert(mesh.normals.end(), { p.x / r, p.y / r, p.z / r });
+			mesh.texcoords.insert(mesh.texcoords.end(), { GLfloat(i) / n, GLfloat(j) / n });
+			mesh.colours.insert(mesh.colours.end(), { 1.f, 1.f, 1.f, 1.f });
+		}
+	}
+
+	vector<GLint> triangle_materials;
+	for (GLuint j = 0; j < n; j++)
+	{
+		for (GLuint i = 0; i < n; i++)
+		{
+			GLuint a = j * (n + 1) + i, b = a + n + 1;
+			GLint material = j < n / 2 ? 0 : 1;
+			// Skip the triangles that collapse to a point at the poles
+			if (j > 0)
+			{
+				mesh.indices.insert(mesh.indices.end(), { a, b, a + 1 });
+				triangle_materials.push_back(material);
+			}
+			if (j < n - 1)
+			{
+				mesh.indices.insert(mesh.indices.end(), { a + 1, b, b + 1 });
+				triangle_materials.push_back(material);
+			}
+		}
+	}
+
+	mesh.materials.resize(2);
+	memset(&mesh.materials[0], 0, 2 * sizeof(mesh_material));
+	mesh.computeRanges(triangle_materials);
+	mesh.computeBounds();
+}
+
+
+/* A rows x rows forest of copies of one mesh on a 3 unit grid, seen from eye height at
+   the edge of the forest like the main scene camera. Reports the triangles drawn in a
+   frame at full detail and with the level of detail picked by screen size */
+void benchmark_lod_forest(GLuint rows, GLuint mesh_size)
+{
+	mesh_data mesh;
+	make_blob_mesh(mesh, mesh_size);
+
+	bench_clock::time_point t = bench_clock::now();
+	build_lod_chain(mesh);
+	double build_time = elapsed_ms(t);
+
+	TinyObjLoader tree;
+	tree.upload(mesh.view());
+
+	const GLfloat viewport_height = 720.f;
+	mat4 projection = perspective(radians(30.0f), 1.3333f, 0.1f, 100.0f);
+	mat4 view = lookAt(vec3(0.f, 1.7f, -5.f), vec3(0.f, 1.f, 10.f), vec3(0, 1, 0));
+
+	GLuint full_triangles = tree.lods[0].num_indices / 3;
+	double full = 0, drawn = 0;
+	vector<GLuint> per_level(tree.lods.size(), 0);
+	t = bench_clock::now();
+	for (GLuint z = 0; z < rows; z++)
+	{
+		for (GLuint x = 0; x < rows; x++)
+		{
+			mat4 model = translate(mat4(1.0f), vec3((GLfloat(x) - rows * 0.5f) * 3.f, 1.f, GLfloat(z) * 3.f));
+			tree.selectLod(view * model, projection, viewport_height);
+			per_level[tree.current_lod]++;
+			full += full_triangles;
+			drawn += tree.lods[tree.current_lod].num_indices / 3;
+		}
+	}
+	double select_time = elapsed_ms(t);
+
+	cout << "LOD forest: " << rows * rows << " trees of " << full_triangles << " triangles, " << tree.lods.size()
+		<< " levels built in " << build_time << " ms" << endl;
+	cout << "\tlevels:";
+	for (size_t l = 0; l < tree.lods.size(); l++)
+	{
+		cout << " " << tree.lods[l].num_indices / 3 << " tris (error " << tree.lods[l].error << ") x" << per_level[l] << ";";
+	}
+	cout << endl;
+	cout << "\ttriangles/frame: full detail " << full / 1e6 << " M, with LOD " << drawn / 1e6 << " M ("
+		<< 100.0 * drawn / full << "%), selection " << select_time * 1000.0 / (rows * rows) << " us/tree" << endl;
+}
+
+
+/* Index reordering on a mesh_size x mesh_size sphere, in source order and with its
+   triangles shuffled as an unordered scan would be. Reports ACMR, ATVR and overfetch
+   before and after, with and without the overdraw pass */
+void benchmark_vertex_cache(GLuint mesh_size)
+{
+	mesh_data source;
+	make_blob_mesh(source, mesh_size);
+
+	mesh_data shuffled = source;
+	{
+		GLuint triangles = GLuint(shuffled.indices.size() / 3);
+		vector<GLuint> order(triangles);
+		for (GLuint t = 0; t < triangles; t++) order[t] = t;
+		// Only shuffle within each material range so the ranges stay valid
+		mt19937 gen(1);
+		for (size_t r = 0; r < shuffled.ranges.size(); r++)
+		{
+			const material_range& range = shuffled.ranges[r];
+			shuffle(order.begin() + range.first / 3, order.begin() + (range.first + range.count) / 3, gen);
+		}
+		for (GLuint t = 0; t < triangles; t++)
+		{
+			for (int k = 0; k < 3; k++) shuffled.indices[t * 3 + k] = source.indices[order[t] * 3 + k];
+		}
+	}
+
+	const mesh_data* inputs[2] = { &source, &shuffled };
+	const char* names[2] = { "source order", "shuffled" };
+	cout << "vertex cache: " << source.indices.size() / 3 << " triangles, " << VERTEX_CACHE_SIZE << " entry FIFO" << endl;
+	for (int i = 0; i < 2; i++)
+	{
+		for (int overdraw = 0; overdraw < 2; overdraw++)
+		{
+			mesh_data mesh = *inputs[i];
+			vertex_cache_stats before = analyze_vertex_cache(&mesh.indices[0], mesh.indices.size(), mesh.numVertices(), sizeof(mesh_vertex));
+			bench_clock::time_point t = bench_clock::now();
+			optimize_mesh(mesh, overdraw != 0);
+			double time = elapsed_ms(t);
+			vertex_cache_stats after = analyze_vertex_cache(&mesh.indices[0], mesh.indices.size(), mesh.numVertices(), sizeof(mesh_vertex));
+
+			string name = string("\t") + names[i] + (overdraw ? ", cache + overdraw + fetch" : ", cache + fetch");
+			print_vertex_cache_stats(name.c_str(), before, after);
+			cout << "\t\t" << time << " ms" << endl;
+		}
+	}
+}
+
+
+/* Meshlet culling of a mesh_size x mesh_size sphere standing in for the tree and of
+   the main scene terrain, from a few camera positions. Reports the meshlets culled
+   by the frustum and by their normal cones and the time the culling pass takes */
+void benchmark_cluster_culling(GLuint mesh_size)
+{
+	mesh_data mesh;
+	make_blob_mesh(mesh, mesh_size);
+	optimize_mesh(mesh);
+	bench_clock::time_point t = bench_clock::now();
+	build_meshlets(&mesh.indices[0], &mesh.ranges[0], GLuint(mesh.ranges.size()), &mesh.positions[0], mesh.numVertices(), mesh.meshlets);
+	double build_time = elapsed_ms(t);
+
+	GLuint tree_triangles = 0;
+	for (size_t m = 0; m < mesh.meshlets.size(); m++) tree_triangles += mesh.meshlets[m].index_count / 3;
+	cout << "meshlets: tree " << mesh.indices.size() / 3 << " triangles in " << mesh.meshlets.size() << " meshlets ("
+		<< GLfloat(tree_triangles) / mesh.meshlets.size() << " triangles each), built in " << build_time << " ms" << endl;
+
+	terrain_object terrain(1, 0.6f, 0.9f);
+	terrain.createTerrain(200, 200, 100.f, 100.f);
+	terrain.createObject();
+	cout << "\tterrain " << terrain.triangles.size() / 3 << " triangles in " << terrain.meshlets.size() << " meshlets" << endl;
+
+	mat4 projection = perspective(radians(30.0f), 1.3333f, 0.1f, 100.0f);
+	struct camera { const char* name; vec3 eye, target; };
+	camera cameras[] =
+	{
+		{ "tree in the distance", vec3(0.f, 1.7f, -20.f), vec3(0.f, 0.f, 0.f) },
+		{ "close to the tree", vec3(0.f, 0.5f, -1.6f), vec3(0.f, 0.f, 0.f) },
+		{ "looking away", vec3(0.f, 1.7f, -5.f), vec3(0.f, 1.7f, -10.f) },
+		{ "over the terrain", vec3(0.f, 30.f, -60.f), vec3(0.f, 0.f, 0.f) },
+	};
+
+	const GLuint repeats = 100;
+	vector<GLsizei> counts;
+	vector<const void*> offsets;
+	for (const camera& c : cameras)
+	{
+		mat4 view = lookAt(c.eye, c.target, vec3(0, 1, 0));
+		cluster_view cv;
+		cluster_cull_stats tree_stats, terrain_stats;
+
+		t = bench_clock::now();
+		for (GLuint r = 0; r < repeats; r++)
+		{
+			tree_stats.clear();
+			counts.clear();
+			offsets.clear();
+			cv.set(view, projection);
+			cull_meshlets(&mesh.meshlets[0], GLuint(mesh.meshlets.size()), cv, counts, offsets, tree_stats);
+		}
+		double tree_time = elapsed_ms(t) / repeats;
+		size_t tree_draws = counts.size();
+
+		t = bench_clock::now();
+		for (GLuint r = 0; r < repeats; r++)
+		{
+			terrain.cull(view, projection);
+		}
+		double terrain_time = elapsed_ms(t) / repeats;
+		terrain_stats = terrain.cluster_stats;
+
+		cout << "\t" << c.name << ":" << endl;
+		print_cluster_stats("\t\ttree", tree_stats);
+		cout << "\t\t\t" << tree_time * 1000.0 << " us, " << tree_draws << " draw ranges" << endl;
+		print_cluster_stats("\t\tterrain", terrain_stats);
+		cout << "\t\t\t" << terrain_time * 1000.0 << " us, " << terrain.visible_counts.size() << " draw ranges" << endl;
+	}
+}
+
+
+/* Vertex packing of a mesh_size x mesh_size sphere: the size of the vertex buffer as
+   floats and quantized, the largest decoding errors and the time taken to pack */
+void benchmark_quantization(GLuint mesh_size)
+{
+	mesh_data mesh;
+	make_blob_mesh(mesh, mesh_size);
+	mesh_view view = mesh.view();
+
+	vector<quantized_vertex> packed;
+	bench_clock::time_point t = bench_clock::now();
+	quantize_params params = quantize_vertices(view, packed);
+	double pack_time = elapsed_ms(t);
+	quantize_error error = measure_quantize_error(view, packed, params);
+
+	size_t float_bytes = size_t(view.num_vertices) * sizeof(mesh_vertex);
+	size_t packed_bytes = size_t(view.num_vertices) * sizeof(quantized_vertex);
+	vec3 extent = view.bounds.box_max - view.bounds.box_min;
+	cout << "quantization: " << view.num_vertices << " vertices, " << sizeof(mesh_vertex) << " -> " << sizeof(quantized_vertex)
+		<< " bytes/vertex, " << float_bytes / 1024 << " KB -> " << packed_bytes / 1024 << " KB ("
+		<< 100.0 * packed_bytes / float_bytes << "%), packed in " << pack_time << " ms" << endl;
+	cout << "\tmax error: position " << error.position << " (" << 100.f * error.position / max(extent.x, max(extent.y, extent.z))
+		<< "% of the size), normal " << error.normal_degrees << " degrees, texcoord " << error.texcoord
+		<< ", colour " << error.colour << endl;
+}
+
+
+/* Compression of a mesh_size x mesh_size sphere prepared the way the loader does it
+   (levels of detail and index reordering). Reports the size as floats, quantized and
+   coded, and the decode speed into memory and straight into mapped GL buffers */
+void benchmark_mesh_codec(GLuint mesh_size)
+{
+	mesh_data mesh;
+	make_blob_mesh(mesh, mesh_size);
+	build_lod_chain(mesh);
+	optimize_mesh(mesh);
+	mesh_view view = mesh.view();
+
+	vector<quantized_vertex> quantized;
+	quantize_vertices(view, quantized);
+	vector<unsigned char> packed_vertices, packed_indices;
+	bench_clock::time_point t = bench_clock::now();
+	encode_vertices(&quantized[0], view.num_vertices, packed_vertices);
+	encode_indices(view.indices, view.num_indices, packed_indices);
+	double encode_time = elapsed_ms(t);
+
+	size_t float_bytes = size_t(view.num_vertices) * 12 * sizeof(GLfloat) + size_t(view.num_indices) * sizeof(GLuint);
+	size_t quantized_bytes = size_t(view.num_vertices) * sizeof(quantized_vertex) + size_t(view.num_indices) * sizeof(GLuint);
+	size_t packed_bytes = packed_vertices.size() + packed_indices.size();
+
+	// Decode into memory, best of a few runs
+	vector<quantized_vertex> vertices(view.num_vertices);
+	vector<GLuint> indices(view.num_indices);
+	double vertex_time = 1e30, index_time = 1e30;
+	bool ok = true;
+	for (int r = 0; r < 5; r++)
+	{
+		t = bench_clock::now();
+		ok = decode_vertices(&packed_vertices[0], packed_vertices.size(), &vertices[0], view.num_vertices) && ok;
+		vertex_time = min(vertex_time, elapsed_ms(t));
+		t = bench_clock::now();
+		ok = decode_indices(&packed_indices[0], packed_indices.size(), &indices[0], view.num_indices, view.num_vertices) && ok;
+		index_time = min(index_time, elapsed_ms(t));
+	}
+	ok = ok && memcmp(&vertices[0], &quantized[0], vertices.size() * sizeof(quantized_vertex)) == 0;
+
+	// Decode straight into mapped buffers, as TinyObjLoader does from a compressed cache
+	GLuint buffers[2];
+	glGenBuffers(2, buffers);
+	t = bench_clock::now();
+	glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(quantized_vertex), NULL, GL_STATIC_DRAW);
+	void* mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(quantized_vertex), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (mapped) decode_vertices(&packed_vertices[0], packed_vertices.size(), (quantized_vertex*)mapped, view.num_vertices);
+	glUnmapBuffer(GL_ARRAY_BUFFER);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+	glBufferData(GL_ARRAY_BUFFER, indices.size() * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+	mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, indices.size() * sizeof(GLuint), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (mapped) decode_indices(&packed_indices[0], packed_indices.size(), (GLuint*)mapped, view.num_indices, view.num_vertices);
+	glUnmapBuffer(GL_ARRAY_BUFFER);
+	glFinish();
+	double mapped_time = elapsed_ms(t);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glDeleteBuffers(2, buffers);
+
+	double vertex_out = vertices.size() * sizeof(quantized_vertex), index_out = indices.size() * sizeof(GLuint);
+	cout << "mesh codec: " << view.num_vertices << " vertices, " << view.num_indices / 3 << " triangles in " << view.num_lods
+		<< " levels, " << (ok ? "round trip exact" : "ROUND TRIP FAILED") << ", encoded in " << encode_time << " ms" << endl;
+	cout << "\tfloat " << float_bytes / 1024 << " KB, quantized " << quantized_bytes / 1024 << " KB, coded " << packed_bytes / 1024
+		<< " KB (" << GLfloat(float_bytes) / packed_bytes << ":1 from float, " << GLfloat(quantized_bytes) / packed_bytes << ":1 from quantized)" << endl;
+	cout << "\tvertices " << GLfloat(packed_vertices.size()) / view.num_vertices << " bytes each, decoded at "
+		<< vertex_out / (vertex_time * 1e6) << " GB/s; indices " << GLfloat(packed_indices.size()) / (view.num_indices / 3)
+		<< " bytes/triangle, decoded at " << index_out / (index_time * 1e6) << " GB/s" << endl;
+	cout << "\tdecoded into mapped GL buffers in " << mapped_time << " ms (" << (vertex_out + index_out) / (mapped_time * 1e6) << " GB/s)" << endl;
+}
+
+
+/* Size and warm load time of the float and compressed mesh caches for an OBJ file,
+   or for a generated one of about size_mb megabytes when obj_path is null. The file
+   is copied so that the cache next to it is left alone */
+void benchmark_compressed_cache(const char* obj_path, GLuint size_mb)
+{
+	const char* filename = "benchmark_codec.obj";
+	error_code ec;
+	if (obj_path)
+	{
+		filesystem::copy_file(obj_path, filename, filesystem::copy_options::overwrite_existing, ec);
+		if (ec)
+		{
+			cout << "compressed cache: " << obj_path << " not found, skipped" << endl;
+			return;
+		}
+	}
+	else if (!write_test_obj(filename, GLuint(sqrt(size_mb * 1024.0 * 1024.0 / 200.0))))
+	{
+		cout << "compressed cache: could not write " << filename << endl;
+		return;
+	}
+	uintmax_t obj_bytes = filesystem::file_size(filename, ec);
+
+	uintmax_t cache_bytes[2];
+	double warm_time[2];
+	for (int compressed = 0; compressed < 2; compressed++)
+	{
+		TinyObjLoader cold, warm;
+		cold.compress_cache = warm.compress_cache = compressed != 0;
+		string cache_path = mesh_cache::cachePath(filename, cold.cacheOptions());
+		remove(cache_path.c_str());
+		cold.load_obj(filename);
+		warm.load_obj(filename);
+		cache_bytes[compressed] = filesystem::file_size(cache_path, ec);
+		warm_time[compressed] = warm.loaded_from_cache ? warm.load_time : -1.0;
+		remove(cache_path.c_str());
+	}
+	remove(filename);
+
+	cout << "compressed cache: " << (obj_path ? obj_path : "generated obj") << " " << obj_bytes / 1024 << " KB" << endl;
+	cout << "\tfloat cache " << cache_bytes[0] / 1024 << " KB, warm load " << warm_time[0] << " ms" << endl;
+	cout << "\tcompressed cache " << cache_bytes[1] / 1024 << " KB (" << 100.0 * cache_bytes[1] / cache_bytes[0]
+		<< "%), warm load " << warm_time[1] << " ms" << endl;
+}
+
+
+/* Loading the same image into a number of textures on the GL thread, which stalls
+   for the whole load, against the loader threads with a frame loop that uploads
+   for budget_ms each frame. The longest update() is the worst frame hitch */
+void benchmark_async_loading(const char* image_path, GLuint textures, double budget_ms)
+{
+	vector<GLuint> serial(textures);
+	bench_clock::time_point t = bench_clock::now();
+	for (GLuint i = 0; i < textures; i++)
+	{
+		decoded_image image;
+		if (!decode_image(image_path, true, image))
+		{
+			cout << "async loading: " << image_path << " not found, skipped" << endl;
+			return;
+		}
+		glGenTextures(1, &serial[i]);
+		upload_texture(serial[i], image, true);
+	}
+	glFinish();
+	double serial_time = elapsed_ms(t);
+
+	vector<GLuint> async(textures);
+	GLuint frames = 0;
+	t = bench_clock::now();
+	{
+		asset_loader loader;
+		for (GLuint i = 0; i < textures; i++) async[i] = loader.loadTexture(image_path, true, true);
+		while (!loader.idle())
+		{
+			loader.update(budget_ms);
+			frames++;
+			this_thread::sleep_for(chrono::milliseconds(1));
+		}
+		glFinish();
+		double async_time = elapsed_ms(t);
+
+		cout << "async loading: " << textures << " textures of " << image_path << endl;
+		cout << "\tGL thread " << serial_time << " ms, blocked for all of it" << endl;
+		cout << "\tloader threads " << async_time << " ms over " << frames << " frames, " << loader.upload_time
+			<< " ms on the GL thread, longest frame " << loader.longest_update << " ms" << endl;
+	}
+
+	glDeleteTextures(textures, &serial[0]);
+	glDeleteTextures(textures, &async[0]);
+}
+
+
+/* The same texture and mesh asked for many times under different spellings of the
+   path, each must be loaded once. Then every handle is dropped and collect() must
+   evict them all, the mesh and its material textures in one call */
+void benchmark_asset_manager(const char* image_path, const char* obj_path, GLuint requests)
+{
+	asset_loader loader;
+	asset_manager manager(&loader);
+	string image = image_path;
+	string spelled = "./" + image;
+	replace(spelled.begin(), spelled.end(), '\\', '/');
+
+	vector<texture_handle> textures;
+	vector<mesh_handle> meshes;
+	bench_clock::time_point t = bench_clock::now();
+	for (GLuint i = 0; i < requests; i++)
+	{
+		textures.push_back(manager.loadTexture(i % 2 ? image : spelled, true, true));
+		meshes.push_back(manager.loadMesh(obj_path));
+	}
+	double request_time = elapsed_ms(t);
+	loader.finishAll();
+	double load_time = elapsed_ms(t);
+
+	bool pass = manager.loads == 1 + 1 + GLuint(meshes[0]->textures.size()) || meshes[0]->failed;
+	for (GLuint i = 1; i < requests; i++) pass = pass && textures[i] == textures[0] && meshes[i] == meshes[0];
+	cout << "asset manager: " << requests << " requests each for a texture and a mesh, " << manager.loads << " loads "
+		<< (pass ? "PASS" : "FAIL") << ", requests " << request_time << " ms, loaded in " << load_time << " ms" << endl;
+	manager.print();
+
+	textures.clear();
+	meshes.clear();
+	GLuint before = manager.evicted;
+	size_t freed = manager.collect();
+	cout << "\tdropped every handle: " << manager.evicted - before << " evicted, " << freed / 1024 << " KB freed, "
+		<< manager.memoryUsage() << " bytes left" << endl;
+}
+
+
+/* The SSE box reduction against the plain loop over the same random positions, an
+   odd count so the scalar tail is used too. Both must give the same box. Then how
+   much tighter the furthest vertex sphere is than the sphere through the box corners
+   for a round and a flat mesh */
+void benchmark_bounds(GLuint numpoints, GLuint runs)
+{
+	mt19937 rng(7);
+	uniform_real_distribution<GLfloat> dist(-50.f, 50.f);
+	vector<GLfloat> positions(size_t(numpoints) * 3);
+	for (size_t i = 0; i < positions.size(); i++) positions[i] = dist(rng);
+
+	vec3 lo_scalar, hi_scalar, lo_simd, hi_simd;
+	bench_clock::time_point t = bench_clock::now();
+	for (GLuint r = 0; r < runs; r++) bounds_min_max_scalar(&positions[0], numpoints, lo_scalar, hi_scalar);
+	double scalar_time = elapsed_ms(t) / runs;
+	t = bench_clock::now();
+	for (GLuint r = 0; r < runs; r++) bounds_min_max(&positions[0], numpoints, lo_simd, hi_simd);
+	double simd_time = elapsed_ms(t) / runs;
+	t = bench_clock::now();
+	for (GLuint r = 0; r < runs; r++) compute_bounds(&positions[0], numpoints);
+	double volume_time = elapsed_ms(t) / runs;
+
+	bool pass = lo_scalar == lo_simd && hi_scalar == hi_simd;
+	cout << "bounds: " << numpoints << " positions " << (pass ? "PASS" : "FAIL") << ", box " << scalar_time << " ms scalar, "
+		<< simd_time << " ms SSE (" << scalar_time / simd_time << "x), box and sphere " << volume_time << " ms" << endl;
+
+	mesh_data blob, grid;
+	make_blob_mesh(blob, 200);
+	make_grid_mesh(grid, 200);
+	mesh_data* meshes[2] = { &blob, &grid };
+	const char* names[2] = { "blob", "grid" };
+	for (int m = 0; m < 2; m++)
+	{
+		const bounding_volume& b = meshes[m]->bounds;
+		GLfloat corner_radius = length(b.box_max - b.box_min) * 0.5f;
+		cout << "\t" << names[m] << " sphere radius " << b.radius << ", through the box corners " << corner_radius
+			<< " (" << 100.f * b.radius / corner_radius << "%)" << endl;
+	}
+}
+
+
+/* Run the same particles for a number of steps on the CPU and with the compute shader
+   and check that they end up in the same place. The update is only additions and
+   comparisons so both backends should match exactly, on hardware or on llvmpipe */
+bool check_gpu_simulation(GLWrapper* glw, GLuint numpoints, GLuint steps)
+{
+	points particles(numpoints, 1.f, 0.1f);
+	particles.seed = 1234;
+	particles.create();
+	if (!particles.createGPU(glw))
+	{
+		cout << "gpu simulation: skipped, compute shaders not supported" << endl;
+		return true;
+	}
+
+	vector<vec3> start(particles.vertices, particles.vertices + numpoints);
+
+	// GPU backend
+	particles.gpu_simulation = true;
+	bench_clock::time_point t = bench_clock::now();
+	for (GLuint s = 0; s < steps; s++) particles.animate();
+	glFinish();
+	double gpu_time = elapsed_ms(t);
+	particles.readBackGPU();
+	vector<vec3> gpu_result(particles.vertices, particles.vertices + numpoints);
+
+	// CPU reference from the same starting point
+	particles.gpu_simulation = false;
+	copy(start.begin(), start.end(), particles.vertices);
+	t = bench_clock::now();
+	for (GLuint s = 0; s < steps; s++) particles.animate();
+	double cpu_time = elapsed_ms(t);
+
+	float max_error = 0;
+	GLuint mismatches = 0;
+	for (GLuint i = 0; i < numpoints; i++)
+	{
+		vec3 d = abs(gpu_result[i] - particles.vertices[i]);
+		float e = max(d.x, max(d.y, d.z));
+		if (e > 0) mismatches++;
+		max_error = max(max_error, e);
+	}
+
+	bool pass = max_error <= 1e-5f;
+	cout << "gpu simulation: " << numpoints << " particles x " << steps << " steps "
+		<< (pass ? "PASS" : "FAIL") << ", max error " << max_error << ", " << mismatches << " differ" << endl;
+	cout << "\tcpu " << cpu_time / steps << " ms/step, gpu " << gpu_time / steps << " ms/step" << endl;
+	return pass;
+}
+
+
+/* Draw a ring of point sprites through oit_buffer into a small framebuffer and
+   compare the composite with the same sprites sorted back to front and alpha
+   blended on the CPU. The weighted average only matches the sorted blend where the
+   layers are faint, so the sprites only overlap at their soft edges. A broken
+   target, blend function or composite then shows up as a large error */
+bool check_oit(GLWrapper* glw)
+{
+	const GLsizei fb_size = 64;
+	const GLuint numsprites = 8;
+	const GLfloat size = 14.f;
+	const vec4 background(0.2f, 0.2f, 0.2f, 1.f);
+	const vec3 palette[numsprites] = { vec3(1, 0, 0), vec3(0, 1, 0), vec3(0, 0, 1), vec3(1, 1, 0),
+									   vec3(0, 1, 1), vec3(1, 0, 1), vec3(1, 0.5f, 0), vec3(0.5f, 0.5f, 1) };
+
+	// Drawn with identity matrices so these are normalised device coordinates, further back each time
+	vector<vec3> positions(numsprites), colours(palette, palette + numsprites);
+	for (GLuint i = 0; i < numsprites; i++)
+	{
+		float angle = radians(360.f * i / numsprites);
+		positions[i] = vec3(0.6f * cos(angle), 0.6f * sin(angle), -0.5f + 0.12f * i);
+	}
+
+	// The opaque scene, with the usual window formats so its depth can be blitted to the OIT targets
+	GLuint scene_framebuffer, scene_colour, scene_depth;
+	glGenRenderbuffers(1, &scene_colour);
+	glBindRenderbuffer(GL_RENDERBUFFER, scene_colour);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, fb_size, fb_size);
+	glGenRenderbuffers(1, &scene_depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, scene_depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, fb_size, fb_size);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &scene_framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, scene_framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, scene_colour);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, scene_depth);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+	oit_buffer oit;
+	oit.create(glw, fb_size, fb_size);
+	oit.scene_framebuffer = scene_framebuffer;
+	glBindFramebuffer(GL_FRAMEBUFFER, oit.framebuffer);
+	complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+	GLuint program = glw->LoadShader("..\\ASSIGNMENT_2\\code\\point_sprites.vert", "..\\ASSIGNMENT_2\\code\\point_sprites_oit.frag");
+	GLint previous_vao, viewport[4];
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous_vao);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	GLuint vao, buffers[2];
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	glGenBuffers(2, buffers);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+	glBufferData(GL_ARRAY_BUFFER, numsprites * sizeof(vec3), &positions[0], GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+	glBufferData(GL_ARRAY_BUFFER, numsprites * sizeof(vec3), &colours[0], GL_STATIC_DRAW);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	vector<unsigned char> pixels(size_t(fb_size) * fb_size * 4, 0);
+	if (complete)
+	{
+		glViewport(0, 0, fb_size, fb_size);
+		glBindFramebuffer(GL_FRAMEBUFFER, scene_framebuffer);
+		glClearBufferfv(GL_COLOR, 0, &background[0]);
+		glClearBufferfi(GL_DEPTH_STENCIL, 0, 1.f, 0);
+
+		mat4 identity(1.f);
+		glUseProgram(program);
+		glUniformMatrix4fv(glGetUniformLocation(program, "model"), 1, GL_FALSE, &identity[0][0]);
+		glUniformMatrix4fv(glGetUniformLocation(program, "view"), 1, GL_FALSE, &identity[0][0]);
+		glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, &identity[0][0]);
+		glUniform1f(glGetUniformLocation(program, "size"), size);
+
+		glEnable(GL_PROGRAM_POINT_SIZE);
+		oit.begin();
+		glDrawArrays(GL_POINTS, 0, numsprites);
+		oit.end();
+		oit.composite();
+		glDisable(GL_PROGRAM_POINT_SIZE);
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, scene_framebuffer);
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		glReadPixels(0, 0, fb_size, fb_size, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	glBindVertexArray(previous_vao);
+	glDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(2, buffers);
+	glDeleteProgram(program);
+	glDeleteFramebuffers(1, &scene_framebuffer);
+	glDeleteRenderbuffers(1, &scene_colour);
+	glDeleteRenderbuffers(1, &scene_depth);
+
+	if (!complete)
+	{
+		cout << "oit composite: FAIL, framebuffer is incomplete" << endl;
+		return false;
+	}
+
+	// Reference: the sprites of point_sprites.vert and point_sprites_oit.frag, back to front
+	vector<GLuint> order(numsprites);
+	for (GLuint i = 0; i < numsprites; i++) order[i] = i;
+	sort(order.begin(), order.end(), [&positions](GLuint a, GLuint b) { return positions[a].z > positions[b].z; });
+
+	float max_error = 0, total_error = 0;
+	GLuint covered = 0;
+	for (GLsizei y = 0; y < fb_size; y++)
+	{
+		for (GLsizei x = 0; x < fb_size; x++)
+		{
+			vec3 reference = vec3(background);
+			bool drawn = false;
+			for (GLuint j = 0; j < numsprites; j++)
+			{
+				const vec3& p = positions[order[j]];
+				float point_size = (1.f - p.z) * size;
+				vec2 centre = (vec2(p.x, p.y) * 0.5f + 0.5f) * float(fb_size);
+				vec2 coord = (vec2(x + 0.5f, y + 0.5f) - centre) / point_size;
+				float f = dot(coord, coord);
+				if (f > 0.25f) continue;
+
+				float s = smoothstep(0.01f, 0.25f, f);
+				vec3 colour = mix(colours[order[j]], vec3(0.9f, 0.7f, 1.f), s);
+				reference = mix(reference, colour, 1.f - s);
+				drawn = true;
+			}
+			if (!drawn) continue;
+
+			const unsigned char* pixel = &pixels[(size_t(y) * fb_size + x) * 4];
+			vec3 result = vec3(pixel[0], pixel[1], pixel[2]) / 255.f;
+			vec3 d = abs(result - reference);
+			float e = max(d.x, max(d.y, d.z));
+			max_error = max(max_error, e);
+			total_error += e;
+			covered++;
+		}
+	}
+
+	bool pass = covered > 0 && max_error <= 0.1f;
+	cout << "oit composite: " << numsprites << " sprites " << (pass ? "PASS" : "FAIL") << ", max error " << max_error
+		<< ", mean error " << (covered ? total_error / covered : 0.f) << " over " << covered << " pixels" << endl;
+	return pass;
+}
+
+
+/* Startup loading of a number of textures: decoding and uploading one after another
+   on the GL thread, as the startup textures used to be, against load_textures()
+   decoding them all on every core while the GL thread uploads, as
+   asset_manager::loadTextures() does now. Both must load every texture */
+void benchmark_texture_batch(const char* image_path, GLuint textures)
+{
+	vector<GLuint> serial(textures, 0);
+	bench_clock::time_point t = bench_clock::now();
+	for (GLuint i = 0; i < textures; i++)
+	{
+		decoded_image image;
+		if (!decode_image(image_path, true, image))
+		{
+			cout << "texture batch: " << image_path << " not found, skipped" << endl;
+			for (GLuint j = 0; j < i; j++) glDeleteTextures(1, &serial[j]);
+			return;
+		}
+		glGenTextures(1, &serial[i]);
+		upload_texture(serial[i], image, true);
+	}
+	glFinish();
+	double serial_time = elapsed_ms(t);
+
+	vector<texture_request> batch(textures, texture_request(image_path, true, true));
+	t = bench_clock::now();
+	size_t loaded = load_textures(batch);
+	glFinish();
+	double batch_time = elapsed_ms(t);
+
+	cout << "texture batch: " << textures << " textures of " << image_path << ", " << loaded << " loaded "
+		<< (loaded == textures ? "PASS" : "FAIL") << " on " << max(1u, thread::hardware_concurrency()) << " threads" << endl;
+	cout << "\tone after another " << serial_time << " ms, batch " << batch_time << " ms, saved "
+		<< serial_time - batch_time << " ms (" << serial_time / max(batch_time, 1e-3) << "x)" << endl;
+
+	glDeleteTextures(textures, &serial[0]);
+	for (GLuint i = 0; i < textures; i++) glDeleteTextures(1, &batch[i].texture);
+}
@@ -0,0 +1,35 @@
+/* benchmarks.h
+   Timing runs for the particle and mesh code. These are started by running the
+   program with the -benchmark argument (after init() has created a GL context)
+   and print their results to the console.
+*/
+
+#pragma once
+
+#include "wrapper_glfw.h"
+
+void run_benchmarks(GLWrapper* glw);
+
+void benchmark_particle_init(GLuint numpoints);
+void benchmark_snow_cover(GLuint impacts_per_frame, GLuint frames);
+void benchmark_depth_sort(GLuint numpoints, GLuint frames);
+void benchmark_wind_field(GLuint numpoints, GLuint frames);
+void benchmark_spatial_hash(GLuint numpoints, GLfloat cell_size, GLuint queries);
+void benchmark_culling(GLuint numpoints, GLuint frames);
+void benchmark_particle_renderers(GLWrapper* glw, GLuint numpoints, GLuint frames);
+void benchmark_obj_parser(GLuint size_mb);
+void benchmark_mesh_cache(GLuint size_mb);
+void benchmark_normal_generation(GLuint size_mb);
+void benchmark_draw_object(GLuint meshes, GLuint frames);
+void benchmark_lod_forest(GLuint rows, GLuint mesh_size);
+void benchmark_vertex_cache(GLuint mesh_size);
+void benchmark_cluster_culling(GLuint mesh_size);
+void benchmark_quantization(GLuint mesh_size);
+void benchmark_mesh_codec(GLuint mesh_size);
+void benchmark_compressed_cache(const char* obj_path, GLuint size_mb);
+void benchmark_async_loading(const char* image_path, GLuint textures, double budget_ms);
+void benchmark_asset_manager(const char* image_path, const char* obj_path, GLuint requests);
+void benchmark_bounds(GLuint numpoints, GLuint runs);
+void benchmark_texture_batch(const char* image_path, GLuint textures);
+bool check_gpu_simulation(GLWrapper* glw, GLuint numpoints, GLuint steps);
+bool check_oit(GLWrapper* glw);
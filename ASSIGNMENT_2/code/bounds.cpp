@@ -0,0 +1,156 @@
+/* bounds.cpp
+   Bounding boxes and spheres, see bounds.h
+*/
+
+#include "bounds.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BOUNDS_SSE
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+using namespace glm;
+
+#ifdef BOUNDS_SSE
+// Four packed xyz positions from three unaligned loads into one register for each axis
+static inline void load_xyz4(const GLfloat* p, __m128& x, __m128& y, __m128& z)
+{
+	__m128 a = _mm_loadu_ps(p);			// x0 y0 z0 x1
+	__m128 b = _mm_loadu_ps(p + 4);		// y1 z1 x2 y2
+	__m128 c = _mm_loadu_ps(p + 8);		// z2 x3 y3 z3
+	x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+	y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+	z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+static inline GLfloat lanes_min(__m128 v)
+{
+	v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+	return _mm_cvtss_f32(v);
+}
+
+static inline GLfloat lanes_max(__m128 v)
+{
+	v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+	return _mm_cvtss_f32(v);
+}
+#endif
+
+
+void bounds_min_max_scalar(const GLfloat* positions, size_t count, vec3& lo, vec3& hi)
+{
+	if (count == 0)
+	{
+		lo = hi = vec3(0.f);
+		return;
+	}
+	lo = hi = vec3(positions[0], positions[1], positions[2]);
+	for (size_t i = 1; i < count; i++)
+	{
+		vec3 p(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]);
+		lo = min(lo, p);
+		hi = max(hi, p);
+	}
+}
+
+
+void bounds_min_max(const GLfloat* positions, size_t count, vec3& lo, vec3& hi)
+{
+#ifdef BOUNDS_SSE
+	if (count >= 4)
+	{
+		__m128 min_x, min_y, min_z;
+		load_xyz4(positions, min_x, min_y, min_z);
+		__m128 max_x = min_x, max_y = min_y, max_z = min_z;
+
+		size_t i = 4;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 x, y, z;
+			load_xyz4(positions + i * 3, x, y, z);
+			min_x = _mm_min_ps(min_x, x);
+			min_y = _mm_min_ps(min_y, y);
+			min_z = _mm_min_ps(min_z, z);
+			max_x = _mm_max_ps(max_x, x);
+			max_y = _mm_max_ps(max_y, y);
+			max_z = _mm_max_ps(max_z, z);
+		}
+
+		lo = vec3(lanes_min(min_x), lanes_min(min_y), lanes_min(min_z));
+		hi = vec3(lanes_max(max_x), lanes_max(max_y), lanes_max(max_z));
+		for (; i < count; i++)
+		{
+			vec3 p(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]);
+			lo = min(lo, p);
+			hi = max(hi, p);
+		}
+		return;
+	}
+#endif
+	bounds_min_max_scalar(positions, count, lo, hi);
+}
+
+
+bounding_volume compute_bounds(const GLfloat* positions, size_t count)
+{
+	bounding_volume b;
+	bounds_min_max(positions, count, b.box_min, b.box_max);
+	b.centre = (b.box_min + b.box_max) * 0.5f;
+
+	GLfloat furthest = 0.f;		// Squared distance
+	size_t i = 0;
+#ifdef BOUNDS_SSE
+	__m128 far2 = _mm_setzero_ps();
+	__m128 cx = _mm_set1_ps(b.centre.x), cy = _mm_set1_ps(b.centre.y), cz = _mm_set1_ps(b.centre.z);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 x, y, z;
+		load_xyz4(positions + i * 3, x, y, z);
+		x = _mm_sub_ps(x, cx);
+		y = _mm_sub_ps(y, cy);
+		z = _mm_sub_ps(z, cz);
+		__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+		far2 = _mm_max_ps(far2, d2);
+	}
+	furthest = lanes_max(far2);
+#endif
+	for (; i < count; i++)
+	{
+		vec3 d = vec3(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]) - b.centre;
+		furthest = max(furthest, dot(d, d));
+	}
+	b.radius = sqrt(furthest);
+	return b;
+}
+
+
+/* Each axis of the matrix moves the box corners by its column times the half size
+   on that axis, so the new half size is the sum of the absolute columns scaled */
+bounding_volume bounding_volume::transform(const mat4& m) const
+{
+	vec3 box_centre = (box_min + box_max) * 0.5f;
+	vec3 half = (box_max - box_min) * 0.5f;
+	vec3 moved = vec3(m * vec4(box_centre, 1.f));
+	vec3 extent = abs(vec3(m[0])) * half.x + abs(vec3(m[1])) * half.y + abs(vec3(m[2])) * half.z;
+
+	bounding_volume out;
+	out.box_min = moved - extent;
+	out.box_max = moved + extent;
+	out.centre = vec3(m * vec4(centre, 1.f));
+	out.radius = radius * max(length(vec3(m[0])), max(length(vec3(m[1])), length(vec3(m[2]))));
+	return out;
+}
+
+
+void print_bounds(const char* name, const bounding_volume& b)
+{
+	cout << name << " bounds: box (" << b.box_min.x << ", " << b.box_min.y << ", " << b.box_min.z << ") to ("
+		<< b.box_max.x << ", " << b.box_max.y << ", " << b.box_max.z << "), sphere (" << b.centre.x << ", "
+		<< b.centre.y << ", " << b.centre.z << ") radius " << b.radius << endl;
+}
@@ -0,0 +1,36 @@
+/* bounds.h
+   Bounding volumes of a mesh: an axis aligned box and a sphere, in model space
+   when computed and moved into world or view space with transform().
+   The box is a min/max reduction over packed xyz positions. With SSE four
+   positions are loaded as three registers and shuffled into x, y and z registers,
+   so each instruction reduces four vertices on one axis, and the lanes are only
+   combined at the end. The sphere is centred on the box with the distance to the
+   furthest vertex as its radius, from a second pass done the same way. It is never
+   bigger than the sphere through the corners of the box and is often much smaller.
+*/
+
+#pragma once
+
+#include "wrapper_glfw.h"
+#include <glm/glm.hpp>
+#include <cstddef>
+
+struct bounding_volume
+{
+	glm::vec3 box_min, box_max;
+	glm::vec3 centre;
+	GLfloat radius;
+
+	// The box around the transformed box and the sphere moved and scaled by the
+	// largest scale of the matrix, so both still hold everything after the transform
+	bounding_volume transform(const glm::mat4& m) const;
+};
+
+// Zero size at the origin for no positions
+bounding_volume compute_bounds(const GLfloat* positions, size_t count);
+
+void print_bounds(const char* name, const bounding_volume& b);
+
+// The box reduction on its own, and the plain loop it is checked against
+void bounds_min_max(const GLfloat* positions, size_t count, glm::vec3& lo, glm::vec3& hi);
+void bounds_min_max_scalar(const GLfloat* positions, size_t count, glm::vec3& lo, glm::vec3& hi);
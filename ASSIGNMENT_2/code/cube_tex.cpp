@@ -184,6 +184,8 @@ void Cube::makeCube()
 		1.f, 0.f, 0.f, 0.f, 0.f, 1.f
 	};
 
+	bounds = compute_bounds(vertexPositions, sizeof(vertexPositions) / (3 * sizeof(GLfloat)));
+
 	/* Create the vertex buffer for the cube */
 	glGenBuffers(1, &positionBufferObject);
 	glBindBuffer(GL_ARRAY_BUFFER, positionBufferObject);
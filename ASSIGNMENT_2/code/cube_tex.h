@@ -6,6 +6,7 @@ Iain Martin November 2018
 #pragma once
 
 #include "wrapper_glfw.h"
+#include "bounds.h"
 #include <vector>
 #include <glm/glm.hpp>
 
@@ -32,4 +33,6 @@ public:
 	int numvertices;
 	int drawmode;
 	bool enableTexture;
+
+	bounding_volume bounds;		// Model space, set by makeCube()
 };
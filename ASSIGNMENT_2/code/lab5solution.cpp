@@ -40,6 +40,21 @@ if you prefer */
 
 // include file to make terrain
 #include "terrain_object.h"
+#include "snow_cover.h"
+#include "wind_field.h"
+
+// Weighted blended order independent transparency for the particles
+#include "oit_buffer.h"
+
+// Instanced quads as an alternative to the point sprites
+#include "particle_quads.h"
+
+// Timing runs started with the -benchmark argument
+#include "benchmarks.h"
+
+// Texture and mesh loading on worker threads, each file loaded once
+#include "asset_loader.h"
+#include "asset_manager.h"
 
 
 GLuint colourmode;	/* Index of a uniform to switch the colour mode in the vertex shader
@@ -53,6 +68,7 @@ GLfloat light_x, light_y, light_z;
 
 GLuint program;		/* Identifier for the main shader prgoram */
 GLuint points_program;		/* Identifier for the point_sprites shader prgoram */
+GLuint points_oit_program;	/* Point sprites shader that writes to the order independent transparency targets */
 GLuint obj_ldr_program;
 GLuint terrain_program;
 GLuint sky_program;
@@ -78,17 +94,23 @@ GLuint numlats, numlongs;	//Define the resolution of the sphere object
 /* Uniforms*/
 GLuint modelID, viewID, projectionID, colourmodeID; // uniforms for lighting shaders
 GLuint terrain_modelID, terrain_viewID, terrain_projectionID, terrain_colourmodeID; // uniforms for lighting shaders
+GLuint terrain_snowcoverID, terrain_sizeID; // uniforms for the snow cover on the terrain
 GLuint sky_viewID, sky_projectionID, sky_modelID; // uniforms for sky lighting shaders
 GLuint points_modelID, points_viewID, points_projectionID, points_sizeID; // Uniforms for the points shaders
+GLuint points_oit_modelID, points_oit_viewID, points_oit_projectionID, points_oit_sizeID; // Uniforms for the OIT points shaders
 GLuint lightposID, normalmatrixID;
 GLuint emitmodeID, fogmodeID;
 
 
 GLfloat aspect_ratio;		/* Aspect ratio of the window defined in the reshape callback*/
+GLfloat viewport_height;	/* Height of the window in pixels, for the tree level of detail */
 GLuint numspherevertices;
 
 // Define texture ID value (identifier for a specific texture)
-GLuint textureID1, textureID2, textureID3, point_textureID, textureID4;
+GLuint textureID2, textureID3;
+
+// Shared handles to the loaded textures, the texture name is handle->texture
+texture_handle textureID1, point_textureID, textureID4;
 
 /* Point sprite object and adjustable parameters */
 points* point_anim;
@@ -96,6 +118,14 @@ GLfloat speed;
 GLfloat maxdist;
 GLfloat point_size;		// Used to adjust point size in the vertex shader
 
+/* Draw the particles with weighted blended OIT instead of ordinary alpha blending */
+oit_buffer* particle_oit;
+bool use_oit;
+
+/* Draw the particles as instanced quads instead of point sprites */
+particle_quads* quads;
+bool use_quads;
+
 
 // Quad object
 GLuint quad_vbo;
@@ -103,10 +133,14 @@ GLuint quad_vbo;
 Sphere sphere;
 Cube cube(true);
 
-TinyObjLoader tiny_obj;		// This is an instance of our tiny object loader with texture
+/* World space bounds of the scene objects as last drawn: their model space bounds
+   moved by the model matrix they were drawn with */
+bounding_volume terrain_world_bounds, sky_world_bounds, tree_world_bounds, present_world_bounds;
+
+mesh_handle tree;		// Shared handle to the tree, drawn with tree->mesh, our tiny object loader with texture
 
 /* Define textureID*/
-GLuint texID;
+texture_handle texID;
 
 // terrain objects
 terrain_object* heightfield;
@@ -115,6 +149,16 @@ GLfloat perlin_scale, perlin_frequency;
 GLfloat land_size;
 GLfloat sealevel = 0;
 
+// Snow that builds up where the particles land on the terrain
+snow_cover* snow;
+
+// Curl noise wind that blows the particles around
+wind_field* wind;
+
+// Loads the tree and the textures in the background, the GL side is done a little each frame
+asset_loader* loader;
+asset_manager* assets;
+
 
 using namespace std;
 using namespace glm;
@@ -124,54 +168,6 @@ using namespace glm;
 string fog_mode_desc[] = { "off", "linear", "exp", "exp2" };
 
 
-bool load_texture(const char* filename, GLuint& texID, bool bGenMipmaps)
-{
-	// Obtain an unused texture identifier. 
-	glGenTextures(1, &texID);
-
-	// local image parameters
-	int width, height, nrChannels;
-
-	/* load an image file using stb_image */
-	unsigned char* data = stbi_load(filename, &width, &height, &nrChannels, 0);
-
-	// check for an error during the load process
-	if (data)
-	{
-		// Note: this is not a full check of all pixel format types, just the most common two!
-		int pixel_format = 0;
-		if (nrChannels == 3)
-			pixel_format = GL_RGB;
-		else
-			pixel_format = GL_RGBA;
-
-		// Bind the texture ID before the call to create the texture.
-			// texID[i] will now be the identifier for this specific texture
-		glBindTexture(GL_TEXTURE_2D, texID);
-
-		// Create the texture, passing in the pointer to the loaded image pixel data
-		glTexImage2D(GL_TEXTURE_2D, 0, pixel_format, width, height, 0, pixel_format, GL_UNSIGNED_BYTE, data);
-
-		// Generate Mip Maps
-		if (bGenMipmaps)
-		{
-			glGenerateMipmap(GL_TEXTURE_2D);
-		}
-		else
-		{
-			// If mipmaps are not used then ensure that the min filter is defined
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		}
-	}
-	else
-	{
-		printf("stb_image  loading error: filename=%s", filename);
-		return false;
-	}
-	stbi_image_free(data);
-	return true;
-}
-
 /*
 This function is called before entering the main rendering loop.
 Use it for all your initialisation stuff
@@ -211,6 +207,10 @@ void init(GLWrapper* glw)
 	heightfield->createTerrain(200, 200, land_size, land_size);
 	heightfield->createObject();
 
+	/* Create the snow layer over the terrain, a coarse grid is enough as the texture is filtered */
+	snow = new snow_cover(64, 64, land_size, land_size);
+	snow->create();
+
 
 	/* create the sphere and cube objects */
 	sphere.makeSphere(numlats, numlongs);
@@ -221,6 +221,7 @@ void init(GLWrapper* glw)
 	{
 		program = glw->LoadShader("..\\ASSIGNMENT_2\\code\\lab5solution.vert", "..\\ASSIGNMENT_2\\code\\lab5solution.frag");
 		points_program = glw->LoadShader("..\\ASSIGNMENT_2\\code\\point_sprites.vert", "..\\ASSIGNMENT_2\\code\\point_sprites_analytic.frag");
+		points_oit_program = glw->LoadShader("..\\ASSIGNMENT_2\\code\\point_sprites.vert", "..\\ASSIGNMENT_2\\code\\point_sprites_oit.frag");
 		terrain_program = glw->LoadShader("..\\ASSIGNMENT_2\\code\\terrain.vert", "..\\ASSIGNMENT_2\\code\\terrain.frag");
 		sky_program = glw->LoadShader("..\\ASSIGNMENT_2\\code\\sky_sphere.vert", "..\\ASSIGNMENT_2\\code\\sky_sphere.frag");
 	}
@@ -232,9 +233,11 @@ void init(GLWrapper* glw)
 	}
 
 
-	/* Load and create our object*/
-	tiny_obj.load_obj("..\\ASSIGNMENT_2\\code\\tree.obj");
-	load_texture("..\\ASSIGNMENT_2\\code\\grass.jpg", texID, false);
+	/* Load and create our object in the background, the scene is drawn without it until it arrives.
+	   The textures named by its materials are loaded once it has */
+	loader = new asset_loader();
+	assets = new asset_manager(loader);
+	tree = assets->loadMesh("..\\ASSIGNMENT_2\\code\\tree.obj");
 
 	/* Define uniforms to send to main program shaders */
 	modelID = glGetUniformLocation(program, "model");
@@ -251,6 +254,8 @@ void init(GLWrapper* glw)
 	terrain_colourmodeID = glGetUniformLocation(terrain_program, "colourmode");
 	terrain_viewID = glGetUniformLocation(terrain_program, "view");
 	terrain_projectionID = glGetUniformLocation(terrain_program, "projection");
+	terrain_snowcoverID = glGetUniformLocation(terrain_program, "snowcover");
+	terrain_sizeID = glGetUniformLocation(terrain_program, "terrainsize");
 
 	/* Define uniforms to send to main program shaders */
 	// sky_modelID = glGetUniformLocation(sky_program, "model");
@@ -265,14 +270,32 @@ void init(GLWrapper* glw)
 	points_viewID = glGetUniformLocation(points_program, "view");
 	points_projectionID = glGetUniformLocation(points_program, "projection");
 
+	/* Define uniforms to send to the order independent transparency point sprites shaders */
+	points_oit_modelID = glGetUniformLocation(points_oit_program, "model");
+	points_oit_sizeID = glGetUniformLocation(points_oit_program, "size");
+	points_oit_viewID = glGetUniformLocation(points_oit_program, "view");
+	points_oit_projectionID = glGetUniformLocation(points_oit_program, "projection");
+
+	/* Create the transparency targets at the current framebuffer size */
+	int fb_width, fb_height;
+	glfwGetFramebufferSize(glw->getWindow(), &fb_width, &fb_height);
+	particle_oit = new oit_buffer();
+	particle_oit->create(glw, fb_width, fb_height);
+	viewport_height = (GLfloat)fb_height;
+	use_oit = false;
+
+	quads = new particle_quads();
+	quads->create(glw);
+	use_quads = false;
+
 	// Place the present object on the terrain at its current start position
 	cube_y = heightfield->heightAtPosition(1.f, 1.f);
 	tree_y = heightfield->heightAtPosition(x, z);
 
 
-	// Call our texture loader function to load two textures.
-	// Note that our texture loader generates the texID and is passed as a var parameter
-	// The third parameter is a boolean that with generater mipmaps if true
+	// Ask the loader for the textures. Each name holds a grey placeholder until its image
+	// has been decoded on a loader thread and uploaded at the start of a frame.
+	// The second parameter is a boolean that with generate mipmaps if true
 
 	/* load an image file using stb_image */
 	const char* filename1 = "..\\ASSIGNMENT_2\\code\\grass.jpg";
@@ -281,28 +304,16 @@ void init(GLWrapper* glw)
 	const char* point_texture_file = "..\\ASSIGNMENT_2\\code\\snowflake.png";
 
 
-	// This will flip the image so that the texture coordinates defined in
-	// the sphere, match the image orientation as loaded by stb_image
-	stbi_set_flip_vertically_on_load(true);
-	if (!load_texture(filename1, textureID1, true))
-	{
-		cout << "Fatal error loading texture: " << filename1 << endl;
-		exit(0);
-	}
+	// The ground, point sprite and sky textures are all drawn on the first frame, so they are
+	// loaded here with the images decoded in parallel. The last parameter flips the images so
+	// that the texture coordinates defined in the sphere, match the image orientation
+	vector<texture_handle> startup = assets->loadTextures({ filename1, point_texture_file, filename4 }, true, true);
+	textureID1 = startup[0];
+	point_textureID = startup[1];
+	textureID4 = startup[2];
 
-	// Load point sprite texture image
-	if (!load_texture(point_texture_file, point_textureID, true))
-	{
-		cout << "Fatal error loading texture: " << point_texture_file << endl;
-		exit(0);
-	}
-
-	// Load point sprite texture image
-	if (!load_texture(filename4, textureID4, true))
-	{
-		cout << "Fatal error loading texture: " << point_texture_file << endl;
-		exit(0);
-	}
+	// The same grass texture as textureID1, so both get one shared handle
+	texID = assets->loadTexture(filename1, true, true);
 
 
 
@@ -324,6 +335,13 @@ void init(GLWrapper* glw)
 	maxdist = 1.f;
 	point_anim = new points(5000, maxdist, speed);
 	point_anim->create();
+	point_anim->attachTerrain(heightfield, snow);
+
+	/* Wind over the whole terrain, from just below the ground to above the particle spawn height */
+	wind = new wind_field(32, 16, 32, vec3(-land_size / 2.f, -5.f, -land_size / 2.f), vec3(land_size / 2.f, 25.f, land_size / 2.f));
+	wind->create();
+	point_anim->attachWind(wind);
+	point_anim->createGPU(glw);
 	point_size = 8;
 	/* Define the Blending function */
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -342,6 +360,14 @@ void display()
 	/* Enable depth test  */
 	glEnable(GL_DEPTH_TEST);
 
+	// Upload whatever the loader threads have finished, a couple of milliseconds a frame.
+	// Once the last load is in, evict the assets that nothing holds any more
+	if (loader->update(2.0) && loader->idle())
+	{
+		size_t freed = assets->collect();
+		if (freed) cout << "Evicted unused assets: " << freed / 1024 << " KB freed" << endl;
+	}
+
 	// Projection matrix : 45 Field of View, 4:3 ratio, display range : 0.1 unit <-> 100 units
 	mat4 projection = perspective(radians(30.0f), aspect_ratio, 0.1f, 100.0f);
 
@@ -378,7 +404,14 @@ void display()
 		glUniformMatrix4fv(terrain_projectionID, 1, GL_FALSE, &projection[0][0]);
 		glUniformMatrix4fv(terrain_modelID, 1, GL_FALSE, &model.top()[0][0]);
 
-		// Draw our quad
+		// The snow cover is read from texture unit 1
+		glUniform1i(terrain_snowcoverID, 1);
+		glUniform2f(terrain_sizeID, land_size, land_size);
+		snow->bind(1);
+
+		// Draw our quad, only the meshlets in view
+		terrain_world_bounds = heightfield->bounds.transform(model.top());
+		heightfield->cull(view * model.top(), projection);
 		heightfield->drawObject(drawmode);
 	}
 	model.pop();
@@ -393,12 +426,13 @@ void display()
 		glUseProgram(sky_program);
 
 		// Send our common uniforms variables to the currently bound shader,
-		glBindTexture(GL_TEXTURE_2D, textureID4);
+		glBindTexture(GL_TEXTURE_2D, textureID4->texture);
 		glUniformMatrix4fv(sky_viewID, 1, GL_FALSE, &view[0][0]);
 		glUniformMatrix4fv(sky_projectionID, 1, GL_FALSE, &projection[0][0]);
 		glUniformMatrix4fv(sky_modelID, 1, GL_FALSE, &model.top()[0][0]);
 				
 		// Draw our shape
+		sky_world_bounds = sphere.bounds.transform(model.top());
 		sphere.drawSphere(drawmode);
 		glBindTexture(GL_TEXTURE_2D, 0);
 	}
@@ -436,12 +470,25 @@ void display()
 
 
 		/* Draw our object with texture */
-		glBindTexture(GL_TEXTURE_2D, texID);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glBindTexture(GL_TEXTURE_2D, texID->texture);
 
-		// draw the object
+		// draw the object, with less detail the smaller it is on the screen
 		glUniformMatrix4fv(modelID, 1, GL_FALSE, &model.top()[0][0]);
-		tiny_obj.drawObject(drawmode);
+		if (tree->mesh.loaded())
+		{
+			tree_world_bounds = tree->mesh.bounds.transform(model.top());
+			tree->mesh.selectLod(view * model.top(), projection, viewport_height);
+			tree->mesh.cullClusters(view * model.top(), projection);
+			tree->mesh.drawObject(drawmode);
+		}
+		else
+		{
+			// A tall cube stands in for the tree while it is still loading
+			model.top() = scale(model.top(), vec3(0.5f, 2.f, 0.5f));
+			model.top() = translate(model.top(), vec3(0.f, 0.25f, 0.f));
+			glUniformMatrix4fv(modelID, 1, GL_FALSE, &model.top()[0][0]);
+			cube.drawCube(drawmode);
+		}
 		glBindTexture(GL_TEXTURE_2D, 0);
 
 	}
@@ -485,6 +532,7 @@ void display()
 		{
 			// here we scale the model to make it into a cuboid
 			model.top() = scale(model.top(), vec3(1.f, 0.05f, 1.f));
+			present_world_bounds = cube.bounds.transform(model.top());
 
 			// Send the model uniform and normal matrix to the currently bound shader,
 			glUniformMatrix4fv(modelID, 1, GL_FALSE, &(model.top()[0][0]));
@@ -639,31 +687,77 @@ void display()
 	
 
 	// Now draw our particles
-	/* switch to the point sprites shader program current */
-	glUseProgram(points_program);
+	if (use_oit)
+	{
+		/* switch to the order independent transparency point sprites shader program */
+		glUseProgram(points_oit_program);
 
-	// Send our uniforms variables to the currently bound shader,
-	glUniformMatrix4fv(points_modelID, 1, GL_FALSE, &model.top()[0][0]);
-	glUniform1f(points_sizeID, point_size);
-	glUniformMatrix4fv(points_viewID, 1, GL_FALSE, &view[0][0]);
-	glUniformMatrix4fv(points_projectionID, 1, GL_FALSE, &projection[0][0]);
+		// Send our uniforms variables to the currently bound shader,
+		glUniformMatrix4fv(points_oit_modelID, 1, GL_FALSE, &model.top()[0][0]);
+		glUniform1f(points_oit_sizeID, point_size);
+		glUniformMatrix4fv(points_oit_viewID, 1, GL_FALSE, &view[0][0]);
+		glUniformMatrix4fv(points_oit_projectionID, 1, GL_FALSE, &projection[0][0]);
+
+		/* Draw into the accumulation and revealage targets, this sets up its own blending */
+		particle_oit->begin();
+	}
+	else
+	{
+		/* switch to the point sprites shader program current */
+		glUseProgram(points_program);
+
+		// Send our uniforms variables to the currently bound shader,
+		glUniformMatrix4fv(points_modelID, 1, GL_FALSE, &model.top()[0][0]);
+		glUniform1f(points_sizeID, point_size);
+		glUniformMatrix4fv(points_viewID, 1, GL_FALSE, &view[0][0]);
+		glUniformMatrix4fv(points_projectionID, 1, GL_FALSE, &projection[0][0]);
+
+		/* Enable Blending for the analytic point sprite */
+		glEnable(GL_BLEND);
+	}
 
 	// Enable gl_PointSize
 	glEnable(GL_PROGRAM_POINT_SIZE);
-	/* Enable Blending for the analytic point sprite */
-	glEnable(GL_BLEND);
 
 	// Bind the ground texture, change texture parameter to make use of mipmap
-	glBindTexture(GL_TEXTURE_2D, point_textureID);
+	glBindTexture(GL_TEXTURE_2D, point_textureID->texture);
 
 	/* Modify our animation variables */
 	angle_x += angle_inc_x;
 	angle_y += angle_inc_y;
 	angle_z += angle_inc_z;
 
-	point_anim->draw();
+	// Drop the particles that are off screen or thinned out by distance
+	if (point_anim->culling) point_anim->cull(projection, view * model.top());
+
+	// Sort the particles back to front before drawing them blended, OIT doesn't need it
+	if (point_anim->depth_sort && !use_oit) point_anim->sortByDepth(view * model.top());
+
+	// The quads need the positions on the CPU so the GPU simulation always uses the point sprites
+	if (use_quads && !point_anim->gpu_simulation)
+	{
+		quads->build(point_anim, view * model.top());
+		quads->draw(model.top(), view, projection, use_oit);
+	}
+	else
+	{
+		point_anim->draw();
+	}
+
+	// Blend the transparent particles over the scene
+	if (use_oit)
+	{
+		particle_oit->end();
+		particle_oit->composite();
+	}
+
+	// Move the wind on and then the particles
+	wind->update();
 	point_anim->animate();
 
+	// Upload the parts of the snow cover that the particles landed on
+	snow->update();
+
 	// Disable everything
 	glDisable(GL_BLEND);
 	glBindTexture(GL_TEXTURE_2D, 0);
@@ -682,6 +776,9 @@ static void reshape(GLFWwindow* window, int w, int h)
 {
 	glViewport(0, 0, (GLsizei)w, (GLsizei)h);
 	aspect_ratio = ((float)w / 640.f*4.f) / ((float)h / 480.f*3.f);
+	viewport_height = (GLfloat)h;
+
+	if (particle_oit) particle_oit->resize(w, h);
 }
 
 /* change view angle, exit upon ESC */
@@ -739,11 +836,108 @@ static void keyCallback(GLFWwindow* window, int key, int s, int action, int mods
 	if (key == 'L') maxdist -= 0.1f;
 	if (key == ';') maxdist += 0.1f;
 
+	/* Switch the particles between alpha blending and order independent transparency */
+	if (key == 'I' && action != GLFW_PRESS)
+	{
+		use_oit = !use_oit;
+		cout << "Particle transparency: " << (use_oit ? "weighted blended OIT" : "alpha blend") << endl;
+	}
+
+	/* Switch between point sprites and instanced quads for the particles */
+	if (key == 'H' && action != GLFW_PRESS)
+	{
+		use_quads = !use_quads;
+		cout << "Particle renderer: " << (use_quads ? "instanced quads" : "point sprites") << endl;
+	}
+
+	/* Stretch the quads along the direction of motion or spin them */
+	if (key == 'J' && action != GLFW_PRESS)
+	{
+		quads->velocity_align = !quads->velocity_align;
+		cout << "Particle quads: " << (quads->velocity_align ? "velocity aligned" : "spinning") << endl;
+	}
+
+	/* Switch the particle update between the CPU and the compute shader, which is
+	   refused while the particles clump */
+	if (key == 'G' && action != GLFW_PRESS)
+	{
+		point_anim->setGPUSimulation(!point_anim->gpu_simulation);
+		cout << "Particle simulation: " << (point_anim->gpu_simulation ? "GPU" : "CPU") << endl;
+	}
+
+	/* Toggle frustum and distance culling of the particles */
+	if (key == 'E' && action != GLFW_PRESS)
+	{
+		point_anim->culling = !point_anim->culling;
+		cout << "Particle culling: " << (point_anim->culling ? "on" : "off") << endl;
+	}
+
+	/* Print the particle counters for the last frame */
+	if (key == 'Q' && action != GLFW_PRESS)
+	{
+		GLuint drawn = point_anim->culling ? point_anim->numvisible : point_anim->numpoints;
+		cout << "Particles drawn: " << drawn << " of " << point_anim->numpoints
+			<< ", uploaded: " << point_anim->upload_bytes / 1024 << " KB" << endl;
+		cout << "Tree level of detail: " << tree->mesh.current_lod << " of " << tree->mesh.lods.size()
+			<< ", triangles drawn: " << tree->mesh.triangles_drawn << endl;
+		print_cluster_stats("Tree", tree->mesh.cluster_stats);
+		print_cluster_stats("Terrain", heightfield->cluster_stats);
+		print_bounds("Terrain world", terrain_world_bounds);
+		print_bounds("Sky world", sky_world_bounds);
+		print_bounds("Tree world", tree_world_bounds);
+		print_bounds("Present base world", present_world_bounds);
+		cout << "Assets still loading: " << loader->pending() << endl;
+		assets->print();
+	}
+
+	/* Toggle culling of the tree and terrain meshlets */
+	if (key == '1' && action != GLFW_PRESS)
+	{
+		tree->mesh.cluster_culling = !tree->mesh.cluster_culling;
+		heightfield->cluster_culling = tree->mesh.cluster_culling;
+		cout << "Meshlet culling: " << (tree->mesh.cluster_culling ? "on" : "off") << endl;
+	}
+
+	/* Toggle the tree level of detail */
+	if (key == 'U' && action != GLFW_PRESS)
+	{
+		tree->mesh.use_lod = !tree->mesh.use_lod;
+		cout << "Tree level of detail: " << (tree->mesh.use_lod ? "on" : "off") << endl;
+	}
+
+	/* Toggle the particles clumping together */
+	if (key == 'R' && action != GLFW_PRESS && !point_anim->gpu_simulation)
+	{
+		point_anim->clumping = !point_anim->clumping;
+		cout << "Particle clumping: " << (point_anim->clumping ? "on" : "off") << endl;
+	}
+
+	/* Toggle back to front sorting of the particles */
+	if (key == 'K' && action != GLFW_PRESS)
+	{
+		point_anim->depth_sort = !point_anim->depth_sort;
+		cout << "Particle depth sort: " << (point_anim->depth_sort ? "on" : "off") << endl;
+	}
+
 	point_anim->updateParams(maxdist, speed);
 
 }
 
 
+/* Drop the handles while there is still a GL context to delete the textures and
+   buffers in, the loader goes first as its unfinished loads call the manager */
+void release_assets()
+{
+	delete(loader);
+	tree.reset();
+	texID.reset();
+	textureID1.reset();
+	point_textureID.reset();
+	textureID4.reset();
+	delete(assets);
+}
+
+
 /* Entry point of program */
 int main(int argc, char* argv[])
 {
@@ -761,8 +955,19 @@ int main(int argc, char* argv[])
 
 	init(glw);
 
+	// Run the timing tests instead of the animation if requested
+	if (argc > 1 && string(argv[1]) == "-benchmark")
+	{
+		loader->finishAll();
+		run_benchmarks(glw);
+		release_assets();
+		delete(glw);
+		return 0;
+	}
+
 	glw->eventLoop();
 
+	release_assets();
 	delete(glw);
 	return 0;
 }
@@ -30,13 +30,39 @@ vec3 light_dir = vec3(0.0, 0.0, 10.0);
 uniform mat3 normalmatrix;
 uniform vec4 lightpos;
 
+// Set while a mesh with quantized vertices is drawn (mesh_quantize.h). The position
+// and texture coordinate arrive as fractions of these ranges and the normal as an
+// octahedral map in its first two components
+uniform uint quantized;
+uniform vec3 position_offset, position_scale;
+uniform vec4 texcoord_transform;		// offset in xy, scale in zw
+
+vec3 octahedral_decode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
 void main()
 {
 	vec3 light_pos3 = lightpos.xyz;		
 
+	vec3 vposition = position;
+	vec3 vnormal = normal;
+	vec2 vtexcoord = texcoord;
+	if (quantized == 1)
+	{
+		vposition = position_offset + position * position_scale;
+		vnormal = octahedral_decode(normal.xy);
+		vtexcoord = texcoord_transform.xy + texcoord * texcoord_transform.zw;
+	}
+
 	vec4 specular_colour = vec4(1.0,1.0,1.0,1.0);
 	vec4 diffuse_colour = vec4(0.5,0.5,0,1.0);
-	vec4 position_h = vec4(position, 1.0);
+	vec4 position_h = vec4(vposition, 1.0);
 	float shininess = 8.0;
 	
 	if (colourmode == 1)
@@ -48,7 +74,7 @@ void main()
 
 	mat4 mv_matrix = view * model;
 	mat3 normalmatrix = mat3(mv_matrix);
-	vec3 N = mat3(mv_matrix) * normal;
+	vec3 N = mat3(mv_matrix) * vnormal;
 	N = normalize(N);
 	light_dir = normalize(light_dir);
 
@@ -65,10 +91,10 @@ void main()
 	gl_Position = projection * view * model * position_h;
 
 	// Pass through the texture coordinate
-	ftexcoord = texcoord;
+	ftexcoord = vtexcoord;
 
 	fposition = (mv_matrix * position_h).xyz;			// Modify the vertex position (x, y, z, w) by the model-view transformation
-	fnormal = normalize(normalmatrix * normal);	// Modify the normals by the normal-matrix (i.e. to model-view (or eye) coordinates )
+	fnormal = normalize(normalmatrix * vnormal);	// Modify the normals by the normal-matrix (i.e. to model-view (or eye) coordinates )
 	flightdir = light_pos3 - fposition;				// Calculate the vector from the light position to the vertex in eye space
 
 	// Calculate the vertex position in projectin space and output to the pipleline using the reserved variable gl_Position
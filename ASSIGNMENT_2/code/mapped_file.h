@@ -0,0 +1,35 @@
+/* mapped_file.h
+   Read only memory mapping of a whole file, so that parsers can work straight
+   over the file's bytes without copying them into a buffer first.
+   Uses MapViewOfFile on Windows and mmap elsewhere.
+*/
+
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+class mapped_file
+{
+public:
+	mapped_file();
+	~mapped_file();
+
+	bool open(const std::string& filename);
+	void close();
+
+	const char* data;		// Start of the file contents, nullptr if nothing is mapped
+	size_t size;
+
+private:
+	// Not copyable, the mapping belongs to one object
+	mapped_file(const mapped_file&);
+	mapped_file& operator=(const mapped_file&);
+
+#ifdef _WIN32
+	void* file;
+	void* mapping;
+#else
+	int fd;
+#endif
+};
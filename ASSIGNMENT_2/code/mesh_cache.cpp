@@ -0,0 +1,362 @@
+/* mesh_cache.cpp
+   Binary mesh cache files, see mesh_cache.h
+   All values are stored in the byte order of the machine that wrote them, the
+   cache is a local build product and is never shared between machines.
+*/
+
+#include "mesh_cache.h"
+#include "mesh_codec.h"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <cstddef>
+#include <cstring>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+mesh_cache::mesh_cache()
+{
+	view = mesh_view();
+	rehashed = false;
+}
+
+
+/* Cache file used for a source file loaded with the options, e.g. tree.obj.lods.optimized.meshcache */
+string mesh_cache::cachePath(const string& source_path, uint32_t options)
+{
+	return source_path + ((options & MESH_CACHE_LODS) ? ".lods" : "") + ((options & MESH_CACHE_OPTIMIZED) ? ".optimized" : "")
+		+ ((options & MESH_CACHE_COMPRESSED) ? ".compressed" : "") + ".meshcache";
+}
+
+
+/* 64 bit hash of a file's contents, eight bytes at a time (FNV style mixing with a
+   multiply and shift so that every input bit reaches the whole result) */
+uint64_t mesh_cache::hashFile(const string& path)
+{
+	mapped_file source;
+	if (!source.open(path)) return 0;
+
+	uint64_t h = 0xcbf29ce484222325ull ^ source.size;
+	const char* p = source.data;
+	size_t n = source.size;
+	for (; n >= 8; p += 8, n -= 8)
+	{
+		uint64_t w;
+		memcpy(&w, p, 8);
+		h = (h ^ w) * 0x100000001b3ull;
+		h ^= h >> 29;
+	}
+	for (; n > 0; p++, n--) h = (h ^ uint8_t(*p)) * 0x100000001b3ull;
+	h ^= h >> 32;
+	return h;
+}
+
+
+static bool source_stat(const string& path, uint64_t& size, int64_t& mtime)
+{
+	error_code ec;
+	size = fs::file_size(path, ec);
+	if (ec) return false;
+	fs::file_time_type t = fs::last_write_time(path, ec);
+	if (ec) return false;
+	mtime = int64_t(t.time_since_epoch().count());
+	return true;
+}
+
+
+static inline uint64_t align16(uint64_t offset)
+{
+	return (offset + 15) & ~uint64_t(15);
+}
+
+static bool array_fits(uint64_t offset, uint64_t bytes, uint64_t size)
+{
+	return offset % 16 == 0 && offset <= size && bytes <= size - offset;
+}
+
+
+/* Map and check a cache file, view is filled in if it is valid for the source */
+bool mesh_cache::open(const string& cache_path, const string& source_path, uint32_t options)
+{
+	close();
+	rehashed = false;
+
+	uint64_t source_size;
+	int64_t source_mtime;
+	if (!source_stat(source_path, source_size, source_mtime))
+	{
+		reason = "source file not found";
+		return false;
+	}
+
+	if (!file.open(cache_path))
+	{
+		reason = "no cache file";
+		return false;
+	}
+
+	mesh_cache_header h;
+	if (file.size < sizeof(h))
+	{
+		reason = "cache file too small";
+		close();
+		return false;
+	}
+	memcpy(&h, file.data, sizeof(h));
+
+	if (h.magic != MESH_CACHE_MAGIC || h.version != MESH_CACHE_VERSION)
+	{
+		reason = "cache file is an old version";
+		close();
+		return false;
+	}
+	if (h.file_size != file.size)
+	{
+		reason = "cache file is incomplete";
+		close();
+		return false;
+	}
+	if ((h.flags & MESH_CACHE_OPTIONS) != (options & MESH_CACHE_OPTIONS))
+	{
+		reason = "cache file was built with different options";
+		close();
+		return false;
+	}
+	if (h.source_size != source_size)
+	{
+		reason = "source file size has changed";
+		close();
+		return false;
+	}
+
+	if (h.source_mtime != source_mtime)
+	{
+		// Touched but maybe not changed, e.g. by a checkout. Compare the contents
+		close();
+		if (hashFile(source_path) != h.source_hash)
+		{
+			reason = "source file has changed";
+			return false;
+		}
+		rehashed = true;
+
+		// Record the new time so the next run doesn't hash again
+		h.source_mtime = source_mtime;
+		fstream patch(cache_path, ios::in | ios::out | ios::binary);
+		patch.seekp(offsetof(mesh_cache_header, source_mtime));
+		patch.write((const char*)&h.source_mtime, sizeof(h.source_mtime));
+		patch.close();
+
+		if (!file.open(cache_path))
+		{
+			reason = "cache file could not be reopened";
+			return false;
+		}
+	}
+
+	uint64_t size = file.size;
+	bool compressed = (h.flags & MESH_CACHE_COMPRESSED) != 0;
+	bool ok = h.bounds_radius >= 0.f &&
+			  array_fits(h.ranges_offset, uint64_t(h.num_ranges) * sizeof(material_range), size) &&
+			  array_fits(h.materials_offset, uint64_t(h.num_materials) * sizeof(mesh_material), size) &&
+			  array_fits(h.lods_offset, uint64_t(h.num_lods) * sizeof(mesh_lod), size) &&
+			  array_fits(h.meshlets_offset, uint64_t(h.num_meshlets) * sizeof(meshlet), size);
+	if (compressed)
+	{
+		// The decoders check the coded data itself as they go
+		ok = ok && array_fits(h.packed_vertices_offset, h.packed_vertex_bytes, size) &&
+			 array_fits(h.indices_offset, h.packed_index_bytes, size);
+	}
+	else
+	{
+		ok = ok && array_fits(h.positions_offset, uint64_t(h.num_vertices) * 3 * sizeof(float), size) &&
+			 array_fits(h.colours_offset, uint64_t(h.num_vertices) * 4 * sizeof(float), size) &&
+			 array_fits(h.indices_offset, uint64_t(h.num_indices) * sizeof(GLuint), size);
+		if (h.flags & MESH_CACHE_NORMALS) ok = ok && array_fits(h.normals_offset, uint64_t(h.num_vertices) * 3 * sizeof(float), size);
+		if (h.flags & MESH_CACHE_TEXCOORDS) ok = ok && array_fits(h.texcoords_offset, uint64_t(h.num_vertices) * 2 * sizeof(float), size);
+	}
+	for (uint32_t l = 0; l < h.num_lods && ok; l++)
+	{
+		// The levels are drawn straight from the mapped index and range arrays
+		const mesh_lod* lod = (const mesh_lod*)(file.data + h.lods_offset) + l;
+		ok = uint64_t(lod->first_index) + lod->num_indices <= h.num_indices &&
+			 uint64_t(lod->first_range) + lod->num_ranges <= h.num_ranges;
+	}
+	for (uint32_t m = 0; m < h.num_meshlets && ok; m++)
+	{
+		const meshlet* cluster = (const meshlet*)(file.data + h.meshlets_offset) + m;
+		ok = uint64_t(cluster->first_index) + cluster->index_count <= h.num_indices;
+	}
+	for (uint32_t r = 0; r < h.num_ranges && ok; r++)
+	{
+		// Each range is drawn as whole triangles with its material's texture
+		const material_range* range = (const material_range*)(file.data + h.ranges_offset) + r;
+		ok = uint64_t(range->first) + range->count <= h.num_indices && range->first % 3 == 0 &&
+			 range->material >= -1 && range->material < GLint(h.num_materials);
+	}
+	if (!compressed && ok)
+	{
+		// decode_indices() checks the indices of a compressed cache
+		const GLuint* indices = (const GLuint*)(file.data + h.indices_offset);
+		GLuint largest = 0;
+		for (uint32_t i = 0; i < h.num_indices; i++) largest = max(largest, indices[i]);
+		ok = h.num_indices == 0 || largest < h.num_vertices;
+	}
+	if (!ok)
+	{
+		reason = "cache file is corrupt";
+		close();
+		return false;
+	}
+
+	const char* base = file.data;
+	view.num_vertices = h.num_vertices;
+	view.num_indices = h.num_indices;
+	view.num_ranges = h.num_ranges;
+	view.num_materials = h.num_materials;
+	view.num_lods = h.num_lods;
+	view.num_meshlets = h.num_meshlets;
+	if (compressed)
+	{
+		view.packed_vertices = (const unsigned char*)(base + h.packed_vertices_offset);
+		view.packed_vertex_bytes = size_t(h.packed_vertex_bytes);
+		view.packed_indices = (const unsigned char*)(base + h.indices_offset);
+		view.packed_index_bytes = size_t(h.packed_index_bytes);
+		view.packed_params.position_offset = glm::vec3(h.quantize[0], h.quantize[1], h.quantize[2]);
+		view.packed_params.position_scale = glm::vec3(h.quantize[3], h.quantize[4], h.quantize[5]);
+		view.packed_params.texcoord_offset = glm::vec2(h.quantize[6], h.quantize[7]);
+		view.packed_params.texcoord_scale = glm::vec2(h.quantize[8], h.quantize[9]);
+		view.packed_normals = (h.flags & MESH_CACHE_NORMALS) != 0;
+		view.packed_texcoords = (h.flags & MESH_CACHE_TEXCOORDS) != 0;
+	}
+	else
+	{
+		view.positions = (const GLfloat*)(base + h.positions_offset);
+		view.normals = (h.flags & MESH_CACHE_NORMALS) ? (const GLfloat*)(base + h.normals_offset) : nullptr;
+		view.texcoords = (h.flags & MESH_CACHE_TEXCOORDS) ? (const GLfloat*)(base + h.texcoords_offset) : nullptr;
+		view.colours = (const GLfloat*)(base + h.colours_offset);
+		view.indices = (const GLuint*)(base + h.indices_offset);
+	}
+	view.ranges = (const material_range*)(base + h.ranges_offset);
+	view.materials = (const mesh_material*)(base + h.materials_offset);
+	view.lods = (const mesh_lod*)(base + h.lods_offset);
+	view.meshlets = (const meshlet*)(base + h.meshlets_offset);
+	view.bounds.box_min = glm::vec3(h.bounds_min[0], h.bounds_min[1], h.bounds_min[2]);
+	view.bounds.box_max = glm::vec3(h.bounds_max[0], h.bounds_max[1], h.bounds_max[2]);
+	view.bounds.centre = glm::vec3(h.bounds_centre[0], h.bounds_centre[1], h.bounds_centre[2]);
+	view.bounds.radius = h.bounds_radius;
+	reason.clear();
+	return true;
+}
+
+
+void mesh_cache::close()
+{
+	file.close();
+	view = mesh_view();
+}
+
+
+/* Write the cache for a mesh loaded from source_path with the options. The file is
+   written under a temporary name and renamed into place so a crash never leaves a
+   half written cache. The name is different for every write, as loader threads can
+   write the same cache at once, and whichever is renamed last is kept */
+bool mesh_cache::write(const string& cache_path, const string& source_path, const mesh_view& mesh, uint32_t options)
+{
+	bool compress = (options & MESH_CACHE_COMPRESSED) != 0;
+	mesh_cache_header h;
+	memset(&h, 0, sizeof(h));
+	h.magic = MESH_CACHE_MAGIC;
+	h.version = MESH_CACHE_VERSION;
+	if (!source_stat(source_path, h.source_size, h.source_mtime)) return false;
+	h.source_hash = hashFile(source_path);
+
+	h.num_vertices = mesh.num_vertices;
+	h.num_indices = mesh.num_indices;
+	h.num_ranges = mesh.num_ranges;
+	h.num_materials = mesh.num_materials;
+	h.num_lods = mesh.num_lods;
+	h.num_meshlets = mesh.num_meshlets;
+	h.flags = (mesh.normals ? MESH_CACHE_NORMALS : 0) | (mesh.texcoords ? MESH_CACHE_TEXCOORDS : 0) | (options & MESH_CACHE_OPTIONS);
+	for (int i = 0; i < 3; i++)
+	{
+		h.bounds_min[i] = mesh.bounds.box_min[i];
+		h.bounds_max[i] = mesh.bounds.box_max[i];
+		h.bounds_centre[i] = mesh.bounds.centre[i];
+	}
+	h.bounds_radius = mesh.bounds.radius;
+
+	vector<unsigned char> packed_vertices, packed_indices;
+	if (compress)
+	{
+		vector<quantized_vertex> quantized;
+		quantize_params params = quantize_vertices(mesh, quantized);
+		encode_vertices(quantized.empty() ? nullptr : &quantized[0], mesh.num_vertices, packed_vertices);
+		encode_indices(mesh.indices, mesh.num_indices, packed_indices);
+		h.packed_vertex_bytes = packed_vertices.size();
+		h.packed_index_bytes = packed_indices.size();
+		const float quantize[10] = { params.position_offset.x, params.position_offset.y, params.position_offset.z,
+									 params.position_scale.x, params.position_scale.y, params.position_scale.z,
+									 params.texcoord_offset.x, params.texcoord_offset.y,
+									 params.texcoord_scale.x, params.texcoord_scale.y };
+		memcpy(h.quantize, quantize, sizeof(quantize));
+	}
+	uint64_t vertex_array = compress ? 0 : uint64_t(mesh.num_vertices);
+
+	// Lay out the arrays one after another
+	struct section { uint64_t* offset; const void* data; uint64_t bytes; };
+	section sections[] =
+	{
+		{ &h.positions_offset, mesh.positions, vertex_array * 3 * sizeof(float) },
+		{ &h.normals_offset, mesh.normals, mesh.normals ? vertex_array * 3 * sizeof(float) : 0 },
+		{ &h.texcoords_offset, mesh.texcoords, mesh.texcoords ? vertex_array * 2 * sizeof(float) : 0 },
+		{ &h.colours_offset, mesh.colours, vertex_array * 4 * sizeof(float) },
+		{ &h.indices_offset, compress ? (packed_indices.empty() ? nullptr : &packed_indices[0]) : (const void*)mesh.indices,
+		  compress ? uint64_t(packed_indices.size()) : uint64_t(mesh.num_indices) * sizeof(GLuint) },
+		{ &h.ranges_offset, mesh.ranges, uint64_t(mesh.num_ranges) * sizeof(material_range) },
+		{ &h.materials_offset, mesh.materials, uint64_t(mesh.num_materials) * sizeof(mesh_material) },
+		{ &h.lods_offset, mesh.lods, uint64_t(mesh.num_lods) * sizeof(mesh_lod) },
+		{ &h.meshlets_offset, mesh.meshlets, uint64_t(mesh.num_meshlets) * sizeof(meshlet) },
+		{ &h.packed_vertices_offset, packed_vertices.empty() ? nullptr : &packed_vertices[0], uint64_t(packed_vertices.size()) },
+	};
+	const int num_sections = sizeof(sections) / sizeof(sections[0]);
+
+	uint64_t offset = align16(sizeof(h));
+	for (int s = 0; s < num_sections; s++)
+	{
+		*sections[s].offset = offset;
+		offset = align16(offset + sections[s].bytes);
+	}
+	h.file_size = offset;
+
+	static atomic<unsigned> writes(0);
+	string temp_path = cache_path + "." + to_string(hash<thread::id>()(this_thread::get_id())) + "." + to_string(writes++) + ".tmp";
+	ofstream out(temp_path, ios::binary | ios::trunc);
+	if (!out) return false;
+
+	const char zeros[16] = { 0 };
+	out.write((const char*)&h, sizeof(h));
+	uint64_t written = sizeof(h);
+	for (int s = 0; s < num_sections; s++)
+	{
+		out.write(zeros, *sections[s].offset - written);
+		if (sections[s].bytes) out.write((const char*)sections[s].data, sections[s].bytes);
+		written = *sections[s].offset + sections[s].bytes;
+	}
+	out.write(zeros, h.file_size - written);
+	out.close();
+	if (!out) return false;
+
+	error_code ec;
+	fs::rename(temp_path, cache_path, ec);
+	if (ec)
+	{
+		fs::remove(temp_path, ec);
+		return false;
+	}
+	return true;
+}
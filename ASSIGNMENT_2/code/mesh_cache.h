@@ -0,0 +1,93 @@
+/* mesh_cache.h
+   Versioned binary cache of a mesh_data, written next to the source OBJ after it
+   has been parsed once. Later runs memory map the cache and upload straight from
+   the mapped arrays. The header records the size, modification time and a hash
+   of the source file: a different size means the cache is stale, a different
+   time alone means the source is hashed again and the cache is only rebuilt if
+   the contents have actually changed.
+   A compressed cache stores quantized vertices and indices coded by mesh_codec.h in
+   place of the attribute and index arrays, about a fifth of the size. Its view has
+   the packed arrays set instead and the uploader decodes them.
+   The loader options that change what is stored (levels of detail, optimised indices
+   and compression) are part of the file name and recorded in the flags, so meshes
+   loaded with different options each have a cache of their own.
+*/
+
+#pragma once
+
+#include "mesh_data.h"
+#include "mapped_file.h"
+#include <cstdint>
+#include <string>
+
+const uint32_t MESH_CACHE_MAGIC = 0x4853454d;		// "MESH"
+const uint32_t MESH_CACHE_VERSION = 9;
+
+struct mesh_cache_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t file_size;			// Size of the whole cache file, to catch truncated writes
+
+	uint64_t source_size;
+	int64_t source_mtime;
+	uint64_t source_hash;
+
+	uint32_t num_vertices;
+	uint32_t num_indices;
+	uint32_t num_ranges;
+	uint32_t num_materials;
+	uint32_t num_lods;
+	uint32_t num_meshlets;
+	uint32_t flags;				// MESH_CACHE_NORMALS | MESH_CACHE_TEXCOORDS and the MESH_CACHE_OPTIONS
+	float bounds_min[3];
+	float bounds_max[3];
+	float bounds_centre[3];
+	float bounds_radius;
+
+	// Byte offsets of the arrays from the start of the file, each 16 byte aligned
+	uint64_t positions_offset;
+	uint64_t normals_offset;
+	uint64_t texcoords_offset;
+	uint64_t colours_offset;
+	uint64_t indices_offset;
+	uint64_t ranges_offset;
+	uint64_t materials_offset;
+	uint64_t lods_offset;
+	uint64_t meshlets_offset;
+
+	// Only used by a compressed cache, which has no attribute arrays and the coded
+	// indices at indices_offset
+	uint64_t packed_vertices_offset;
+	uint64_t packed_vertex_bytes;
+	uint64_t packed_index_bytes;
+	float quantize[10];			// quantize_params: position offset and scale, texcoord offset and scale
+};
+
+const uint32_t MESH_CACHE_NORMALS = 1;
+const uint32_t MESH_CACHE_TEXCOORDS = 2;
+const uint32_t MESH_CACHE_COMPRESSED = 4;
+const uint32_t MESH_CACHE_LODS = 8;			// Built with levels of detail
+const uint32_t MESH_CACHE_OPTIMIZED = 16;	// Built with the triangles and vertices reordered
+const uint32_t MESH_CACHE_OPTIONS = MESH_CACHE_COMPRESSED | MESH_CACHE_LODS | MESH_CACHE_OPTIMIZED;
+
+class mesh_cache
+{
+public:
+	mesh_cache();
+
+	// options are the MESH_CACHE_OPTIONS the mesh is wanted with, a cache written
+	// with any others is refused
+	bool open(const std::string& cache_path, const std::string& source_path, uint32_t options);
+	void close();
+
+	// Compressed with mesh_codec.h if options has MESH_CACHE_COMPRESSED
+	static bool write(const std::string& cache_path, const std::string& source_path, const mesh_view& mesh, uint32_t options);
+	static uint64_t hashFile(const std::string& path);
+	static std::string cachePath(const std::string& source_path, uint32_t options);
+
+	mesh_view view;				// Points into the mapped file while it is open
+	mapped_file file;
+	bool rehashed;				// The source time had changed so its contents were hashed to check the cache
+	std::string reason;			// Why the last open() failed
+};
@@ -0,0 +1,360 @@
+/* mesh_codec.cpp
+   Vertex and index compression, see mesh_codec.h
+*/
+
+#include "mesh_codec.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+// The 16 bit words of a quantized_vertex that are coded, all but the position padding
+static const int coded_words[9] = { 0, 1, 2, 4, 5, 6, 7, 8, 9 };
+const int num_coded_words = 9;
+
+// Block widths
+const unsigned char WIDTH_ZERO = 0, WIDTH_4 = 1, WIDTH_8 = 2, WIDTH_16 = 3;
+
+static inline GLushort zigzag16(GLushort delta)
+{
+	return GLushort((delta << 1) ^ (GLshort(delta) >> 15));
+}
+
+static inline GLushort unzigzag16(GLushort v)
+{
+	return GLushort((v >> 1) ^ -(v & 1));
+}
+
+
+void encode_vertices(const quantized_vertex* vertices, GLuint count, vector<unsigned char>& out)
+{
+	static_assert(sizeof(quantized_vertex) == 20, "quantized_vertex is coded as 10 words");
+	GLushort previous[10] = { 0 };
+	GLushort words[VERTEX_CODEC_BLOCK][10];
+	GLushort values[VERTEX_CODEC_BLOCK];
+
+	for (GLuint start = 0; start < count; start += VERTEX_CODEC_BLOCK)
+	{
+		GLuint n = min(VERTEX_CODEC_BLOCK, count - start);
+		memcpy(words, vertices + start, n * sizeof(quantized_vertex));
+
+		for (int w = 0; w < num_coded_words; w++)
+		{
+			int word = coded_words[w];
+			GLushort last = previous[word], all = 0;
+			for (GLuint i = 0; i < n; i++)
+			{
+				values[i] = zigzag16(GLushort(words[i][word] - last));
+				last = words[i][word];
+				all |= values[i];
+			}
+
+			unsigned char width = all == 0 ? WIDTH_ZERO : all < 16 ? WIDTH_4 : all < 256 ? WIDTH_8 : WIDTH_16;
+			out.push_back(width);
+			if (width == WIDTH_4)
+			{
+				for (GLuint i = 0; i < n; i += 2) out.push_back((unsigned char)(values[i] | (i + 1 < n ? values[i + 1] << 4 : 0)));
+			}
+			else if (width == WIDTH_8)
+			{
+				for (GLuint i = 0; i < n; i++) out.push_back((unsigned char)values[i]);
+			}
+			else if (width == WIDTH_16)
+			{
+				for (GLuint i = 0; i < n; i++)
+				{
+					out.push_back((unsigned char)(values[i] & 0xff));
+					out.push_back((unsigned char)(values[i] >> 8));
+				}
+			}
+			previous[word] = last;
+		}
+	}
+}
+
+
+vertex_decoder::vertex_decoder(const unsigned char* data, size_t size, GLuint count)
+	: data(data), end(data + size), remaining(count), error(false)
+{
+	memset(previous, 0, sizeof(previous));
+}
+
+
+GLuint vertex_decoder::decode(quantized_vertex* out, GLuint max_vertices)
+{
+	GLushort words[VERTEX_CODEC_BLOCK][10];
+	GLuint decoded = 0;
+
+	while (remaining > 0 && !error)
+	{
+		GLuint n = min(VERTEX_CODEC_BLOCK, remaining);
+		if (decoded + n > max_vertices) break;
+
+		for (int w = 0; w < num_coded_words && !error; w++)
+		{
+			int word = coded_words[w];
+			GLushort last = previous[word];
+			if (data >= end)
+			{
+				error = true;
+				break;
+			}
+			unsigned char width = *data++;
+			size_t bytes = width == WIDTH_ZERO ? 0 : width == WIDTH_4 ? (n + 1) / 2 : width == WIDTH_8 ? n : n * 2;
+			if (width > WIDTH_16 || size_t(end - data) < bytes)
+			{
+				error = true;
+				break;
+			}
+
+			switch (width)
+			{
+			case WIDTH_ZERO:
+				for (GLuint i = 0; i < n; i++) words[i][word] = last;
+				break;
+			case WIDTH_4:
+				for (GLuint i = 0; i < n; i++)
+				{
+					last = GLushort(last + unzigzag16((data[i >> 1] >> ((i & 1) * 4)) & 15));
+					words[i][word] = last;
+				}
+				break;
+			case WIDTH_8:
+				for (GLuint i = 0; i < n; i++)
+				{
+					last = GLushort(last + unzigzag16(data[i]));
+					words[i][word] = last;
+				}
+				break;
+			default:
+				for (GLuint i = 0; i < n; i++)
+				{
+					last = GLushort(last + unzigzag16(GLushort(data[i * 2] | (data[i * 2 + 1] << 8))));
+					words[i][word] = last;
+				}
+				break;
+			}
+			data += bytes;
+			previous[word] = last;
+		}
+		if (error) break;
+
+		for (GLuint i = 0; i < n; i++) words[i][3] = 0;
+		memcpy(out + decoded, words, n * sizeof(quantized_vertex));
+		decoded += n;
+		remaining -= n;
+	}
+	return decoded;
+}
+
+
+bool decode_vertices(const unsigned char* data, size_t size, quantized_vertex* out, GLuint count)
+{
+	vertex_decoder decoder(data, size, count);
+	return decoder.decode(out, count) == count && !decoder.failed();
+}
+
+
+static inline GLuint zigzag32(GLint v)
+{
+	return (GLuint(v) << 1) ^ GLuint(v >> 31);
+}
+
+static inline GLint unzigzag32(GLuint v)
+{
+	return GLint(v >> 1) ^ -GLint(v & 1);
+}
+
+static void write_varint(vector<unsigned char>& out, GLuint v)
+{
+	while (v >= 128)
+	{
+		out.push_back((unsigned char)(v | 128));
+		v >>= 7;
+	}
+	out.push_back((unsigned char)v);
+}
+
+// The encoder and decoder keep the same recent edges and vertices and the next unused vertex
+struct index_codec_state
+{
+	GLuint edges[16][2];
+	GLuint edge_head;
+	GLuint vertices[16];
+	GLuint vertex_head;
+	GLuint next;		// One past the highest vertex seen
+	GLuint last;		// Last vertex coded, explicit vertices are coded relative to it
+
+	index_codec_state() : edge_head(0), vertex_head(0), next(0), last(0)
+	{
+		memset(edges, 0xff, sizeof(edges));
+		memset(vertices, 0xff, sizeof(vertices));
+	}
+
+	// Edges are stored the way round the triangle on the other side of them has them
+	void pushTriangle(GLuint a, GLuint b, GLuint c)
+	{
+		pushEdge(b, a);
+		pushEdge(c, b);
+		pushEdge(a, c);
+	}
+	void pushEdge(GLuint a, GLuint b)
+	{
+		edges[edge_head & 15][0] = a;
+		edges[edge_head & 15][1] = b;
+		edge_head++;
+	}
+	const GLuint* recentEdge(GLuint i) const { return edges[(edge_head - 1 - i) & 15]; }
+
+	void pushVertex(GLuint v)
+	{
+		vertices[vertex_head & 15] = v;
+		vertex_head++;
+	}
+	GLuint recentVertex(GLuint i) const { return vertices[(vertex_head - 1 - i) & 15]; }
+
+	void used(GLuint v)
+	{
+		if (v >= next) next = v + 1;
+		last = v;
+	}
+};
+
+/* 4 bit code of one vertex: 0 the next unused vertex, 1 to 14 one of the recent
+   vertices, 15 an explicit vertex whose value follows as a varint */
+static GLuint encode_vertex(index_codec_state& state, GLuint v, vector<unsigned char>& extra)
+{
+	GLuint code = 15;
+	if (v == state.next)
+	{
+		code = 0;
+	}
+	else
+	{
+		for (GLuint i = 0; i < 14; i++)
+		{
+			if (state.recentVertex(i) == v)
+			{
+				code = 1 + i;
+				break;
+			}
+		}
+	}
+	if (code == 15) write_varint(extra, zigzag32(GLint(v - state.last)));
+	if (code == 0 || code == 15) state.pushVertex(v);
+	state.used(v);
+	return code;
+}
+
+
+/* One byte per triangle: the high nibble is the recent edge it starts with, or 15
+   for none, the low nibble codes the vertex after the edge. A triangle with no
+   recent edge has a second byte with the codes of its other two vertices. Explicit
+   vertices follow in order */
+void encode_indices(const GLuint* indices, size_t count, vector<unsigned char>& out)
+{
+	index_codec_state state;
+	vector<unsigned char> extra;
+
+	for (size_t t = 0; t + 2 < count; t += 3)
+	{
+		GLuint tri[3] = { indices[t], indices[t + 1], indices[t + 2] };
+		GLint edge = -1, rotation = 0;
+		for (GLuint i = 0; i < 15 && edge < 0; i++)
+		{
+			const GLuint* e = state.recentEdge(i);
+			for (int r = 0; r < 3; r++)
+			{
+				if (tri[r] == e[0] && tri[(r + 1) % 3] == e[1])
+				{
+					edge = GLint(i);
+					rotation = r;
+					break;
+				}
+			}
+		}
+
+		extra.clear();
+		GLuint a = tri[rotation], b = tri[(rotation + 1) % 3], c = tri[(rotation + 2) % 3];
+		if (edge >= 0)
+		{
+			GLuint code = encode_vertex(state, c, extra);
+			out.push_back((unsigned char)((edge << 4) | code));
+		}
+		else
+		{
+			GLuint code_a = encode_vertex(state, a, extra);
+			GLuint code_b = encode_vertex(state, b, extra);
+			GLuint code_c = encode_vertex(state, c, extra);
+			out.push_back((unsigned char)(0xf0 | code_a));
+			out.push_back((unsigned char)((code_b << 4) | code_c));
+		}
+		out.insert(out.end(), extra.begin(), extra.end());
+		state.pushTriangle(a, b, c);
+	}
+}
+
+
+static bool decode_vertex(index_codec_state& state, GLuint code, const unsigned char*& data, const unsigned char* end, GLuint& v)
+{
+	if (code == 0)
+	{
+		v = state.next;
+		state.pushVertex(v);
+	}
+	else if (code < 15)
+	{
+		v = state.recentVertex(code - 1);
+	}
+	else
+	{
+		GLuint value = 0;
+		for (int shift = 0;; shift += 7)
+		{
+			if (data >= end || shift > 28) return false;
+			unsigned char byte = *data++;
+			value |= GLuint(byte & 127) << shift;
+			if (byte < 128) break;
+		}
+		v = GLuint(state.last + unzigzag32(value));
+		state.pushVertex(v);
+	}
+	state.used(v);
+	return true;
+}
+
+
+bool decode_indices(const unsigned char* data, size_t size, GLuint* out, size_t count, GLuint vertex_count)
+{
+	const unsigned char* end = data + size;
+	index_codec_state state;
+
+	for (size_t t = 0; t + 2 < count; t += 3)
+	{
+		if (data >= end) return false;
+		unsigned char code = *data++;
+		GLuint a, b, c;
+		if ((code >> 4) < 15)
+		{
+			const GLuint* e = state.recentEdge(code >> 4);
+			a = e[0];
+			b = e[1];
+			if (!decode_vertex(state, code & 15, data, end, c)) return false;
+		}
+		else
+		{
+			if (data >= end) return false;
+			unsigned char codes = *data++;
+			if (!decode_vertex(state, code & 15, data, end, a) ||
+				!decode_vertex(state, codes >> 4, data, end, b) ||
+				!decode_vertex(state, codes & 15, data, end, c)) return false;
+		}
+		if (a >= vertex_count || b >= vertex_count || c >= vertex_count) return false;
+
+		out[t] = a;
+		out[t + 1] = b;
+		out[t + 2] = c;
+		state.pushTriangle(a, b, c);
+	}
+	return data == end;
+}
@@ -0,0 +1,52 @@
+/* mesh_codec.h
+   Compression of quantized vertices (mesh_quantize.h) and triangle indices for the
+   mesh cache.
+   Vertices are coded in blocks of 64. Each 16 bit word of a vertex (the padding
+   word is skipped) is stored as the zigzag coded difference from the same word of
+   the vertex before, with one width for the whole block: nothing when the word
+   doesn't change, 4, 8 or 16 bits. After optimize_vertex_fetch() neighbouring
+   vertices are close on the mesh, so most differences are small. A block decodes
+   with a few tight loops into a small buffer that is then copied out whole, which
+   suits a write combined buffer from glMapBufferRange.
+   Indices are coded a triangle at a time against the last 16 edges and vertices,
+   rotating each triangle (which keeps its winding) so that it starts with a shared
+   edge where it can. A triangle that shares an edge and adds the next unused vertex,
+   the common case for a vertex cache ordered mesh, takes one byte. The triangle
+   order is kept, so material ranges, levels of detail and meshlets stay valid.
+   Both decoders check every read against the end of the data and every index
+   against the vertex count, as the data comes from a file.
+*/
+
+#pragma once
+
+#include "wrapper_glfw.h"
+#include "mesh_quantize.h"
+#include <vector>
+
+const GLuint VERTEX_CODEC_BLOCK = 64;
+
+void encode_vertices(const quantized_vertex* vertices, GLuint count, std::vector<unsigned char>& out);
+void encode_indices(const GLuint* indices, size_t count, std::vector<unsigned char>& out);
+
+/* Decode the vertices a block at a time, so they can go straight from the mapped
+   cache file into a mapped vertex buffer without a whole copy in between */
+class vertex_decoder
+{
+public:
+	vertex_decoder(const unsigned char* data, size_t size, GLuint count);
+
+	// Decode up to max_vertices (rounded down to whole blocks unless it reaches the
+	// end) into out. Returns the number decoded, 0 at the end or on corrupt data
+	GLuint decode(quantized_vertex* out, GLuint max_vertices);
+	bool failed() const { return error; }
+
+private:
+	const unsigned char* data;
+	const unsigned char* end;
+	GLuint remaining;
+	GLushort previous[10];
+	bool error;
+};
+
+bool decode_vertices(const unsigned char* data, size_t size, quantized_vertex* out, GLuint count);
+bool decode_indices(const unsigned char* data, size_t size, GLuint* out, size_t count, GLuint vertex_count);
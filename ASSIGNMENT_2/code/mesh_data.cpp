@@ -0,0 +1,182 @@
+/* mesh_data.cpp
+   Helpers for the CPU side mesh, see mesh_data.h
+*/
+
+#include "mesh_data.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+using namespace std;
+using namespace glm;
+
+mesh_data::mesh_data()
+{
+	bounds = compute_bounds(nullptr, 0);
+}
+
+
+/* Bounding box and sphere of the positions, zero size at the origin for an empty mesh */
+void mesh_data::computeBounds()
+{
+	bounds = compute_bounds(positions.empty() ? nullptr : &positions[0], numVertices());
+}
+
+
+/* Sort the triangles by material and split the index array into one run per material.
+   triangle_materials has one entry per triangle in index order. Materials that use
+   the same texture are placed next to each other so their runs can be drawn together,
+   triangles without a material come first. The sort is stable so each material keeps
+   the triangle order it had in the file. Call after the materials have been set.
+   This leaves the mesh with only the full detail level */
+void mesh_data::computeRanges(const vector<GLint>& triangle_materials)
+{
+	GLuint triangles = GLuint(indices.size() / 3);
+	GLuint num_materials = GLuint(materials.size());
+
+	// Rank of each material in draw order, slot 0 is for no material
+	vector<GLuint> order(num_materials);
+	for (GLuint m = 0; m < num_materials; m++) order[m] = m;
+	stable_sort(order.begin(), order.end(), [&](GLuint a, GLuint b)
+	{
+		return strcmp(materials[a].diffuse_texname, materials[b].diffuse_texname) < 0;
+	});
+	vector<GLuint> rank(num_materials + 1, 0);
+	for (GLuint i = 0; i < num_materials; i++) rank[order[i] + 1] = i + 1;
+
+	auto material_of = [&](GLuint t)
+	{
+		GLint m = t < triangle_materials.size() ? triangle_materials[t] : -1;
+		return (m >= 0 && GLuint(m) < num_materials) ? m : -1;
+	};
+
+	// Counting sort of the triangles by rank
+	vector<GLuint> start(num_materials + 2, 0);
+	for (GLuint t = 0; t < triangles; t++) start[rank[material_of(t) + 1] + 1]++;
+	for (GLuint r = 1; r < start.size(); r++) start[r] += start[r - 1];
+
+	vector<GLuint> sorted(indices.size());
+	for (GLuint t = 0; t < triangles; t++)
+	{
+		GLuint dst = start[rank[material_of(t) + 1]]++;
+		for (int c = 0; c < 3; c++) sorted[dst * 3 + c] = indices[t * 3 + c];
+	}
+	indices.swap(sorted);
+
+	ranges.clear();
+	GLuint first = 0;
+	for (GLuint r = 0; r <= num_materials; r++)
+	{
+		GLuint end = start[r];
+		if (end == first) continue;
+
+		material_range range = { first * 3, (end - first) * 3, r == 0 ? -1 : GLint(order[r - 1]) };
+		ranges.push_back(range);
+		first = end;
+	}
+
+	mesh_lod lod = { 0, GLuint(indices.size()), 0, GLuint(ranges.size()), 0.f };
+	lods.assign(1, lod);
+}
+
+
+/* Angle weighted vertex normals (Thurmer and Wuthrich): each triangle adds its unit
+   normal to its corners scaled by the angle at the corner, so the result does not
+   depend on how the surface was split into triangles. Vertices with the same slot
+   share one normal, which lets the caller average across texture seams but not
+   across smoothing group edges. The triangles are split over the threads and each
+   one writes only the normals of its own corners, then the slots are split over the
+   threads and each one sums only the corners of its own slots, so no two threads
+   ever add to the same value */
+void mesh_data::computeNormals(const vector<GLuint>& vertex_slots, GLuint num_slots)
+{
+	GLuint nv = numVertices();
+	GLuint corners = GLuint(indices.size());
+	GLuint triangles = corners / 3;
+
+	vector<vec3> corner_normals(corners);
+	parallel_for(triangles, parallel_chunks(triangles), [&](size_t begin, size_t end, unsigned /*chunk*/)
+	{
+		for (size_t t = begin; t < end; t++)
+		{
+			vec3 p[3];
+			for (int k = 0; k < 3; k++)
+			{
+				GLuint v = indices[t * 3 + k];
+				p[k] = vec3(positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2]);
+			}
+			vec3 n = cross(p[1] - p[0], p[2] - p[0]);
+			GLfloat len = length(n);
+			for (int k = 0; k < 3; k++)
+			{
+				vec3 e1 = p[(k + 1) % 3] - p[k], e2 = p[(k + 2) % 3] - p[k];
+				GLfloat l1 = length(e1), l2 = length(e2);
+				if (len <= 0.f || l1 <= 0.f || l2 <= 0.f)
+				{
+					corner_normals[t * 3 + k] = vec3(0.f);
+					continue;
+				}
+				GLfloat angle = acos(clamp(dot(e1, e2) / (l1 * l2), -1.f, 1.f));
+				corner_normals[t * 3 + k] = n * (angle / len);
+			}
+		}
+	});
+
+	// Corners of each slot, counting sorted
+	vector<GLuint> slot_start(num_slots + 1, 0);
+	for (GLuint c = 0; c < corners; c++) slot_start[vertex_slots[indices[c]] + 1]++;
+	for (GLuint s = 0; s < num_slots; s++) slot_start[s + 1] += slot_start[s];
+	vector<GLuint> slot_corners(corners);
+	{
+		vector<GLuint> next(slot_start.begin(), slot_start.end() - 1);
+		for (GLuint c = 0; c < corners; c++) slot_corners[next[vertex_slots[indices[c]]]++] = c;
+	}
+
+	vector<vec3> slot_normals(num_slots);
+	parallel_for(num_slots, parallel_chunks(num_slots), [&](size_t begin, size_t end, unsigned /*chunk*/)
+	{
+		for (size_t s = begin; s < end; s++)
+		{
+			vec3 n(0.f);
+			for (GLuint i = slot_start[s]; i < slot_start[s + 1]; i++) n += corner_normals[slot_corners[i]];
+			GLfloat len = length(n);
+			slot_normals[s] = len > 0.f ? n / len : vec3(0.f, 1.f, 0.f);
+		}
+	});
+
+	normals.resize(nv * 3);
+	parallel_for(nv, parallel_chunks(nv), [&](size_t begin, size_t end, unsigned /*chunk*/)
+	{
+		for (size_t v = begin; v < end; v++)
+		{
+			const vec3& n = slot_normals[vertex_slots[v]];
+			normals[v * 3] = n.x;
+			normals[v * 3 + 1] = n.y;
+			normals[v * 3 + 2] = n.z;
+		}
+	});
+}
+
+
+mesh_view mesh_data::view() const
+{
+	mesh_view v = mesh_view();
+	v.num_vertices = numVertices();
+	v.num_indices = GLuint(indices.size());
+	v.num_ranges = GLuint(ranges.size());
+	v.num_materials = GLuint(materials.size());
+	v.num_lods = GLuint(lods.size());
+	v.num_meshlets = GLuint(meshlets.size());
+	v.positions = positions.empty() ? nullptr : &positions[0];
+	v.normals = normals.empty() ? nullptr : &normals[0];
+	v.texcoords = texcoords.empty() ? nullptr : &texcoords[0];
+	v.colours = colours.empty() ? nullptr : &colours[0];
+	v.indices = indices.empty() ? nullptr : &indices[0];
+	v.ranges = ranges.empty() ? nullptr : &ranges[0];
+	v.materials = materials.empty() ? nullptr : &materials[0];
+	v.lods = lods.empty() ? nullptr : &lods[0];
+	v.meshlets = meshlets.empty() ? nullptr : &meshlets[0];
+	v.bounds = bounds;
+	return v;
+}
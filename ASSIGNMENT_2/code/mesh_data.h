@@ -0,0 +1,132 @@
+/* mesh_data.h
+   CPU side copy of a mesh in its final, ready to upload form: one index per
+   vertex shared by the position, normal, texture coordinate and colour arrays,
+   triangle indices, the bounding box and sphere, the index ranges drawn with each
+   material and the levels of detail, which are further index ranges into the same
+   vertices, and the meshlets that split those ranges into culling clusters.
+   mesh_view points at the same arrays wherever they live, either in a
+   mesh_data or straight into a memory mapped mesh cache file.
+*/
+
+#pragma once
+
+#include "wrapper_glfw.h"
+#include "bounds.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+// A run of indices that use one material
+struct material_range
+{
+	GLuint first;		// First index in the index array
+	GLuint count;		// Number of indices
+	GLint material;		// Index into the materials, -1 for none
+};
+
+// The parts of an OBJ material that the renderer uses. Fixed size so that it can be
+// stored directly in the mesh cache
+struct mesh_material
+{
+	char name[64];
+	GLfloat diffuse[3];
+	char diffuse_texname[128];
+};
+
+// One level of detail: a run of the index array and the material ranges that cover it.
+// Level 0 is the full detail mesh
+struct mesh_lod
+{
+	GLuint first_index;
+	GLuint num_indices;
+	GLuint first_range;
+	GLuint num_ranges;
+	GLfloat error;		// Roughly how far the surface has moved from level 0, in model units
+};
+
+// A cluster of consecutive triangles with its bounds, see meshlet.h. Plain arrays
+// rather than glm types so that it can be stored directly in the mesh cache
+struct meshlet
+{
+	GLuint first_index;			// Into the index array
+	GLuint index_count;
+	GLfloat centre[3];
+	GLfloat radius;
+	GLfloat cone_apex[3];
+	GLfloat cone_cutoff;		// Back facing when the view direction is within this of the axis, above 1 never
+	GLfloat cone_axis[3];
+	GLuint vertex_count;
+};
+
+// What the vertex shader needs to turn quantized vertices (mesh_quantize.h) back
+// into model space
+struct quantize_params
+{
+	glm::vec3 position_offset;
+	glm::vec3 position_scale;
+	glm::vec2 texcoord_offset;
+	glm::vec2 texcoord_scale;
+};
+
+// Interleaved vertex as uploaded by TinyObjLoader
+struct mesh_vertex
+{
+	GLfloat position[3];
+	GLfloat normal[3];
+	GLfloat texcoord[2];
+	GLfloat colour[4];
+};
+
+struct mesh_view
+{
+	GLuint num_vertices;
+	GLuint num_indices;
+	GLuint num_ranges;
+	GLuint num_materials;
+	GLuint num_lods;
+	GLuint num_meshlets;
+
+	const GLfloat* positions;		// 3 per vertex
+	const GLfloat* normals;			// 3 per vertex, nullptr if the mesh has none
+	const GLfloat* texcoords;		// 2 per vertex, nullptr if the mesh has none
+	const GLfloat* colours;			// 4 per vertex
+	const GLuint* indices;
+	const material_range* ranges;
+	const mesh_material* materials;
+	const mesh_lod* lods;
+	const meshlet* meshlets;		// Sorted by first_index, covering every level of detail
+
+	// Set instead of the attribute and index arrays when the mesh comes from a
+	// compressed cache: quantized vertices and indices coded by mesh_codec.h
+	const unsigned char* packed_vertices;
+	size_t packed_vertex_bytes;
+	const unsigned char* packed_indices;
+	size_t packed_index_bytes;
+	quantize_params packed_params;
+	bool packed_normals, packed_texcoords;
+
+	bounding_volume bounds;
+};
+
+class mesh_data
+{
+public:
+	mesh_data();
+
+	void computeBounds();
+	void computeRanges(const std::vector<GLint>& triangle_materials);
+	void computeNormals(const std::vector<GLuint>& vertex_slots, GLuint num_slots);
+	mesh_view view() const;
+	GLuint numVertices() const { return GLuint(positions.size() / 3); }
+
+	std::vector<GLfloat> positions;
+	std::vector<GLfloat> normals;
+	std::vector<GLfloat> texcoords;
+	std::vector<GLfloat> colours;
+	std::vector<GLuint> indices;
+	std::vector<material_range> ranges;
+	std::vector<mesh_material> materials;
+	std::vector<mesh_lod> lods;
+	std::vector<meshlet> meshlets;
+
+	bounding_volume bounds;
+};
@@ -0,0 +1,296 @@
+/* mesh_optimize.cpp
+   Vertex cache, overdraw and vertex fetch ordering, see mesh_optimize.h
+*/
+
+#include "mesh_optimize.h"
+#include "mesh_data.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+using namespace glm;
+
+/* Run the indices through a FIFO post-transform cache of cache_size entries and a
+   16 line cache of the vertex buffer, vertex_size bytes per vertex */
+vertex_cache_stats analyze_vertex_cache(const GLuint* indices, size_t index_count, GLuint vertex_count,
+										GLuint vertex_size, GLuint cache_size)
+{
+	vertex_cache_stats stats = {};
+	stats.triangles = GLuint(index_count / 3);
+
+	// Time each vertex was put in the cache, it is still there if that was less than
+	// cache_size misses ago
+	vector<size_t> cached_at(vertex_count, 0);
+	vector<char> used(vertex_count, 0);
+	size_t time = cache_size + 1;
+
+	const GLuint line_size = 64, num_lines = 16;
+	size_t lines[num_lines];
+	fill(lines, lines + num_lines, size_t(-1));
+	size_t bytes_read = 0;
+
+	for (size_t i = 0; i < index_count; i++)
+	{
+		GLuint v = indices[i];
+		if (!used[v])
+		{
+			used[v] = 1;
+			stats.vertices_used++;
+		}
+		if (time - cached_at[v] <= cache_size) continue;
+
+		cached_at[v] = time++;
+		stats.transformed++;
+
+		// Direct mapped line cache for the fetch of the vertex
+		size_t first = size_t(v) * vertex_size / line_size, last = (size_t(v) * vertex_size + vertex_size - 1) / line_size;
+		for (size_t line = first; line <= last; line++)
+		{
+			if (lines[line % num_lines] == line) continue;
+			lines[line % num_lines] = line;
+			bytes_read += line_size;
+		}
+	}
+
+	stats.acmr = stats.triangles ? GLfloat(stats.transformed) / stats.triangles : 0.f;
+	stats.atvr = stats.vertices_used ? GLfloat(stats.transformed) / stats.vertices_used : 0.f;
+	stats.overfetch = stats.vertices_used ? GLfloat(bytes_read) / (GLfloat(stats.vertices_used) * vertex_size) : 0.f;
+	return stats;
+}
+
+
+void print_vertex_cache_stats(const char* name, const vertex_cache_stats& before, const vertex_cache_stats& after)
+{
+	cout << name << ": " << after.triangles << " triangles, " << after.vertices_used << " vertices, ACMR "
+		<< before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr
+		<< ", overfetch " << before.overfetch << " -> " << after.overfetch << endl;
+}
+
+
+/* Tipsify: fan out from one vertex at a time, emitting all its remaining triangles,
+   then move to the vertex among the ones just used that is most likely to still be
+   in the cache once its own triangles have been emitted. When none qualifies the
+   most recently used vertex that still has triangles is taken from the dead end
+   stack, and only then the next unfinished vertex in index order */
+void optimize_vertex_cache(GLuint* indices, size_t index_count, GLuint vertex_count, GLuint cache_size)
+{
+	GLuint triangles = GLuint(index_count / 3);
+	if (triangles == 0) return;
+
+	// Triangles around each vertex
+	vector<GLuint> live(vertex_count, 0);
+	for (size_t i = 0; i < triangles * 3; i++) live[indices[i]]++;
+	vector<GLuint> start(vertex_count + 1, 0);
+	for (GLuint v = 0; v < vertex_count; v++) start[v + 1] = start[v] + live[v];
+	vector<GLuint> adjacent(triangles * 3);
+	{
+		vector<GLuint> next(start.begin(), start.end() - 1);
+		for (size_t i = 0; i < triangles * 3; i++) adjacent[next[indices[i]]++] = GLuint(i / 3);
+	}
+
+	vector<GLuint> source(indices, indices + triangles * 3);
+	vector<char> emitted(triangles, 0);
+	vector<size_t> cached_at(vertex_count, 0);
+	vector<GLuint> dead_end;
+	vector<GLuint> candidates;
+	dead_end.reserve(triangles * 3);
+
+	size_t time = cache_size + 1;
+	GLuint cursor = 0;
+	size_t out = 0;
+	GLint fan = GLint(source[0]);
+
+	while (fan >= 0)
+	{
+		candidates.clear();
+		for (GLuint j = start[fan]; j < start[fan + 1]; j++)
+		{
+			GLuint t = adjacent[j];
+			if (emitted[t]) continue;
+			emitted[t] = 1;
+
+			for (int k = 0; k < 3; k++)
+			{
+				GLuint v = source[t * 3 + k];
+				indices[out++] = v;
+				dead_end.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - cached_at[v] > cache_size) cached_at[v] = time++;
+			}
+		}
+
+		// Best of the vertices just used: the one that will be oldest in the cache
+		// without falling out of it when its own remaining triangles are emitted
+		GLint best = -1;
+		long best_priority = -1;
+		for (size_t c = 0; c < candidates.size(); c++)
+		{
+			GLuint v = candidates[c];
+			if (live[v] == 0) continue;
+			long priority = 0;
+			if (time - cached_at[v] + 2 * live[v] <= cache_size) priority = long(time - cached_at[v]);
+			if (priority > best_priority)
+			{
+				best_priority = priority;
+				best = GLint(v);
+			}
+		}
+
+		if (best < 0)
+		{
+			while (!dead_end.empty() && best < 0)
+			{
+				GLuint v = dead_end.back();
+				dead_end.pop_back();
+				if (live[v] > 0) best = GLint(v);
+			}
+		}
+		while (best < 0 && cursor < vertex_count)
+		{
+			if (live[cursor] > 0) best = GLint(cursor);
+			cursor++;
+		}
+		fan = best;
+	}
+}
+
+
+/* Split the cache friendly order into clusters and sort the clusters front to back
+   from the outside of the mesh in. A cluster ends where the cache had to start
+   again (a triangle with no cached vertices), or early once its ACMR, counted from
+   an empty cache, is within threshold of the ACMR of the whole list, so starting
+   the next cluster cold costs little.
+   Clusters are sorted by how far their centre lies along their average normal from
+   the centre of the mesh, the view independent measure from the Tipsify paper */
+void optimize_overdraw(GLuint* indices, size_t index_count, const GLfloat* positions, GLuint vertex_count,
+					   GLfloat threshold, GLuint cache_size)
+{
+	GLuint triangles = GLuint(index_count / 3);
+	if (triangles < 2) return;
+
+	vertex_cache_stats whole = analyze_vertex_cache(indices, triangles * 3, vertex_count, 12, cache_size);
+
+	// Each cluster is measured from an empty cache, as it will be drawn after some
+	// other cluster once they are sorted
+	vector<size_t> cached_at(vertex_count, 0);
+	size_t time = cache_size + 1;
+	vector<GLuint> cluster_start;
+	GLuint cluster_triangles = 0, cluster_misses = 0;
+	for (GLuint t = 0; t < triangles; t++)
+	{
+		if (cluster_start.empty() ||
+			(cluster_triangles >= 16 && cluster_misses <= threshold * whole.acmr * cluster_triangles))
+		{
+			cluster_start.push_back(t);
+			cluster_triangles = 0;
+			cluster_misses = 0;
+			time += cache_size + 1;
+		}
+
+		GLuint misses = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			GLuint v = indices[t * 3 + k];
+			if (time - cached_at[v] > cache_size)
+			{
+				cached_at[v] = time++;
+				misses++;
+			}
+		}
+
+		// Nothing was cached, so the order is starting somewhere new anyway
+		if (misses == 3 && cluster_triangles > 0)
+		{
+			cluster_start.push_back(t);
+			cluster_triangles = 0;
+			cluster_misses = 0;
+		}
+		cluster_triangles++;
+		cluster_misses += misses;
+	}
+	GLuint num_clusters = GLuint(cluster_start.size());
+	cluster_start.push_back(triangles);
+	if (num_clusters < 2) return;
+
+	// Area weighted centre and normal of the mesh and of each cluster
+	auto position = [&](GLuint v) { return vec3(positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2]); };
+	vector<vec3> centres(num_clusters), normals(num_clusters);
+	vec3 mesh_centre(0.f);
+	GLfloat mesh_area = 0.f;
+	for (GLuint c = 0; c < num_clusters; c++)
+	{
+		vec3 centre(0.f), normal(0.f);
+		GLfloat area = 0.f;
+		for (GLuint t = cluster_start[c]; t < cluster_start[c + 1]; t++)
+		{
+			vec3 a = position(indices[t * 3]), b = position(indices[t * 3 + 1]), d = position(indices[t * 3 + 2]);
+			vec3 n = cross(b - a, d - a);
+			GLfloat twice_area = length(n);
+			centre += (a + b + d) * (twice_area / 3.f);
+			normal += n;
+			area += twice_area;
+		}
+		mesh_centre += centre;
+		mesh_area += area;
+		centres[c] = area > 0.f ? centre / area : position(indices[cluster_start[c] * 3]);
+		GLfloat len = length(normal);
+		normals[c] = len > 0.f ? normal / len : vec3(0.f);
+	}
+	if (mesh_area > 0.f) mesh_centre = mesh_centre / mesh_area;
+
+	vector<GLfloat> sort_key(num_clusters);
+	vector<GLuint> order(num_clusters);
+	for (GLuint c = 0; c < num_clusters; c++)
+	{
+		sort_key[c] = dot(centres[c] - mesh_centre, normals[c]);
+		order[c] = c;
+	}
+	stable_sort(order.begin(), order.end(), [&](GLuint a, GLuint b) { return sort_key[a] > sort_key[b]; });
+
+	vector<GLuint> source(indices, indices + triangles * 3);
+	size_t out = 0;
+	for (GLuint i = 0; i < num_clusters; i++)
+	{
+		GLuint c = order[i];
+		for (GLuint j = cluster_start[c] * 3; j < cluster_start[c + 1] * 3; j++) indices[out++] = source[j];
+	}
+}
+
+
+GLuint optimize_vertex_fetch(GLuint* indices, size_t index_count, GLuint vertex_count, vector<GLuint>& remap)
+{
+	remap.assign(vertex_count, GLuint(-1));
+	GLuint next = 0;
+	for (size_t i = 0; i < index_count; i++)
+	{
+		GLuint& v = indices[i];
+		if (remap[v] == GLuint(-1)) remap[v] = next++;
+		v = remap[v];
+	}
+	return next;
+}
+
+
+void optimize_mesh(mesh_data& mesh, bool overdraw)
+{
+	GLuint nv = mesh.numVertices();
+	if (nv == 0 || mesh.indices.empty()) return;
+
+	for (size_t r = 0; r < mesh.ranges.size(); r++)
+	{
+		const material_range& range = mesh.ranges[r];
+		GLuint* indices = &mesh.indices[range.first];
+		optimize_vertex_cache(indices, range.count, nv);
+		if (overdraw) optimize_overdraw(indices, range.count, &mesh.positions[0], nv);
+	}
+
+	// The full detail level comes first in the index array so it sets the vertex order
+	vector<GLuint> remap;
+	GLuint used = optimize_vertex_fetch(&mesh.indices[0], mesh.indices.size(), nv, remap);
+	remap_vertices(mesh.positions, 3, remap, used);
+	remap_vertices(mesh.normals, 3, remap, used);
+	remap_vertices(mesh.texcoords, 2, remap, used);
+	remap_vertices(mesh.colours, 4, remap, used);
+}
@@ -0,0 +1,61 @@
+/* mesh_optimize.h
+   Reordering of indexed triangle lists for the GPU.
+   optimize_vertex_cache reorders the triangles so that vertices are reused while
+   they are still in the post-transform cache (Tipsify, Sander et al. 2007).
+   optimize_overdraw then splits that order into clusters and sorts the clusters so
+   the ones facing outwards are drawn first, which lets the depth test reject more
+   of what is behind them. optimize_vertex_fetch renumbers the vertices in the order
+   they are first used so that the vertex fetches walk through memory.
+   analyze_vertex_cache measures the result: ACMR (vertices transformed per triangle)
+   and ATVR (vertices transformed per vertex) with a FIFO cache, and the overfetch
+   of vertex data through a small cache of 64 byte lines.
+*/
+
+#pragma once
+
+#include "wrapper_glfw.h"
+#include <vector>
+
+class mesh_data;
+
+const GLuint VERTEX_CACHE_SIZE = 16;
+
+struct vertex_cache_stats
+{
+	GLuint triangles;
+	GLuint vertices_used;
+	GLuint transformed;		// Cache misses
+	GLfloat acmr;			// transformed / triangles, 0.5 is the best possible for a large regular grid, 3 the worst
+	GLfloat atvr;			// transformed / vertices_used, 1 is the best possible
+	GLfloat overfetch;		// Vertex bytes read / bytes in the vertices used, 1 is the best possible
+};
+
+vertex_cache_stats analyze_vertex_cache(const GLuint* indices, size_t index_count, GLuint vertex_count,
+										GLuint vertex_size, GLuint cache_size = VERTEX_CACHE_SIZE);
+void print_vertex_cache_stats(const char* name, const vertex_cache_stats& before, const vertex_cache_stats& after);
+
+void optimize_vertex_cache(GLuint* indices, size_t index_count, GLuint vertex_count, GLuint cache_size = VERTEX_CACHE_SIZE);
+void optimize_overdraw(GLuint* indices, size_t index_count, const GLfloat* positions, GLuint vertex_count,
+					   GLfloat threshold = 1.05f, GLuint cache_size = VERTEX_CACHE_SIZE);
+
+/* Renumber the vertices in the order the indices first use them. remap[old] is the new
+   number, or GLuint(-1) for vertices that are not used. Returns the number of vertices used */
+GLuint optimize_vertex_fetch(GLuint* indices, size_t index_count, GLuint vertex_count, std::vector<GLuint>& remap);
+
+/* Move the elements of an array of components values per vertex to their new places */
+template <typename T>
+void remap_vertices(std::vector<T>& data, GLuint components, const std::vector<GLuint>& remap, GLuint new_count)
+{
+	if (data.empty()) return;
+	std::vector<T> moved(size_t(new_count) * components);
+	for (size_t v = 0; v < remap.size(); v++)
+	{
+		if (remap[v] == GLuint(-1)) continue;
+		for (GLuint c = 0; c < components; c++) moved[size_t(remap[v]) * components + c] = data[v * components + c];
+	}
+	data.swap(moved);
+}
+
+/* Run all three passes on a mesh_data. The triangles are only reordered inside each
+   material range of each level of detail, so the ranges stay valid */
+void optimize_mesh(mesh_data& mesh, bool overdraw = true);
@@ -0,0 +1,133 @@
+/* mesh_quantize.cpp
+   Vertex attribute packing, see mesh_quantize.h
+*/
+
+#include "mesh_quantize.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace glm;
+
+static GLushort unorm16(GLfloat v)
+{
+	return GLushort(floor(clamp(v, 0.f, 1.f) * 65535.f + 0.5f));
+}
+
+static GLshort snorm16(GLfloat v)
+{
+	return GLshort(floor(clamp(v, -1.f, 1.f) * 32767.f + 0.5f));
+}
+
+static GLubyte unorm8(GLfloat v)
+{
+	return GLubyte(floor(clamp(v, 0.f, 1.f) * 255.f + 0.5f));
+}
+
+/* Project the unit sphere onto the octahedron |x| + |y| + |z| = 1 and unfold the
+   lower half over the corners of the square */
+vec2 octahedral_encode(vec3 n)
+{
+	GLfloat sum = fabs(n.x) + fabs(n.y) + fabs(n.z);
+	if (sum == 0.f) return vec2(0.f, 0.f);
+	n = n / sum;
+	if (n.z >= 0.f) return vec2(n.x, n.y);
+	return vec2((1.f - fabs(n.y)) * (n.x >= 0.f ? 1.f : -1.f), (1.f - fabs(n.x)) * (n.y >= 0.f ? 1.f : -1.f));
+}
+
+vec3 octahedral_decode(vec2 e)
+{
+	vec3 n(e.x, e.y, 1.f - fabs(e.x) - fabs(e.y));
+	GLfloat t = max(-n.z, 0.f);
+	n.x += n.x >= 0.f ? -t : t;
+	n.y += n.y >= 0.f ? -t : t;
+	return normalize(n);
+}
+
+
+quantize_params quantize_vertices(const mesh_view& mesh, vector<quantized_vertex>& out)
+{
+	quantize_params params;
+	params.position_offset = mesh.bounds.box_min;
+	params.position_scale = mesh.bounds.box_max - mesh.bounds.box_min;
+	params.texcoord_offset = vec2(0.f);
+	params.texcoord_scale = vec2(1.f);
+
+	// Texture coordinates often wrap outside 0 to 1 so they get their own range
+	if (mesh.texcoords && mesh.num_vertices)
+	{
+		vec2 lo(mesh.texcoords[0], mesh.texcoords[1]), hi = lo;
+		for (GLuint i = 1; i < mesh.num_vertices; i++)
+		{
+			vec2 t(mesh.texcoords[i * 2], mesh.texcoords[i * 2 + 1]);
+			lo = min(lo, t);
+			hi = max(hi, t);
+		}
+		params.texcoord_offset = lo;
+		params.texcoord_scale = hi - lo;
+	}
+
+	// A flat mesh has no extent on one axis, anything divided by it stays at the offset
+	vec3 inverse_position(0.f);
+	for (int c = 0; c < 3; c++) if (params.position_scale[c] > 0.f) inverse_position[c] = 1.f / params.position_scale[c];
+	vec2 inverse_texcoord(0.f);
+	for (int c = 0; c < 2; c++) if (params.texcoord_scale[c] > 0.f) inverse_texcoord[c] = 1.f / params.texcoord_scale[c];
+
+	out.resize(mesh.num_vertices);
+	for (GLuint i = 0; i < mesh.num_vertices; i++)
+	{
+		quantized_vertex& v = out[i];
+		for (int c = 0; c < 3; c++) v.position[c] = unorm16((mesh.positions[i * 3 + c] - params.position_offset[c]) * inverse_position[c]);
+		v.position[3] = 0;
+
+		vec2 e(0.f);
+		if (mesh.normals) e = octahedral_encode(vec3(mesh.normals[i * 3], mesh.normals[i * 3 + 1], mesh.normals[i * 3 + 2]));
+		v.normal[0] = snorm16(e.x);
+		v.normal[1] = snorm16(e.y);
+
+		for (int c = 0; c < 2; c++)
+		{
+			v.texcoord[c] = mesh.texcoords ? unorm16((mesh.texcoords[i * 2 + c] - params.texcoord_offset[c]) * inverse_texcoord[c]) : 0;
+		}
+		for (int c = 0; c < 4; c++) v.colour[c] = unorm8(mesh.colours[i * 4 + c]);
+	}
+	return params;
+}
+
+
+/* Decode the packed vertices the way OpenGL and the vertex shader do and compare */
+quantize_error measure_quantize_error(const mesh_view& mesh, const vector<quantized_vertex>& packed, const quantize_params& params)
+{
+	quantize_error error = { 0.f, 0.f, 0.f, 0.f };
+	GLfloat min_cos = 1.f;
+	for (GLuint i = 0; i < mesh.num_vertices && i < packed.size(); i++)
+	{
+		const quantized_vertex& v = packed[i];
+		for (int c = 0; c < 3; c++)
+		{
+			GLfloat decoded = params.position_offset[c] + params.position_scale[c] * (v.position[c] / 65535.f);
+			error.position = max(error.position, fabs(decoded - mesh.positions[i * 3 + c]));
+		}
+		if (mesh.normals)
+		{
+			vec3 n(mesh.normals[i * 3], mesh.normals[i * 3 + 1], mesh.normals[i * 3 + 2]);
+			GLfloat len = length(n);
+			if (len > 0.f)
+			{
+				vec3 decoded = octahedral_decode(vec2(max(v.normal[0] / 32767.f, -1.f), max(v.normal[1] / 32767.f, -1.f)));
+				min_cos = min(min_cos, dot(decoded, n / len));
+			}
+		}
+		if (mesh.texcoords)
+		{
+			for (int c = 0; c < 2; c++)
+			{
+				GLfloat decoded = params.texcoord_offset[c] + params.texcoord_scale[c] * (v.texcoord[c] / 65535.f);
+				error.texcoord = max(error.texcoord, fabs(decoded - mesh.texcoords[i * 2 + c]));
+			}
+		}
+		for (int c = 0; c < 4; c++) error.colour = max(error.colour, fabs(v.colour[c] / 255.f - clamp(mesh.colours[i * 4 + c], 0.f, 1.f)));
+	}
+	error.normal_degrees = degrees(acos(clamp(min_cos, -1.f, 1.f)));
+	return error;
+}
@@ -0,0 +1,40 @@
+/* mesh_quantize.h
+   Packs the float vertex attributes of a mesh into 20 bytes per vertex instead of
+   the 48 of mesh_vertex. Positions are 16 bit fractions of the mesh bounds, normals
+   are two 16 bit values of an octahedral map, texture coordinates are 16 bit
+   fractions of their own range and colours are RGBA8. All of them are read as
+   normalised integers, so the vertex shader only has to scale the position and
+   texture coordinate back up (quantize_params) and unfold the normal.
+   octahedral_encode() and octahedral_decode() are the CPU versions of the mapping
+   used to measure the error, the shader has its own copy of octahedral_decode.
+*/
+
+#pragma once
+
+#include "wrapper_glfw.h"
+#include "mesh_data.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+struct quantized_vertex
+{
+	GLushort position[4];		// Unsigned normalised fraction of the bounds, the fourth is padding
+	GLshort normal[2];			// Signed normalised octahedral map
+	GLushort texcoord[2];		// Unsigned normalised fraction of the texture coordinate range
+	GLubyte colour[4];
+};
+
+// Largest differences between the original and the decoded attributes
+struct quantize_error
+{
+	GLfloat position;			// Model units
+	GLfloat normal_degrees;
+	GLfloat texcoord;
+	GLfloat colour;
+};
+
+quantize_params quantize_vertices(const mesh_view& mesh, std::vector<quantized_vertex>& out);
+quantize_error measure_quantize_error(const mesh_view& mesh, const std::vector<quantized_vertex>& packed, const quantize_params& params);
+
+glm::vec2 octahedral_encode(glm::vec3 n);
+glm::vec3 octahedral_decode(glm::vec2 e);
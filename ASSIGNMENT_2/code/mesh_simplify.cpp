@@ -0,0 +1,374 @@
+/* mesh_simplify.cpp
+   Quadric error metric level of detail chain, see mesh_simplify.h
+   The collapses are done in passes. Each pass finds the cheapest collapse for every
+   edge, sorts them and then takes them in order, skipping any that touch the area
+   around a collapse already made in the pass so the checks stay valid. The index
+   array is rewritten after each pass and degenerate triangles are dropped.
+*/
+
+#include "mesh_simplify.h"
+#include <algorithm>
+#include <unordered_map>
+#include <cstring>
+#include <cmath>
+
+using namespace std;
+using namespace glm;
+
+lod_settings default_lod_settings()
+{
+	lod_settings s;
+	s.max_lods = 5;
+	s.ratio = 0.5f;
+	s.min_triangles = 64;
+	s.max_error = 0.05f;
+	return s;
+}
+
+
+/* Symmetric 4x4 matrix of the sum of squared distances to a set of planes, stored as
+   the upper triangle, and the total weight of the planes */
+struct quadric
+{
+	double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+	double w;
+
+	void clear() { memset(this, 0, sizeof(*this)); }
+
+	// Plane n.p + d = 0 with unit normal n
+	void addPlane(double nx, double ny, double nz, double d, double weight)
+	{
+		a00 += weight * nx * nx; a01 += weight * nx * ny; a02 += weight * nx * nz; a03 += weight * nx * d;
+		a11 += weight * ny * ny; a12 += weight * ny * nz; a13 += weight * ny * d;
+		a22 += weight * nz * nz; a23 += weight * nz * d;
+		a33 += weight * d * d;
+		w += weight;
+	}
+
+	void add(const quadric& q)
+	{
+		a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+		a11 += q.a11; a12 += q.a12; a13 += q.a13;
+		a22 += q.a22; a23 += q.a23;
+		a33 += q.a33;
+		w += q.w;
+	}
+
+	// Weighted sum of the squared distances from p to the planes
+	double error(const vec3& p) const
+	{
+		double x = p.x, y = p.y, z = p.z;
+		double e = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x
+				 + a11 * y * y + 2 * a12 * y * z + 2 * a13 * y
+				 + a22 * z * z + 2 * a23 * z
+				 + a33;
+		return e > 0 ? e : 0;
+	}
+};
+
+struct collapse
+{
+	GLuint from, to;		// Position groups
+	double cost;			// Mean squared distance to the planes of both groups
+};
+
+
+static vec3 triangle_normal(const vec3& a, const vec3& b, const vec3& c)
+{
+	return cross(b - a, c - a);
+}
+
+
+/* Material ranges of a triangle list that is still sorted by material */
+static void append_ranges(const vector<GLint>& triangle_materials, GLuint first_index, vector<material_range>& ranges)
+{
+	for (GLuint t = 0; t < triangle_materials.size(); t++)
+	{
+		GLint m = triangle_materials[t];
+		if (t == 0 || ranges.back().material != m)
+		{
+			material_range r = { first_index + t * 3, 0, m };
+			ranges.push_back(r);
+		}
+		ranges.back().count += 3;
+	}
+}
+
+
+GLuint build_lod_chain(mesh_data& mesh, const lod_settings& settings)
+{
+	GLuint nv = mesh.numVertices();
+
+	// Start again from the full detail level
+	GLuint lod0_indices = mesh.lods.empty() ? GLuint(mesh.indices.size()) : mesh.lods[0].num_indices;
+	GLuint lod0_ranges = mesh.lods.empty() ? GLuint(mesh.ranges.size()) : mesh.lods[0].num_ranges;
+	mesh.indices.resize(lod0_indices);
+	mesh.ranges.resize(lod0_ranges);
+	mesh.lods.clear();
+	mesh_lod full = { 0, lod0_indices, 0, lod0_ranges, 0.f };
+	mesh.lods.push_back(full);
+
+	if (nv == 0 || lod0_indices < settings.min_triangles * 3) return 1;
+
+	// Vertices with exactly the same position are one group and always move together
+	struct position_hash
+	{
+		size_t operator()(const vec3& p) const
+		{
+			uint32_t b[3];
+			memcpy(b, &p, sizeof(b));
+			return size_t(b[0] * 73856093u ^ b[1] * 19349663u ^ b[2] * 83492791u);
+		}
+	};
+	struct position_equal
+	{
+		bool operator()(const vec3& a, const vec3& b) const { return a.x == b.x && a.y == b.y && a.z == b.z; }
+	};
+	unordered_map<vec3, GLuint, position_hash, position_equal> group_of_position;
+	vector<GLuint> group(nv);
+	vector<vec3> group_position;
+	for (GLuint v = 0; v < nv; v++)
+	{
+		vec3 p(mesh.positions[v * 3], mesh.positions[v * 3 + 1], mesh.positions[v * 3 + 2]);
+		auto it = group_of_position.find(p);
+		if (it == group_of_position.end())
+		{
+			it = group_of_position.emplace(p, GLuint(group_position.size())).first;
+			group_position.push_back(p);
+		}
+		group[v] = it->second;
+	}
+	GLuint ng = GLuint(group_position.size());
+
+	// Triangles of the current level, in vertex indices, and their materials
+	vector<GLuint> tris(mesh.indices.begin(), mesh.indices.end());
+	vector<GLint> tri_materials(lod0_indices / 3, -1);
+	for (GLuint r = 0; r < lod0_ranges; r++)
+	{
+		const material_range& range = mesh.ranges[r];
+		fill(tri_materials.begin() + range.first / 3, tri_materials.begin() + (range.first + range.count) / 3, range.material);
+	}
+
+	// Plane of every triangle, weighted by its area
+	vector<quadric> quadrics(ng);
+	for (GLuint g = 0; g < ng; g++) quadrics[g].clear();
+	GLuint ntris = GLuint(tris.size() / 3);
+	for (GLuint t = 0; t < ntris; t++)
+	{
+		const vec3& a = group_position[group[tris[t * 3]]];
+		const vec3& b = group_position[group[tris[t * 3 + 1]]];
+		const vec3& c = group_position[group[tris[t * 3 + 2]]];
+		vec3 n = triangle_normal(a, b, c);
+		float len = length(n);
+		if (len <= 0.f) continue;
+		n = n / len;
+		double d = -double(dot(n, a));
+		for (int k = 0; k < 3; k++) quadrics[group[tris[t * 3 + k]]].addPlane(n.x, n.y, n.z, d, len * 0.5);
+	}
+
+	// Open edges (used by one triangle) get a plane through the edge at right angles
+	// to the triangle, so moving the outline costs as much as moving the surface
+	{
+		unordered_map<uint64_t, GLuint> edge_count;
+		edge_count.reserve(ntris * 3);
+		for (GLuint t = 0; t < ntris; t++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				GLuint ga = group[tris[t * 3 + k]], gb = group[tris[t * 3 + (k + 1) % 3]];
+				uint64_t key = (uint64_t(min(ga, gb)) << 32) | max(ga, gb);
+				edge_count[key]++;
+			}
+		}
+		for (GLuint t = 0; t < ntris; t++)
+		{
+			const vec3& a = group_position[group[tris[t * 3]]];
+			const vec3& b = group_position[group[tris[t * 3 + 1]]];
+			const vec3& c = group_position[group[tris[t * 3 + 2]]];
+			vec3 n = triangle_normal(a, b, c);
+			if (length(n) <= 0.f) continue;
+			for (int k = 0; k < 3; k++)
+			{
+				GLuint ga = group[tris[t * 3 + k]], gb = group[tris[t * 3 + (k + 1) % 3]];
+				uint64_t key = (uint64_t(min(ga, gb)) << 32) | max(ga, gb);
+				if (edge_count[key] != 1) continue;
+
+				vec3 edge = group_position[gb] - group_position[ga];
+				float edge_length = length(edge);
+				vec3 side = cross(edge, n);
+				float side_length = length(side);
+				if (edge_length <= 0.f || side_length <= 0.f) continue;
+				side = side / side_length;
+				double d = -double(dot(side, group_position[ga]));
+				double weight = 10.0 * edge_length * edge_length;
+				quadrics[ga].addPlane(side.x, side.y, side.z, d, weight);
+				quadrics[gb].addPlane(side.x, side.y, side.z, d, weight);
+			}
+		}
+	}
+
+	vec3 diagonal = mesh.bounds.box_max - mesh.bounds.box_min;
+	double max_cost = double(settings.max_error) * length(diagonal);
+	max_cost *= max_cost;
+	double lod_cost = 0;
+
+	vector<GLuint> remap(nv);				// Vertex each vertex moves to in this pass
+	vector<GLuint> tri_start(ng + 1);		// Triangles around each group, counting sorted
+	vector<GLuint> group_tris;
+	vector<char> touched(ng);
+	vector<collapse> collapses;
+	vector<pair<GLuint, GLuint>> moves;
+
+	for (GLuint level = 1; level < settings.max_lods; level++)
+	{
+		GLuint start_triangles = GLuint(tris.size() / 3);
+		GLuint target = max(settings.min_triangles, GLuint(start_triangles * settings.ratio));
+		if (start_triangles <= target) break;
+
+		while (tris.size() / 3 > target)
+		{
+			ntris = GLuint(tris.size() / 3);
+
+			// Triangles around each group
+			fill(tri_start.begin(), tri_start.end(), 0);
+			for (GLuint i = 0; i < ntris * 3; i++) tri_start[group[tris[i]] + 1]++;
+			for (GLuint g = 0; g < ng; g++) tri_start[g + 1] += tri_start[g];
+			group_tris.resize(ntris * 3);
+			{
+				vector<GLuint> fillpos(tri_start.begin(), tri_start.end() - 1);
+				for (GLuint i = 0; i < ntris * 3; i++) group_tris[fillpos[group[tris[i]]]++] = i / 3;
+			}
+
+			// Cheapest direction for each edge, edges shared by two triangles appear twice
+			// but the duplicates are skipped by the touched flags
+			collapses.clear();
+			for (GLuint t = 0; t < ntris; t++)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					GLuint ga = group[tris[t * 3 + k]], gb = group[tris[t * 3 + (k + 1) % 3]];
+					if (ga > gb) continue;
+					quadric q = quadrics[ga];
+					q.add(quadrics[gb]);
+					double w = q.w > 0 ? q.w : 1.0;
+					double to_b = q.error(group_position[gb]) / w;
+					double to_a = q.error(group_position[ga]) / w;
+					collapse c = { ga, gb, to_b };
+					if (to_a < to_b)
+					{
+						c.from = gb;
+						c.to = ga;
+						c.cost = to_a;
+					}
+					if (c.cost <= max_cost) collapses.push_back(c);
+				}
+			}
+			if (collapses.empty()) break;
+			sort(collapses.begin(), collapses.end(), [](const collapse& a, const collapse& b) { return a.cost < b.cost; });
+
+			fill(touched.begin(), touched.end(), 0);
+			for (GLuint v = 0; v < nv; v++) remap[v] = v;
+			GLuint removed = 0;
+			GLuint made = 0;
+			GLuint wanted = ntris - target;
+
+			for (size_t i = 0; i < collapses.size() && removed < wanted; i++)
+			{
+				const collapse& c = collapses[i];
+				if (touched[c.from] || touched[c.to]) continue;
+
+				// Every vertex of the from group needs a vertex of the to group on one of
+				// its triangles to take its attributes from, otherwise the collapse would
+				// tear a seam. Triangles that don't contain both groups must not flip
+				moves.clear();
+				bool ok = true;
+				GLuint shared = 0;
+				for (GLuint j = tri_start[c.from]; j < tri_start[c.from + 1] && ok; j++)
+				{
+					GLuint t = group_tris[j];
+					int from_corner = -1, to_corner = -1;
+					for (int k = 0; k < 3; k++)
+					{
+						GLuint g = group[tris[t * 3 + k]];
+						if (g == c.from) from_corner = k;
+						if (g == c.to) to_corner = k;
+					}
+					if (to_corner >= 0)
+					{
+						shared++;
+						moves.push_back(make_pair(tris[t * 3 + from_corner], tris[t * 3 + to_corner]));
+						continue;
+					}
+
+					vec3 p[3];
+					for (int k = 0; k < 3; k++) p[k] = group_position[group[tris[t * 3 + k]]];
+					vec3 before = triangle_normal(p[0], p[1], p[2]);
+					p[from_corner] = group_position[c.to];
+					vec3 after = triangle_normal(p[0], p[1], p[2]);
+					if (dot(before, after) <= 0.f) ok = false;
+				}
+				if (!ok || shared == 0) continue;
+
+				for (GLuint j = tri_start[c.from]; j < tri_start[c.from + 1] && ok; j++)
+				{
+					GLuint t = group_tris[j];
+					for (int k = 0; k < 3; k++)
+					{
+						GLuint v = tris[t * 3 + k];
+						if (group[v] != c.from) continue;
+						bool found = false;
+						for (size_t m = 0; m < moves.size() && !found; m++) found = moves[m].first == v;
+						if (!found) ok = false;
+					}
+				}
+				if (!ok) continue;
+
+				// Nothing around this collapse can change again in this pass
+				for (GLuint j = tri_start[c.from]; j < tri_start[c.from + 1]; j++)
+				{
+					GLuint t = group_tris[j];
+					for (int k = 0; k < 3; k++) touched[group[tris[t * 3 + k]]] = 1;
+				}
+				touched[c.to] = 1;
+
+				for (size_t m = 0; m < moves.size(); m++) remap[moves[m].first] = moves[m].second;
+				quadrics[c.to].add(quadrics[c.from]);
+				lod_cost = max(lod_cost, c.cost);
+				removed += shared;
+				made++;
+			}
+			if (made == 0) break;
+
+			// Move the corners and drop the triangles that have lost an edge, keeping the order
+			GLuint out = 0;
+			for (GLuint t = 0; t < ntris; t++)
+			{
+				GLuint a = remap[tris[t * 3]], b = remap[tris[t * 3 + 1]], c = remap[tris[t * 3 + 2]];
+				if (group[a] == group[b] || group[b] == group[c] || group[a] == group[c]) continue;
+				tris[out * 3] = a;
+				tris[out * 3 + 1] = b;
+				tris[out * 3 + 2] = c;
+				tri_materials[out] = tri_materials[t];
+				out++;
+			}
+			tris.resize(out * 3);
+			tri_materials.resize(out);
+		}
+
+		// Not worth a level of its own
+		GLuint level_triangles = GLuint(tris.size() / 3);
+		if (level_triangles > start_triangles * 0.9f || level_triangles == 0) break;
+
+		mesh_lod lod;
+		lod.first_index = GLuint(mesh.indices.size());
+		lod.num_indices = GLuint(tris.size());
+		lod.first_range = GLuint(mesh.ranges.size());
+		lod.error = GLfloat(sqrt(lod_cost));
+		mesh.indices.insert(mesh.indices.end(), tris.begin(), tris.end());
+		append_ranges(tri_materials, lod.first_index, mesh.ranges);
+		lod.num_ranges = GLuint(mesh.ranges.size()) - lod.first_range;
+		mesh.lods.push_back(lod);
+	}
+
+	return GLuint(mesh.lods.size());
+}
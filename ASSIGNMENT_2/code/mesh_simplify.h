@@ -0,0 +1,29 @@
+/* mesh_simplify.h
+   Level of detail chain for a mesh_data using quadric error metric simplification
+   (Garland and Heckbert). Every level is an index array into the same vertex
+   arrays as the full detail mesh: edges are collapsed onto one of their existing
+   end points, so no vertices are added and the levels only cost index memory.
+   Vertices at the same position (UV seams, hard edges) move together and the open
+   edges of the mesh get extra planes in their quadrics so the outline is kept.
+   Triangle order is kept through the collapses, so each level is still sorted
+   by material and gets its own material ranges.
+*/
+
+#pragma once
+
+#include "mesh_data.h"
+
+struct lod_settings
+{
+	GLuint max_lods;			// Including the full detail mesh
+	GLfloat ratio;				// Triangles in each level compared with the one before
+	GLuint min_triangles;		// Stop when a level would be smaller than this
+	GLfloat max_error;			// Largest allowed error in model units, as a fraction of the bounds diagonal
+};
+
+lod_settings default_lod_settings();
+
+/* Replace the lods of the mesh with a new chain. The mesh must have its ranges and
+   bounds computed. The indices and ranges of the extra levels are appended after
+   the full detail ones. Returns the number of levels, including the full detail mesh */
+GLuint build_lod_chain(mesh_data& mesh, const lod_settings& settings = default_lod_settings());
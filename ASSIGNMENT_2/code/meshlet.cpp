@@ -0,0 +1,209 @@
+/* meshlet.cpp
+   Meshlet building and cluster culling, see meshlet.h
+*/
+
+#include "meshlet.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+using namespace glm;
+
+/* Bounding sphere and normal cone of the triangles of a meshlet. The cone follows meshoptimizer's cluster bounds: the axis is the average
+   triangle normal, the apex is moved back along the axis until every triangle plane
+   is in front of it, and a camera inside the cone (seen from the apex) sees only
+   back faces. Clusters with normals spread over more than about 85 degrees from the
+   axis are never cone culled */
+static void meshlet_bounds(meshlet& m, const GLuint* indices, const GLfloat* positions)
+{
+	auto position = [&](GLuint v) { return vec3(positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2]); };
+
+	vec3 lo = position(indices[m.first_index]), hi = lo;
+	for (GLuint i = m.first_index; i < m.first_index + m.index_count; i++)
+	{
+		vec3 p = position(indices[i]);
+		lo = min(lo, p);
+		hi = max(hi, p);
+	}
+	vec3 centre = (lo + hi) * 0.5f;
+	GLfloat radius = 0.f;
+	for (GLuint i = m.first_index; i < m.first_index + m.index_count; i++) radius = max(radius, length(position(indices[i]) - centre));
+
+	vec3 sum(0.f);
+	GLuint triangles = m.index_count / 3;
+	vector<vec3> normals(triangles);
+	for (GLuint t = 0; t < triangles; t++)
+	{
+		const GLuint* tri = indices + m.first_index + t * 3;
+		vec3 n = cross(position(tri[1]) - position(tri[0]), position(tri[2]) - position(tri[0]));
+		GLfloat len = length(n);
+		normals[t] = len > 0.f ? n / len : vec3(0.f);
+		sum += normals[t];
+	}
+
+	GLfloat sum_length = length(sum);
+	vec3 axis = sum_length > 0.f ? sum / sum_length : vec3(0.f, 0.f, 1.f);
+	GLfloat min_dot = 1.f;
+	for (GLuint t = 0; t < triangles; t++)
+	{
+		if (normals[t] == vec3(0.f)) continue;
+		min_dot = min(min_dot, dot(axis, normals[t]));
+	}
+
+	GLfloat cutoff = 2.f;
+	vec3 apex = centre;
+	if (sum_length > 0.f && min_dot > 0.1f)
+	{
+		GLfloat max_t = 0.f;
+		for (GLuint t = 0; t < triangles; t++)
+		{
+			if (normals[t] == vec3(0.f)) continue;
+			vec3 p0 = position(indices[m.first_index + t * 3]);
+			GLfloat dc = dot(centre - p0, normals[t]);
+			GLfloat dn = dot(axis, normals[t]);
+			max_t = max(max_t, dc / dn);
+		}
+		apex = centre - axis * max_t;
+		cutoff = sqrt(1.f - min_dot * min_dot);
+	}
+
+	for (int c = 0; c < 3; c++)
+	{
+		m.centre[c] = centre[c];
+		m.cone_apex[c] = apex[c];
+		m.cone_axis[c] = axis[c];
+	}
+	m.radius = radius;
+	m.cone_cutoff = cutoff;
+}
+
+
+void build_meshlets(const GLuint* indices, const material_range* ranges, GLuint num_ranges,
+					const GLfloat* positions, GLuint vertex_count, vector<meshlet>& out,
+					GLuint max_vertices, GLuint max_triangles)
+{
+	// Meshlet each vertex was last counted in, to count the distinct vertices
+	vector<GLuint> seen_in(vertex_count, GLuint(-1));
+	GLuint id = GLuint(out.size());
+	size_t first_meshlet = out.size();
+
+	for (GLuint r = 0; r < num_ranges; r++)
+	{
+		GLuint first = ranges[r].first, end = ranges[r].first + ranges[r].count;
+		GLuint t = first;
+		while (t < end)
+		{
+			meshlet m;
+			m.first_index = t;
+			m.index_count = 0;
+			m.vertex_count = 0;
+			while (t < end && m.index_count / 3 < max_triangles)
+			{
+				GLuint added = 0;
+				for (int k = 0; k < 3; k++)
+				{
+					GLuint v = indices[t + k];
+					if (seen_in[v] != id && (k == 0 || (v != indices[t] && (k == 1 || v != indices[t + 1])))) added++;
+				}
+				if (m.vertex_count + added > max_vertices) break;
+
+				for (int k = 0; k < 3; k++) seen_in[indices[t + k]] = id;
+				m.vertex_count += added;
+				m.index_count += 3;
+				t += 3;
+			}
+			meshlet_bounds(m, indices, positions);
+			out.push_back(m);
+			id++;
+		}
+	}
+
+	// find_meshlet() searches by first index, whatever order the ranges were in
+	sort(out.begin() + first_meshlet, out.end(), [](const meshlet& a, const meshlet& b) { return a.first_index < b.first_index; });
+}
+
+
+void cluster_view::set(const mat4& modelview, const mat4& projection)
+{
+	// Gribb and Hartmann: the planes are sums of the rows of the combined matrix, and
+	// with the model matrix included they come out in model space
+	mat4 m = projection * modelview;
+	vec4 rows[4];
+	for (int i = 0; i < 4; i++) rows[i] = vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+	for (int i = 0; i < 3; i++)
+	{
+		planes[i * 2] = rows[3] + rows[i];
+		planes[i * 2 + 1] = rows[3] - rows[i];
+	}
+	for (int i = 0; i < 6; i++)
+	{
+		GLfloat len = length(vec3(planes[i]));
+		if (len > 0.f) planes[i] = planes[i] * (1.f / len);
+	}
+	camera = vec3(inverse(modelview)[3]);
+}
+
+
+void cull_meshlets(const meshlet* meshlets, GLuint count, const cluster_view& view,
+				   vector<GLsizei>& counts, vector<const void*>& offsets, cluster_cull_stats& stats)
+{
+	for (GLuint i = 0; i < count; i++)
+	{
+		const meshlet& m = meshlets[i];
+		stats.total++;
+
+		vec3 centre(m.centre[0], m.centre[1], m.centre[2]);
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; p++)
+		{
+			outside = dot(vec3(view.planes[p]), centre) + view.planes[p].w < -m.radius;
+		}
+		if (outside)
+		{
+			stats.frustum_culled++;
+			continue;
+		}
+
+		if (m.cone_cutoff <= 1.f)
+		{
+			vec3 apex(m.cone_apex[0], m.cone_apex[1], m.cone_apex[2]);
+			vec3 axis(m.cone_axis[0], m.cone_axis[1], m.cone_axis[2]);
+			vec3 to_apex = apex - view.camera;
+			GLfloat distance = length(to_apex);
+			if (distance > 0.f && dot(to_apex, axis) >= m.cone_cutoff * distance)
+			{
+				stats.backface_culled++;
+				continue;
+			}
+		}
+
+		const void* offset = (const void*)(size_t(m.first_index) * sizeof(GLuint));
+		if (!counts.empty() && (const char*)offsets.back() + counts.back() * sizeof(GLuint) == (const char*)offset)
+		{
+			counts.back() += m.index_count;
+		}
+		else
+		{
+			counts.push_back(m.index_count);
+			offsets.push_back(offset);
+		}
+	}
+}
+
+
+void print_cluster_stats(const char* name, const cluster_cull_stats& stats)
+{
+	GLfloat total = stats.total ? GLfloat(stats.total) : 1.f;
+	cout << name << " meshlets: " << stats.total << ", culled " << stats.culledPercent() << "% ("
+		<< 100.f * stats.frustum_culled / total << "% outside the view, "
+		<< 100.f * stats.backface_culled / total << "% facing away)" << endl;
+}
+
+
+GLuint find_meshlet(const vector<meshlet>& meshlets, GLuint first_index)
+{
+	auto it = lower_bound(meshlets.begin(), meshlets.end(), first_index,
+						  [](const meshlet& m, GLuint index) { return m.first_index < index; });
+	return GLuint(it - meshlets.begin());
+}
@@ -0,0 +1,57 @@
+/* meshlet.h
+   Small clusters of triangles (at most 64 vertices and 124 triangles) with a
+   bounding sphere and a cone that holds all their normals, so whole clusters that
+   are outside the view or facing away from the camera can be skipped.
+   A meshlet is a run of consecutive triangles in the index array, so the triangles
+   are built into meshlets in the order they already have (vertex cache order) and
+   the visible ones are drawn with glMultiDrawElements. Neighbouring visible
+   meshlets are joined into one draw.
+   The bounds are in model space. The frustum planes and camera position are moved
+   into model space instead, once for each mesh, by cluster_view.
+   struct meshlet itself is in mesh_data.h so that meshes and the cache can hold them.
+*/
+
+#pragma once
+
+#include "wrapper_glfw.h"
+#include "mesh_data.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+const GLuint MESHLET_MAX_VERTICES = 64;
+const GLuint MESHLET_MAX_TRIANGLES = 124;
+
+// The frustum planes and the camera position in the model space of a mesh
+struct cluster_view
+{
+	glm::vec4 planes[6];
+	glm::vec3 camera;
+
+	void set(const glm::mat4& modelview, const glm::mat4& projection);
+};
+
+struct cluster_cull_stats
+{
+	GLuint total;
+	GLuint frustum_culled;
+	GLuint backface_culled;
+
+	void clear() { total = frustum_culled = backface_culled = 0; }
+	GLfloat culledPercent() const { return total ? 100.f * (frustum_culled + backface_culled) / total : 0.f; }
+};
+
+/* Split each range into meshlets and append them to out, in index order */
+void build_meshlets(const GLuint* indices, const material_range* ranges, GLuint num_ranges,
+					const GLfloat* positions, GLuint vertex_count, std::vector<meshlet>& out,
+					GLuint max_vertices = MESHLET_MAX_VERTICES, GLuint max_triangles = MESHLET_MAX_TRIANGLES);
+
+/* Test count meshlets and append the visible ones to the multi-draw lists, joining
+   neighbours. Offsets are bytes into the element buffer */
+void cull_meshlets(const meshlet* meshlets, GLuint count, const cluster_view& view,
+				   std::vector<GLsizei>& counts, std::vector<const void*>& offsets, cluster_cull_stats& stats);
+
+/* Print the counts as percentages of the meshlets tested */
+void print_cluster_stats(const char* name, const cluster_cull_stats& stats);
+
+/* First meshlet at or after the index first_index */
+GLuint find_meshlet(const std::vector<meshlet>& meshlets, GLuint first_index);
@@ -0,0 +1,543 @@
+/* obj_parser.cpp
+   Chunked parallel OBJ parser, see obj_parser.h
+   Supports v (with optional vertex colours), vn, vt, f (v, v/vt, v//vn and v/vt/vn,
+   positive and negative indices, polygons are triangulated as a fan), usemtl,
+   mtllib and s. Groups, objects, lines and points are skipped.
+   Files are memory mapped and tokenised in place, with no per line strings,
+   and numbers are read with std::from_chars where the compiler has it.
+*/
+
+#include "obj_parser.h"
+#include "parallel.h"
+#include "mapped_file.h"
+#include <chrono>
+#include <map>
+#include <istream>
+#include <streambuf>
+
+// std::from_chars for floating point needs C++17 and a recent standard library
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#include <charconv>
+#endif
+
+using namespace std;
+
+typedef chrono::high_resolution_clock parse_clock;
+
+static double elapsed_ms(parse_clock::time_point start)
+{
+	return chrono::duration<double, milli>(parse_clock::now() - start).count();
+}
+
+
+/* Everything parsed from one chunk of the file. Face indices are stored as
+   (v, vt, vn) triples, already made zero based and absolute except for those
+   listed in fixups which were relative and still need the chunk's base offset */
+struct obj_chunk
+{
+	const char* begin;
+	const char* end;
+
+	vector<tinyobj::real_t> v, vn, vt, vc;
+	vector<int> idx;
+	vector<size_t> fixups;
+	vector<int> material;		// Per triangle, index into material_names or -1 if set by an earlier chunk
+	vector<int> smoothing;		// Per triangle, smoothing group or -1 if set by an earlier chunk
+	vector<string> material_names;
+	vector<string> mtllibs;
+	int last_material;			// State at the end of the chunk, -1 if the chunk didn't change it
+	int last_smoothing;
+	bool bad_index;
+};
+
+
+static inline const char* skip_space(const char* p, const char* end)
+{
+	while (p < end && (*p == ' ' || *p == '\t')) p++;
+	return p;
+}
+
+static inline bool is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+/* Parse an integer, returns false if there are no digits */
+static inline bool parse_int(const char*& p, const char* end, int& out)
+{
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+	if (p >= end || !is_digit(*p)) return false;
+
+	int n = 0;
+	while (p < end && is_digit(*p)) n = n * 10 + (*p++ - '0');
+	out = negative ? -n : n;
+	return true;
+}
+
+#ifdef __cpp_lib_to_chars
+
+/* Parse a number with std::from_chars, which is correctly rounded and doesn't
+   depend on the locale or need the text to be null terminated */
+static inline bool parse_real(const char*& p, const char* end, tinyobj::real_t& out)
+{
+	p = skip_space(p, end);
+	const char* start = p;
+	if (start < end && *start == '+') start++;
+
+	from_chars_result result = from_chars(start, end, out);
+	if (result.ptr == start) return false;
+
+	// Out of range values are left as they were, but the text is still used up
+	p = result.ptr;
+	return true;
+}
+
+#else
+
+/* Fallback for older compilers. The digits are collected into an integer and
+   scaled once at the end */
+static bool parse_real(const char*& p, const char* end, tinyobj::real_t& out)
+{
+	static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+									1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18 };
+	p = skip_space(p, end);
+	const char* start = p;
+
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+
+	unsigned long long mantissa = 0;
+	int digits = 0, exponent = 0;
+	bool any = false;
+	while (p < end && is_digit(*p))
+	{
+		if (digits < 18) { mantissa = mantissa * 10 + (*p - '0'); digits++; }
+		else exponent++;
+		p++;
+		any = true;
+	}
+	if (p < end && *p == '.')
+	{
+		p++;
+		while (p < end && is_digit(*p))
+		{
+			if (digits < 18) { mantissa = mantissa * 10 + (*p - '0'); digits++; exponent--; }
+			p++;
+			any = true;
+		}
+	}
+	if (!any)
+	{
+		p = start;
+		return false;
+	}
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		const char* e = p + 1;
+		int x;
+		if (parse_int(e, end, x))
+		{
+			exponent += x;
+			p = e;
+		}
+	}
+
+	double value = double(mantissa);
+	while (exponent > 18) { value *= 1e18; exponent -= 18; }
+	while (exponent < -18) { value /= 1e18; exponent += 18; }
+	value = exponent >= 0 ? value * pow10[exponent] : value / pow10[-exponent];
+
+	out = tinyobj::real_t(negative ? -value : value);
+	return true;
+}
+
+#endif
+
+/* Rest of the line as a name, without trailing spaces */
+static string parse_name(const char* p, const char* end)
+{
+	p = skip_space(p, end);
+	while (end > p && (end[-1] == ' ' || end[-1] == '\t')) end--;
+	return string(p, end);
+}
+
+static inline bool starts_with(const char* p, const char* end, const char* word)
+{
+	while (*word)
+	{
+		if (p >= end || *p != *word) return false;
+		p++;
+		word++;
+	}
+	return p == end || *p == ' ' || *p == '\t';
+}
+
+
+/* Read only stream over bytes that are already in memory, so tinyobj::LoadMtl
+   can read a mapped .mtl file without it being copied */
+struct memory_streambuf : public streambuf
+{
+	memory_streambuf(const char* data, size_t size)
+	{
+		char* p = const_cast<char*>(data);
+		setg(p, p, p + size);
+	}
+};
+
+
+/* Map a .mtl file and add its materials */
+static void load_mtl_mapped(const string& filename, map<string, int>* material_map,
+							vector<tinyobj::material_t>* materials, string* warn)
+{
+	mapped_file file;
+	if (!file.open(filename))
+	{
+		if (warn) *warn += "Material file [ " + filename + " ] not found.\n";
+		return;
+	}
+
+	memory_streambuf buffer(file.data ? file.data : "", file.size);
+	istream stream(&buffer);
+	string mtl_warn, mtl_err;
+	tinyobj::LoadMtl(material_map, materials, &stream, &mtl_warn, &mtl_err);
+	if (warn) *warn += mtl_warn + mtl_err;
+}
+
+
+/* Make an OBJ index zero based. Positive indices are absolute, negative ones count
+   back from the last element read in this chunk and are fixed up after the merge */
+static inline int resolve_index(int raw, size_t count, bool& relative, bool& bad)
+{
+	relative = false;
+	if (raw > 0) return raw - 1;
+	if (raw == 0)
+	{
+		bad = true;
+		return -1;
+	}
+	relative = true;
+	return int(count) + raw;
+}
+
+
+static void parse_chunk(obj_chunk& chunk)
+{
+	chunk.last_material = -1;
+	chunk.last_smoothing = -1;
+	chunk.bad_index = false;
+
+	int current_material = -1;
+	int current_smoothing = -1;
+
+	// Corners of the current face, three indices each plus a bit per index that is relative
+	vector<int> corners;
+	vector<unsigned char> relative;
+
+	const char* p = chunk.begin;
+	while (p < chunk.end)
+	{
+		const char* line_end = p;
+		while (line_end < chunk.end && *line_end != '\n') line_end++;
+		const char* next = line_end + 1;
+		if (line_end > p && line_end[-1] == '\r') line_end--;
+
+		p = skip_space(p, line_end);
+		if (p == line_end || *p == '#')
+		{
+			p = next;
+			continue;
+		}
+
+		if (p[0] == 'v' && p + 1 < line_end && (p[1] == ' ' || p[1] == '\t'))
+		{
+			const char* q = p + 2;
+			tinyobj::real_t x = 0, y = 0, z = 0, r, g, b;
+			parse_real(q, line_end, x);
+			parse_real(q, line_end, y);
+			parse_real(q, line_end, z);
+			chunk.v.push_back(x);
+			chunk.v.push_back(y);
+			chunk.v.push_back(z);
+
+			// Optional vertex colour after the position, white if there isn't one
+			if (parse_real(q, line_end, r) && parse_real(q, line_end, g) && parse_real(q, line_end, b))
+			{
+				chunk.vc.push_back(r);
+				chunk.vc.push_back(g);
+				chunk.vc.push_back(b);
+			}
+			else
+			{
+				chunk.vc.push_back(1);
+				chunk.vc.push_back(1);
+				chunk.vc.push_back(1);
+			}
+		}
+		else if (p[0] == 'v' && p + 2 < line_end && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t'))
+		{
+			const char* q = p + 3;
+			tinyobj::real_t x = 0, y = 0, z = 0;
+			parse_real(q, line_end, x);
+			parse_real(q, line_end, y);
+			parse_real(q, line_end, z);
+			chunk.vn.push_back(x);
+			chunk.vn.push_back(y);
+			chunk.vn.push_back(z);
+		}
+		else if (p[0] == 'v' && p + 2 < line_end && p[1] == 't' && (p[2] == ' ' || p[2] == '\t'))
+		{
+			const char* q = p + 3;
+			tinyobj::real_t u = 0, v = 0;
+			parse_real(q, line_end, u);
+			parse_real(q, line_end, v);
+			chunk.vt.push_back(u);
+			chunk.vt.push_back(v);
+		}
+		else if (p[0] == 'f' && p + 1 < line_end && (p[1] == ' ' || p[1] == '\t'))
+		{
+			corners.clear();
+			relative.clear();
+			size_t nv = chunk.v.size() / 3, nvt = chunk.vt.size() / 2, nvn = chunk.vn.size() / 3;
+
+			const char* q = skip_space(p + 2, line_end);
+			while (q < line_end)
+			{
+				int raw_v, raw_vt = 0, raw_vn = 0;
+				if (!parse_int(q, line_end, raw_v)) break;
+				if (q < line_end && *q == '/')
+				{
+					q++;
+					if (q < line_end && *q != '/') parse_int(q, line_end, raw_vt);
+					if (q < line_end && *q == '/')
+					{
+						q++;
+						parse_int(q, line_end, raw_vn);
+					}
+				}
+
+				bool rv, rvt = false, rvn = false;
+				corners.push_back(resolve_index(raw_v, nv, rv, chunk.bad_index));
+				corners.push_back(raw_vt ? resolve_index(raw_vt, nvt, rvt, chunk.bad_index) : -1);
+				corners.push_back(raw_vn ? resolve_index(raw_vn, nvn, rvn, chunk.bad_index) : -1);
+				relative.push_back((rv ? 1 : 0) | (rvt ? 2 : 0) | (rvn ? 4 : 0));
+
+				while (q < line_end && *q != ' ' && *q != '\t') q++;
+				q = skip_space(q, line_end);
+			}
+
+			// Triangle fan
+			size_t n = relative.size();
+			for (size_t k = 2; k < n; k++)
+			{
+				const size_t fan[3] = { 0, k - 1, k };
+				for (int c = 0; c < 3; c++)
+				{
+					for (int a = 0; a < 3; a++)
+					{
+						if (relative[fan[c]] & (1 << a)) chunk.fixups.push_back(chunk.idx.size());
+						chunk.idx.push_back(corners[fan[c] * 3 + a]);
+					}
+				}
+				chunk.material.push_back(current_material);
+				chunk.smoothing.push_back(current_smoothing);
+			}
+		}
+		else if (starts_with(p, line_end, "usemtl"))
+		{
+			chunk.material_names.push_back(parse_name(p + 6, line_end));
+			current_material = int(chunk.material_names.size()) - 1;
+			chunk.last_material = current_material;
+		}
+		else if (starts_with(p, line_end, "mtllib"))
+		{
+			chunk.mtllibs.push_back(parse_name(p + 6, line_end));
+		}
+		else if (p[0] == 's' && p + 1 < line_end && (p[1] == ' ' || p[1] == '\t'))
+		{
+			const char* q = skip_space(p + 2, line_end);
+			int group = 0;
+			if (!parse_int(q, line_end, group) || group < 0) group = 0;	// "s off"
+			current_smoothing = group;
+			chunk.last_smoothing = group;
+		}
+
+		p = next;
+	}
+}
+
+
+bool parse_obj_parallel(const char* data, size_t size, const string& mtl_basedir,
+						tinyobj::attrib_t* attrib, vector<tinyobj::shape_t>* shapes,
+						vector<tinyobj::material_t>* materials, string* warn, string* err,
+						unsigned chunks, obj_parse_stats* stats)
+{
+	parse_clock::time_point start = parse_clock::now();
+
+	if (chunks == 0) chunks = parallel_chunks(size, 1 << 20);
+
+	// Split at line boundaries, a chunk may end up empty if a line is very long
+	vector<obj_chunk> parts(chunks);
+	const char* data_end = data + size;
+	const char* p = data;
+	for (unsigned c = 0; c < chunks; c++)
+	{
+		const char* stop = (c + 1 == chunks) ? data_end : data + size * (c + 1) / chunks;
+		if (stop < p) stop = p;
+		while (stop > data && stop < data_end && stop[-1] != '\n') stop++;
+		parts[c].begin = p;
+		parts[c].end = stop;
+		p = stop;
+	}
+
+	parallel_for(chunks, chunks, [&](size_t begin, size_t end, unsigned /*chunk*/)
+	{
+		for (size_t c = begin; c < end; c++) parse_chunk(parts[c]);
+	});
+
+	double parse_time = elapsed_ms(start);
+	start = parse_clock::now();
+
+	// Materials, loaded in the order the mtllib lines appear
+	map<string, int> material_map;
+	materials->clear();
+	for (unsigned c = 0; c < chunks; c++)
+	{
+		for (size_t m = 0; m < parts[c].mtllibs.size(); m++)
+		{
+			load_mtl_mapped(mtl_basedir + parts[c].mtllibs[m], &material_map, materials, warn);
+		}
+	}
+
+	// Base offsets of each chunk in the merged arrays, and the material and
+	// smoothing group carried into each chunk from the ones before it
+	vector<size_t> vbase(chunks + 1, 0), vnbase(chunks + 1, 0), vtbase(chunks + 1, 0), tribase(chunks + 1, 0);
+	vector<int> carried_material(chunks), carried_smoothing(chunks);
+	vector<vector<int>> material_ids(chunks);
+	int material = -1, smoothing = 0;
+	for (unsigned c = 0; c < chunks; c++)
+	{
+		obj_chunk& part = parts[c];
+		vbase[c + 1] = vbase[c] + part.v.size() / 3;
+		vnbase[c + 1] = vnbase[c] + part.vn.size() / 3;
+		vtbase[c + 1] = vtbase[c] + part.vt.size() / 2;
+		tribase[c + 1] = tribase[c] + part.material.size();
+
+		for (size_t m = 0; m < part.material_names.size(); m++)
+		{
+			map<string, int>::iterator it = material_map.find(part.material_names[m]);
+			if (it == material_map.end())
+			{
+				if (warn) *warn += "material [ " + part.material_names[m] + " ] not found in .mtl\n";
+				material_ids[c].push_back(-1);
+			}
+			else material_ids[c].push_back(it->second);
+		}
+
+		carried_material[c] = material;
+		carried_smoothing[c] = smoothing;
+		if (part.last_material >= 0) material = material_ids[c][part.last_material];
+		if (part.last_smoothing >= 0) smoothing = part.last_smoothing;
+	}
+
+	size_t numv = vbase[chunks], numvn = vnbase[chunks], numvt = vtbase[chunks], numtris = tribase[chunks];
+	attrib->vertices.resize(numv * 3);
+	attrib->colors.resize(numv * 3);
+	attrib->normals.resize(numvn * 3);
+	attrib->texcoords.resize(numvt * 2);
+
+	shapes->clear();
+	shapes->resize(1);
+	tinyobj::mesh_t& mesh = (*shapes)[0].mesh;
+	mesh.indices.resize(numtris * 3);
+	mesh.num_face_vertices.assign(numtris, 3);
+	mesh.material_ids.resize(numtris);
+	mesh.smoothing_group_ids.resize(numtris);
+
+	// Copy each chunk into place on its own thread
+	parallel_for(chunks, chunks, [&](size_t begin, size_t end, unsigned /*chunk*/)
+	{
+		for (size_t c = begin; c < end; c++)
+		{
+			obj_chunk& part = parts[c];
+			copy(part.v.begin(), part.v.end(), attrib->vertices.begin() + vbase[c] * 3);
+			copy(part.vc.begin(), part.vc.end(), attrib->colors.begin() + vbase[c] * 3);
+			copy(part.vn.begin(), part.vn.end(), attrib->normals.begin() + vnbase[c] * 3);
+			copy(part.vt.begin(), part.vt.end(), attrib->texcoords.begin() + vtbase[c] * 2);
+
+			// Relative indices only need the count of everything before this chunk
+			const size_t base[3] = { vbase[c], vtbase[c], vnbase[c] };
+			for (size_t f = 0; f < part.fixups.size(); f++)
+			{
+				size_t i = part.fixups[f];
+				part.idx[i] += int(base[i % 3]);
+			}
+
+			size_t first = tribase[c] * 3;
+			for (size_t i = 0; i < part.idx.size(); i += 3)
+			{
+				int v = part.idx[i], vt = part.idx[i + 1], vn = part.idx[i + 2];
+				if (v < 0 || size_t(v) >= numv || vt >= int(numvt) || vn >= int(numvn)) part.bad_index = true;
+
+				tinyobj::index_t& index = mesh.indices[first + i / 3];
+				index.vertex_index = v;
+				index.texcoord_index = vt;
+				index.normal_index = vn;
+			}
+
+			for (size_t t = 0; t < part.material.size(); t++)
+			{
+				int m = part.material[t];
+				mesh.material_ids[tribase[c] + t] = m < 0 ? carried_material[c] : material_ids[c][m];
+				int s = part.smoothing[t];
+				mesh.smoothing_group_ids[tribase[c] + t] = unsigned(s < 0 ? carried_smoothing[c] : s);
+			}
+		}
+	});
+
+	double merge_time = elapsed_ms(start);
+
+	if (stats)
+	{
+		stats->bytes = size;
+		stats->chunks = chunks;
+		stats->parse_time = parse_time;
+		stats->merge_time = merge_time;
+	}
+
+	for (unsigned c = 0; c < chunks; c++)
+	{
+		if (parts[c].bad_index)
+		{
+			if (err) *err += "Face index out of range in OBJ data\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+
+/* Map the file and parse it in place, .mtl files are looked for next to the .obj.
+   The pages are read in by the worker threads as they touch them, so read_time
+   is just the cost of setting up the mapping */
+bool load_obj_parallel(const string& filename, tinyobj::attrib_t* attrib, vector<tinyobj::shape_t>* shapes,
+					   vector<tinyobj::material_t>* materials, string* warn, string* err, obj_parse_stats* stats)
+{
+	parse_clock::time_point start = parse_clock::now();
+
+	mapped_file file;
+	if (!file.open(filename))
+	{
+		if (err) *err += "Cannot open file [" + filename + "]\n";
+		return false;
+	}
+
+	double read_time = elapsed_ms(start);
+
+	size_t slash = filename.find_last_of("/\\");
+	string basedir = (slash == string::npos) ? string() : filename.substr(0, slash + 1);
+
+	bool ret = parse_obj_parallel(file.data ? file.data : "", file.size, basedir, attrib, shapes, materials, warn, err, 0, stats);
+	if (stats) stats->read_time = read_time;
+	return ret;
+}
@@ -0,0 +1,35 @@
+/* obj_parser.h
+   Multi-threaded Wavefront OBJ parser for large files.
+   The file is split into chunks at line boundaries and each chunk is parsed on
+   its own thread into local v/vn/vt/f arrays. The chunks are then merged in file
+   order: the attribute arrays are concatenated and relative (negative) face
+   indices, materials and smoothing groups that carry over from earlier chunks
+   are resolved using the counts from the chunks before them.
+   The result is in the same tinyobj structures as tinyobj::LoadObj (one shape,
+   faces triangulated) so TinyObjLoader can use either.
+*/
+
+#pragma once
+
+#include "tiny_obj_loader.h"
+#include <string>
+#include <vector>
+
+// Timings for the last load, in milliseconds
+struct obj_parse_stats
+{
+	size_t bytes;
+	unsigned chunks;
+	double read_time;
+	double parse_time;
+	double merge_time;
+};
+
+bool parse_obj_parallel(const char* data, size_t size, const std::string& mtl_basedir,
+						tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+						std::vector<tinyobj::material_t>* materials, std::string* warn, std::string* err,
+						unsigned chunks = 0, obj_parse_stats* stats = nullptr);
+
+bool load_obj_parallel(const std::string& filename, tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+					   std::vector<tinyobj::material_t>* materials, std::string* warn, std::string* err,
+					   obj_parse_stats* stats = nullptr);
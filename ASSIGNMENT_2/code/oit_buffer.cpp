@@ -0,0 +1,175 @@
+/* oit_buffer.cpp
+   Weighted blended order independent transparency targets and composite pass.
+   The point sprites are drawn between begin() and end() with point_sprites_oit.frag
+   and then composite() blends the result over the scene framebuffer, which is the
+   window unless scene_framebuffer is set.
+*/
+
+#include "oit_buffer.h"
+#include <iostream>
+
+using namespace std;
+
+oit_buffer::oit_buffer()
+{
+	framebuffer = 0;
+	accum_texture = 0;
+	revealage_texture = 0;
+	depth_buffer = 0;
+	composite_program = 0;
+	composite_vao = 0;
+	scene_framebuffer = 0;
+	width = height = 0;
+}
+
+
+oit_buffer::~oit_buffer()
+{
+	deleteTargets();
+	if (composite_vao) glDeleteVertexArrays(1, &composite_vao);
+}
+
+
+/* Build the composite shader and the render targets at the window size */
+void oit_buffer::create(GLWrapper* glw, GLsizei width, GLsizei height)
+{
+	composite_program = glw->LoadShader("..\\ASSIGNMENT_2\\code\\oit_composite.vert", "..\\ASSIGNMENT_2\\code\\oit_composite.frag");
+	accumID = glGetUniformLocation(composite_program, "accum");
+	revealageID = glGetUniformLocation(composite_program, "revealage");
+
+	// The full screen triangle is made from gl_VertexID so this VAO has no buffers
+	glGenVertexArrays(1, &composite_vao);
+
+	this->width = width;
+	this->height = height;
+	createTargets();
+}
+
+
+/* Recreate the targets when the window changes size */
+void oit_buffer::resize(GLsizei width, GLsizei height)
+{
+	if (width == this->width && height == this->height) return;
+	if (width <= 0 || height <= 0) return;
+
+	this->width = width;
+	this->height = height;
+	deleteTargets();
+	createTargets();
+}
+
+
+void oit_buffer::createTargets()
+{
+	glGenTextures(1, &accum_texture);
+	glBindTexture(GL_TEXTURE_2D, accum_texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glGenTextures(1, &revealage_texture);
+	glBindTexture(GL_TEXTURE_2D, revealage_texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// Same format as the usual default depth buffer so that it can be blitted across
+	glGenRenderbuffers(1, &depth_buffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accum_texture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, revealage_texture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth_buffer);
+
+	const GLenum buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, buffers);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		cerr << "oit_buffer: framebuffer is incomplete" << endl;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+
+void oit_buffer::deleteTargets()
+{
+	if (framebuffer) glDeleteFramebuffers(1, &framebuffer);
+	if (accum_texture) glDeleteTextures(1, &accum_texture);
+	if (revealage_texture) glDeleteTextures(1, &revealage_texture);
+	if (depth_buffer) glDeleteRenderbuffers(1, &depth_buffer);
+	framebuffer = accum_texture = revealage_texture = depth_buffer = 0;
+}
+
+
+/* Start the transparent pass: copy the scene depth across, clear the targets
+   and set the accumulate and revealage blend functions.
+   Depth testing stays on but depth writes are turned off */
+void oit_buffer::begin()
+{
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, scene_framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+	const GLfloat zero[] = { 0.f, 0.f, 0.f, 0.f };
+	const GLfloat one[] = { 1.f, 1.f, 1.f, 1.f };
+	glClearBufferfv(GL_COLOR, 0, zero);
+	glClearBufferfv(GL_COLOR, 1, one);
+
+	glEnable(GL_DEPTH_TEST);
+	glDepthMask(GL_FALSE);
+	glEnable(GL_BLEND);
+	glBlendFunci(0, GL_ONE, GL_ONE);
+	glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+}
+
+
+/* Finish the transparent pass and go back to the scene framebuffer */
+void oit_buffer::end()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, scene_framebuffer);
+	glDepthMask(GL_TRUE);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDisable(GL_BLEND);
+}
+
+
+/* Blend the averaged transparent colour over the scene framebuffer */
+void oit_buffer::composite()
+{
+	GLint previous_vao;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous_vao);
+
+	glUseProgram(composite_program);
+	glUniform1i(accumID, 0);
+	glUniform1i(revealageID, 1);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, accum_texture);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, revealage_texture);
+
+	glDisable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+	glBindVertexArray(composite_vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(previous_vao);
+
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDisable(GL_BLEND);
+	glEnable(GL_DEPTH_TEST);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glUseProgram(0);
+}
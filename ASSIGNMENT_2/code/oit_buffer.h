@@ -0,0 +1,39 @@
+/* oit_buffer.h
+   Render targets for weighted blended order independent transparency
+   (McGuire and Bavoil 2013). Transparent fragments are accumulated into a
+   premultiplied colour target and a revealage target in any order, then a full
+   screen composite pass blends the weighted average over the opaque scene.
+   No sorting is needed, so the cost does not grow with the number of particles.
+*/
+
+#pragma once
+
+#include "wrapper_glfw.h"
+
+class oit_buffer
+{
+public:
+	oit_buffer();
+	~oit_buffer();
+
+	void create(GLWrapper* glw, GLsizei width, GLsizei height);
+	void resize(GLsizei width, GLsizei height);
+	void begin();
+	void end();
+	void composite();
+
+	GLuint framebuffer;
+	GLuint accum_texture;		// RGBA16F sum of weighted premultiplied colours
+	GLuint revealage_texture;	// R8 product of (1 - alpha)
+	GLuint depth_buffer;		// Copy of the scene depth so the opaque objects hide the particles
+	GLuint composite_program;
+	GLuint composite_vao;
+	GLuint accumID, revealageID;
+	GLuint scene_framebuffer;	// Where the opaque scene is drawn and the result composited, 0 for the window
+
+	GLsizei width, height;
+
+private:
+	void createTargets();
+	void deleteTargets();
+};
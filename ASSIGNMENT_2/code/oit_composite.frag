@@ -0,0 +1,24 @@
+// Composite pass for weighted blended order independent transparency
+// Divides the accumulated colour by the accumulated weight and uses the
+// revealage as the coverage. Blend with (ONE_MINUS_SRC_ALPHA, SRC_ALPHA)
+
+#version 400
+
+uniform sampler2D accum;
+uniform sampler2D revealage;
+
+out vec4 outputColor;
+
+void main()
+{
+	ivec2 coord = ivec2(gl_FragCoord.xy);
+	float reveal = texelFetch(revealage, coord, 0).r;
+
+	// Nothing transparent was drawn here
+	if (reveal >= 1.0) discard;
+
+	vec4 sum = texelFetch(accum, coord, 0);
+	vec3 average = sum.rgb / max(sum.a, 0.00001);
+
+	outputColor = vec4(average, reveal);
+}
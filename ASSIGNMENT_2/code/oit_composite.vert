@@ -0,0 +1,10 @@
+// Full screen triangle for the order independent transparency composite pass
+// The vertex positions are made from gl_VertexID so no vertex buffers are needed
+
+#version 400
+
+void main()
+{
+	vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,144 @@
+/* parallel.h
+   Small helpers to split a loop over a number of worker threads.
+   Each worker is given a contiguous range [begin, end) and its chunk number so
+   that it can write into its own output bin without any locking.
+   The workers are started once, on the first parallel loop, and sleep between loops,
+   as several loops run every frame and starting threads for each would cost more
+   than many of them save.
+*/
+
+#pragma once
+
+#include <thread>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+
+/* Number of chunks to split count items into, with at least min_items in each chunk.
+   Small loops return 1 so that they run inline without waking any threads */
+inline unsigned parallel_chunks(size_t count, size_t min_items = 4096)
+{
+	unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+	size_t chunks = count / std::max<size_t>(min_items, 1);
+	if (chunks < 1) chunks = 1;
+	return (unsigned)std::min<size_t>(chunks, threads);
+}
+
+/* Worker threads shared by every parallel_for(). A loop is put on a list that the
+   workers take chunks from, and the calling thread takes chunks from its own loop
+   too until there are none left, then waits for the ones the workers are running.
+   So loops can be started from several threads at once, or from inside another
+   loop, without waiting on workers that are all busy */
+class parallel_pool
+{
+public:
+	struct loop
+	{
+		std::function<void(unsigned)> task;		// Runs one chunk
+		unsigned chunks;
+		std::atomic<unsigned> next;				// Next chunk to start
+		unsigned done;							// Chunks finished, under the pool mutex
+	};
+
+	static parallel_pool& instance()
+	{
+		static parallel_pool pool;
+		return pool;
+	}
+
+	void run(loop& l)
+	{
+		l.next = 0;
+		l.done = 0;
+		{
+			std::lock_guard<std::mutex> lock(pool_mutex);
+			loops.push_back(&l);
+		}
+		loop_added.notify_all();
+
+		unsigned ran = 0;
+		for (unsigned c; (c = l.next++) < l.chunks; ran++) l.task(c);
+
+		std::unique_lock<std::mutex> lock(pool_mutex);
+		l.done += ran;
+		loop_finished.wait(lock, [&l]() { return l.done == l.chunks; });
+
+		// Still listed if this thread took the last chunk
+		std::deque<loop*>::iterator it = std::find(loops.begin(), loops.end(), &l);
+		if (it != loops.end()) loops.erase(it);
+	}
+
+private:
+	parallel_pool()
+	{
+		stopping = false;
+
+		// The calling thread runs chunks as well
+		unsigned threads = std::max(1u, std::thread::hardware_concurrency()) - 1;
+		for (unsigned t = 0; t < threads; t++) workers.emplace_back(&parallel_pool::worker, this);
+	}
+
+	~parallel_pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(pool_mutex);
+			stopping = true;
+		}
+		loop_added.notify_all();
+		for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+	}
+
+	void worker()
+	{
+		std::unique_lock<std::mutex> lock(pool_mutex);
+		for (;;)
+		{
+			loop_added.wait(lock, [this]() { return stopping || !loops.empty(); });
+			if (stopping) return;
+
+			// The loop can't end while it is listed, or while one of its chunks is running
+			loop* l = loops.front();
+			unsigned c = l->next++;
+			if (c + 1 >= l->chunks) loops.pop_front();
+			if (c >= l->chunks) continue;
+
+			lock.unlock();
+			l->task(c);
+			lock.lock();
+			if (++l->done == l->chunks) loop_finished.notify_all();
+		}
+	}
+
+	std::vector<std::thread> workers;
+	std::mutex pool_mutex;
+	std::condition_variable loop_added, loop_finished;
+	std::deque<loop*> loops;		// Loops that may still have chunks to start
+	bool stopping;
+};
+
+/* Call fn(begin, end, chunk) for each chunk of the range [0, count) on the pool
+   and the calling thread, returning when all of them have finished */
+template <typename Func>
+void parallel_for(size_t count, unsigned chunks, Func fn)
+{
+	if (chunks <= 1)
+	{
+		fn(size_t(0), count, 0u);
+		return;
+	}
+
+	size_t step = (count + chunks - 1) / chunks;
+	parallel_pool::loop l;
+	l.chunks = chunks;
+	l.task = [&fn, count, step](unsigned c)
+	{
+		size_t begin = std::min(count, c * step);
+		size_t end = std::min(count, begin + step);
+		fn(begin, end, c);
+	};
+	parallel_pool::instance().run(l);
+}
@@ -0,0 +1,196 @@
+/* particle_quads.cpp
+   Packs the particles into quad instances each frame and draws them with one
+   instanced call. The instances follow the same order and visible set as the
+   point sprites, so depth sorting and culling carry over.
+*/
+
+#include "particle_quads.h"
+#include "points.h"
+#include "wind_field.h"
+#include "parallel.h"
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+using namespace std;
+
+particle_quads::particle_quads()
+{
+	numinstances = 0;
+	vao = 0;
+	corner_buffer = 0;
+	instance_buffer = 0;
+	program[0] = program[1] = 0;
+	size = 0.5f;
+	max_stretch = 4.f;
+	stretch_scale = 200.f;
+	velocity_align = true;
+	spin = 0.02f;
+	frame = 0;
+	build_time = 0;
+	upload_bytes = 0;
+}
+
+
+particle_quads::~particle_quads()
+{
+	if (vao) glDeleteVertexArrays(1, &vao);
+	if (corner_buffer) glDeleteBuffers(1, &corner_buffer);
+	if (instance_buffer) glDeleteBuffers(1, &instance_buffer);
+}
+
+
+static inline GLuint pack_unorm(GLfloat v, GLfloat scale)
+{
+	return GLuint(min(max(v, 0.f), 1.f) * scale + 0.5f);
+}
+
+
+/* Load the shaders and set up a VAO of its own so that the instanced attributes
+   (with their divisors) don't disturb the VAO the rest of the scene uses */
+void particle_quads::create(GLWrapper* glw)
+{
+	program[0] = glw->LoadShader("..\\ASSIGNMENT_2\\code\\particle_quads.vert", "..\\ASSIGNMENT_2\\code\\particle_quads.frag");
+	program[1] = glw->LoadShader("..\\ASSIGNMENT_2\\code\\particle_quads.vert", "..\\ASSIGNMENT_2\\code\\particle_quads_oit.frag");
+	for (int p = 0; p < 2; p++)
+	{
+		modelID[p] = glGetUniformLocation(program[p], "model");
+		viewID[p] = glGetUniformLocation(program[p], "view");
+		projectionID[p] = glGetUniformLocation(program[p], "projection");
+		sizeID[p] = glGetUniformLocation(program[p], "size");
+		max_stretchID[p] = glGetUniformLocation(program[p], "max_stretch");
+	}
+
+	GLint previous_vao;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous_vao);
+
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	// Triangle strip corners
+	const GLfloat corners[] = { -1.f, -1.f, 1.f, -1.f, -1.f, 1.f, 1.f, 1.f };
+	glGenBuffers(1, &corner_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, corner_buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
+
+	// One instance per particle
+	glGenBuffers(1, &instance_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(quad_instance), (GLvoid*)offsetof(quad_instance, position));
+	glVertexAttribDivisor(1, 1);
+	glEnableVertexAttribArray(2);
+	glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, sizeof(quad_instance), (GLvoid*)offsetof(quad_instance, shape));
+	glVertexAttribDivisor(2, 1);
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(quad_instance), (GLvoid*)offsetof(quad_instance, colour));
+	glVertexAttribDivisor(3, 1);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(previous_vao);
+}
+
+
+/* Pack the particles that the point sprites would draw this frame into instances.
+   Call after cull() and sortByDepth() so the same set is drawn in the same order,
+   without a sort this frame the particles go in index order. Nothing is built while
+   the GPU simulation runs, as the positions on the CPU are out of date */
+void particle_quads::build(points* particles, const glm::mat4& modelview)
+{
+	if (particles->gpu_simulation)
+	{
+		numinstances = 0;
+		upload_bytes = 0;
+		return;
+	}
+
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+
+	bool culled = particles->culling;
+	bool sorted = particles->sorted;
+	numinstances = culled ? particles->numvisible : particles->numpoints;
+	if (instances.size() < numinstances) instances.resize(numinstances);
+
+	glm::mat3 rotation(modelview);
+	GLfloat turn = spin * GLfloat(frame);
+
+	// Packed as a fraction of the stretch range, which is empty when quads can't stretch
+	GLfloat stretch_range = max_stretch > 1.f ? 1.f / (max_stretch - 1.f) : 0.f;
+	const GLfloat two_pi = 6.2831853f;
+
+	parallel_for(numinstances, parallel_chunks(numinstances, 65536), [&](size_t begin, size_t end, unsigned /*chunk*/)
+	{
+		for (size_t k = begin; k < end; k++)
+		{
+			GLuint j = sorted ? particles->sort_order[k] : GLuint(k);
+			GLuint i = culled ? particles->visible_index[j] : j;
+
+			const glm::vec3& p = particles->vertices[i];
+			const glm::vec3& c = particles->colours[i];
+			GLuint h = random_hash(i);
+
+			// Sizes between half and full size
+			GLfloat s = 0.5f + 0.5f * GLfloat(h & 0xFFu) / 255.f;
+
+			GLfloat stretch = 1.f, angle;
+			if (velocity_align)
+			{
+				// Point the long side of the quad along the motion as seen from the camera
+				glm::vec3 v = particles->velocity[i];
+				if (particles->wind) v += particles->wind->sample(p);
+				glm::vec3 ve = rotation * v;
+				stretch = min(1.f + stretch_scale * glm::length(v), max_stretch);
+				angle = atan2(ve.y, ve.x);
+			}
+			else
+			{
+				// Each particle spins from its own starting angle, in either direction
+				GLfloat dir = (h & 0x100u) ? 1.f : -1.f;
+				angle = GLfloat(h >> 16) * (two_pi / 65536.f) + turn * dir;
+			}
+			angle = angle / two_pi;
+			angle -= floor(angle);
+
+			quad_instance& q = instances[k];
+			q.position = p;
+			q.shape = pack_unorm(s, 255.f) |
+					  (pack_unorm((stretch - 1.f) * stretch_range, 255.f) << 8) |
+					  (pack_unorm(angle, 65535.f) << 16);
+			q.colour = pack_unorm(c.x, 255.f) | (pack_unorm(c.y, 255.f) << 8) | (pack_unorm(c.z, 255.f) << 16) | (255u << 24);
+		}
+	});
+	frame++;
+
+	// The order is used up, as it is when points::draw() draws with it
+	particles->sorted = false;
+
+	build_time = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+	glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+	glBufferData(GL_ARRAY_BUFFER, numinstances * sizeof(quad_instance), numinstances ? &instances[0] : NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	upload_bytes = numinstances * sizeof(quad_instance);
+}
+
+
+/* Draw the instances built by the last build(). Blending (or the OIT targets) should
+   be set up by the caller as for the point sprites */
+void particle_quads::draw(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, bool oit)
+{
+	int p = oit ? 1 : 0;
+	glUseProgram(program[p]);
+	glUniformMatrix4fv(modelID[p], 1, GL_FALSE, &model[0][0]);
+	glUniformMatrix4fv(viewID[p], 1, GL_FALSE, &view[0][0]);
+	glUniformMatrix4fv(projectionID[p], 1, GL_FALSE, &projection[0][0]);
+	glUniform1f(sizeID[p], size);
+	glUniform1f(max_stretchID[p], max_stretch);
+
+	GLint previous_vao;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous_vao);
+	glBindVertexArray(vao);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, numinstances);
+	glBindVertexArray(previous_vao);
+}
@@ -0,0 +1,19 @@
+// Fragment shader for the instanced particle quads
+// Same circular sprite as point_sprites_analytic.frag but using the quad
+// coordinates instead of gl_PointCoord, stretched quads give streaks
+
+#version 400
+
+in vec4 fcolour;
+in vec2 fcoord;
+out vec4 outputColor;
+
+void main()
+{
+	const vec4 colour2 = vec4(0.9, 0.7, 1.0, 0.0);
+	vec2 temp = fcoord - vec2(0.5);
+	float f = dot(temp, temp);
+	if (f>0.25) discard;
+
+	outputColor = mix (fcolour, colour2, smoothstep(0.01, 0.25, f));
+}
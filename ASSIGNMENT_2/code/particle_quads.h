@@ -0,0 +1,56 @@
+/* particle_quads.h
+   Instanced quad renderer for the particles, an alternative to the GL_POINTS sprites.
+   gl_PointSize is limited by the driver so sprites can be clamped at different sizes
+   on different hardware, quads have no limit and can also be rotated and stretched.
+   Each particle is one instance of a four vertex triangle strip with a compact
+   20 byte instance: the position, one word holding the size, stretch and rotation
+   and one word holding the RGBA8 colour.
+*/
+
+#pragma once
+
+#include "wrapper_glfw.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+class points;
+
+struct quad_instance
+{
+	glm::vec3 position;
+	GLuint shape;		// bits 0-7 size, 8-15 stretch, 16-31 rotation, all unsigned normalised
+	GLuint colour;		// RGBA8
+};
+
+class particle_quads
+{
+public:
+	particle_quads();
+	~particle_quads();
+
+	void create(GLWrapper* glw);
+	void build(points* particles, const glm::mat4& modelview);
+	void draw(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, bool oit);
+
+	std::vector<quad_instance> instances;
+	GLuint numinstances;
+
+	GLuint vao;
+	GLuint corner_buffer;		// The four corners of the quad, shared by every instance
+	GLuint instance_buffer;
+
+	// program[0] draws blended like point_sprites_analytic.frag, program[1] writes the OIT targets
+	GLuint program[2];
+	GLuint modelID[2], viewID[2], projectionID[2], sizeID[2], max_stretchID[2];
+
+	GLfloat size;				// Size of the largest quad in particle coordinates
+	GLfloat max_stretch;		// Longest quad relative to its width
+	GLfloat stretch_scale;		// Stretch added per unit of particle speed (distance per frame)
+	bool velocity_align;		// Stretch along the direction of motion, otherwise spin in place
+	GLfloat spin;				// Rotation per frame in radians when not velocity aligned
+	GLuint frame;
+
+	// Counters for the last frame
+	double build_time;			// Time taken to pack the instances in milliseconds
+	size_t upload_bytes;
+};
@@ -0,0 +1,40 @@
+// Vertex shader for the instanced particle quads
+// Each instance is one particle, the quad is built in eye space so it always
+// faces the camera, then rotated and stretched along its local x axis
+
+#version 400
+
+// Per vertex corner of the quad
+layout(location = 0) in vec2 corner;
+
+// Per instance
+layout(location = 1) in vec3 position;
+layout(location = 2) in uint shape;		// size, stretch and rotation packed by particle_quads::build()
+layout(location = 3) in vec4 colour;
+
+uniform mat4 model, view, projection;
+uniform float size, max_stretch;
+
+out vec4 fcolour;
+out vec2 fcoord;
+
+void main()
+{
+	float s = float(shape & 0xFFu) / 255.0 * size;
+	float stretch = 1.0 + float((shape >> 8) & 0xFFu) / 255.0 * (max_stretch - 1.0);
+	float angle = float(shape >> 16) / 65535.0 * 6.2831853;
+
+	// Size is in particle coordinates so scale it the same way as the positions
+	float scale = length(vec3(model[0]));
+	vec2 c = corner * vec2(0.5 * s * stretch, 0.5 * s) * scale;
+	float ca = cos(angle);
+	float sa = sin(angle);
+	vec2 offset = vec2(c.x * ca - c.y * sa, c.x * sa + c.y * ca);
+
+	vec4 eye = view * model * vec4(position, 1.0);
+	eye.xy += offset;
+
+	fcolour = colour;
+	fcoord = corner * 0.5 + 0.5;
+	gl_Position = projection * eye;
+}
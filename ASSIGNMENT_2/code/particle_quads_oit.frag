@@ -0,0 +1,26 @@
+// Fragment shader for the instanced particle quads drawn with weighted blended
+// order independent transparency, the quad version of point_sprites_oit.frag
+
+#version 420
+
+in vec4 fcolour;
+in vec2 fcoord;
+layout(location = 0) out vec4 accum;
+layout(location = 1) out float revealage;
+
+void main()
+{
+	const vec4 colour2 = vec4(0.9, 0.7, 1.0, 0.0);
+	vec2 temp = fcoord - vec2(0.5);
+	float f = dot(temp, temp);
+	if (f>0.25) discard;
+
+	vec4 colour = mix (fcolour, colour2, smoothstep(0.01, 0.25, f));
+	float alpha = colour.a;
+
+	// Weight function from McGuire and Bavoil, favours near and opaque fragments
+	float w = clamp(pow(min(1.0, alpha * 10.0) + 0.01, 3.0) * 1e8 * pow(1.0 - gl_FragCoord.z * 0.9, 3.0), 1e-2, 3e3);
+
+	accum = vec4(colour.rgb * alpha, alpha) * w;
+	revealage = alpha;
+}
@@ -0,0 +1,27 @@
+// Fragment shader for analytic Point Sprites drawn with weighted blended
+// order independent transparency. Same circular sprite as point_sprites_analytic.frag
+// but writes a depth weighted premultiplied colour and the alpha into two targets
+// which are combined later by oit_composite.frag
+
+#version 420
+
+in vec4 fcolour;
+layout(location = 0) out vec4 accum;
+layout(location = 1) out float revealage;
+
+void main()
+{
+	const vec4 colour2 = vec4(0.9, 0.7, 1.0, 0.0);
+	vec2 temp = gl_PointCoord - vec2(0.5);
+	float f = dot(temp, temp);
+	if (f>0.25) discard;
+
+	vec4 colour = mix (fcolour, colour2, smoothstep(0.01, 0.25, f));
+	float alpha = colour.a;
+
+	// Weight function from McGuire and Bavoil, favours near and opaque fragments
+	float w = clamp(pow(min(1.0, alpha * 10.0) + 0.01, 3.0) * 1e8 * pow(1.0 - gl_FragCoord.z * 0.9, 3.0), 1e-2, 3e3);
+
+	accum = vec4(colour.rgb * alpha, alpha) * w;
+	revealage = alpha;
+}
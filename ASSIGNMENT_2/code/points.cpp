@@ -4,15 +4,47 @@ December 2021
  */
 
 #include "points.h"
+#include "terrain_object.h"
+#include "snow_cover.h"
+#include "wind_field.h"
+#include "spatial_hash.h"
+#include "parallel.h"
+#include "radix_sort.h"
 #include "glm/gtc/random.hpp"
 #include <random>
+#include <chrono>
+#include <iostream>
 
 /* Constructor, set initial parameters*/
 points::points(GLuint number, GLfloat dist, GLfloat sp)
 {
 	numpoints = number;
+	seed = std::random_device()();
 	maxdist = dist;
 	speed = sp;
+	ground = nullptr;
+	snow = nullptr;
+	wind = nullptr;
+	clumping = false;
+	clump_radius = 0.5f;
+	clump_strength = 0.01f;
+	neighbours = nullptr;
+	culling = false;
+	lod_near = 5.f;
+	lod_far = 50.f;
+	numvisible = number;
+	upload_bytes = 0;
+	pending_upload_bytes = 0;
+	depth_sort = false;
+	sorted = false;
+	sort_time = 0;
+	gpu_simulation = false;
+	gpu_position_buffer = 0;
+	gpu_velocity_buffer = 0;
+	gpu_height_buffer = 0;
+	gpu_wind_buffer = 0;
+	gpu_impact_buffer = 0;
+	compute_program = 0;
 }
 
 
@@ -20,6 +52,8 @@ points::~points()
 {
 	delete [] colours;
 	delete[] vertices;
+	delete[] velocity;
+	delete neighbours;
 }
 
 void points::updateParams(GLfloat dist, GLfloat sp)
@@ -29,25 +63,58 @@ void points::updateParams(GLfloat dist, GLfloat sp)
 }
 
 
-void  points::create()
+/* Make the particles land on a terrain instead of the y = 0 plane.
+   If a snow layer is given then each landing is recorded in it */
+void points::attachTerrain(terrain_object* terrain, snow_cover* snow)
+{
+	ground = terrain;
+	this->snow = snow;
+}
+
+
+/* Add a wind field to the particle velocities */
+void points::attachWind(wind_field* wind)
+{
+	this->wind = wind;
+}
+
+
+/* Uniform float in [lo, hi) from a hash */
+static inline GLfloat random_range(GLuint h, GLfloat lo, GLfloat hi)
+{
+	return lo + (hi - lo) * (GLfloat(h >> 8) * (1.f / 16777216.f));
+}
+
+
+/* Allocate the particle arrays and give each particle a random position and velocity.
+   Particle i always gets the same values for the same seed, however the work is split */
+void points::initialise()
 {
 	vertices = new glm::vec3[numpoints];
 	colours = new glm::vec3[numpoints];
 	velocity = new glm::vec3[numpoints];
 
-	/* Define random position and velocity */
-	for (int i = 0; i < numpoints; i++)
+	// Four values per particle, the seed is mixed in once so the inner loop is just the hash
+	GLuint base = random_hash(seed);
+
+	parallel_for(numpoints, parallel_chunks(numpoints, 65536), [&](size_t begin, size_t end, unsigned /*chunk*/)
 	{
-		std::random_device rd;
-		std::mt19937 gen(rd());
-		std::uniform_real_distribution<> disxz(-50.0, 50.0);
-		std::uniform_real_distribution<> disy(-50.0, 50.0);
-		std::uniform_real_distribution<> disv(-0.005, -0.00025);
+		for (size_t i = begin; i < end; i++)
+		{
+			GLuint n = base + GLuint(i) * 4u;
+			vertices[i] = glm::vec3(random_range(random_hash(n), -50.f, 50.f),
+									random_range(random_hash(n + 1u), -50.f, 50.f),
+									random_range(random_hash(n + 2u), -50.f, 50.f));
+			colours[i] = glm::vec3(1.f, 1.f, 1.f);
+			velocity[i] = glm::vec3(0.f, random_range(random_hash(n + 3u), -0.005f, -0.00025f), 0.f);
+		}
+	});
+}
 
-		vertices[i] = glm::vec3(disxz(gen), disy(gen), disxz(gen));
-		colours[i] = glm::vec3(1.f, 1.f, 1.f);
-		velocity[i] = glm::vec3(0.f, disv(gen), 0.f);
-	}
+
+void  points::create()
+{
+	initialise();
 
 	/* Create the vertex buffer object */
 	/* and the vertex buffer positions */
@@ -58,46 +125,457 @@ void  points::create()
 	glGenBuffers(1, &colour_buffer);
 	glBindBuffer(GL_ARRAY_BUFFER, colour_buffer);
 	glBufferData(GL_ARRAY_BUFFER, numpoints * sizeof(glm::vec3), colours, GL_STATIC_DRAW);
+
+	/* Element buffer for drawing in depth order, filled by sortByDepth() */
+	glGenBuffers(1, &order_buffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, order_buffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, numpoints * sizeof(GLuint), NULL, GL_STREAM_DRAW);
+
+	/* Buffers for the particles that survive culling */
+	glGenBuffers(1, &visible_vertex_buffer);
+	glGenBuffers(1, &visible_colour_buffer);
+	visible_positions.resize(numpoints);
+	visible_colours.resize(numpoints);
+	visible_index.resize(numpoints);
+
+	sort_keys.resize(numpoints);
+	sort_order.resize(numpoints);
+	sort_keys_tmp.resize(numpoints);
+	sort_order_tmp.resize(numpoints);
+}
+
+
+/* Sort the particles back to front along the view direction so that the blended
+   sprites are composited in the right order, then upload the order as an element buffer.
+   Only the view space z is needed and that comes from the third row of the modelview matrix */
+void points::sortByDepth(const glm::mat4& modelview)
+{
+	// The CPU positions are out of date while the GPU is running the simulation
+	if (gpu_simulation) return;
+
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	// Sort whichever set of particles is going to be drawn
+	const glm::vec3* positions = culling ? &visible_positions[0] : vertices;
+	GLuint count = culling ? numvisible : numpoints;
+
+	glm::vec4 zrow(modelview[0][2], modelview[1][2], modelview[2][2], modelview[3][2]);
+	parallel_for(count, parallel_chunks(count, 65536), [&](size_t begin, size_t end, unsigned /*chunk*/)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			// The furthest particles have the most negative z, so ascending order is back to front
+			GLfloat z = zrow.x * positions[i].x + zrow.y * positions[i].y + zrow.z * positions[i].z + zrow.w;
+			sort_keys[i] = float_sort_key(z);
+			sort_order[i] = GLuint(i);
+		}
+	});
+
+	radix_sort(&sort_keys[0], &sort_order[0], &sort_keys_tmp[0], &sort_order_tmp[0], count);
+
+	sort_time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, order_buffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(GLuint), &sort_order[0], GL_STREAM_DRAW);
+	pending_upload_bytes += count * sizeof(GLuint);
+	sorted = true;
+}
+
+
+/* Cull the particles against the view frustum and thin them out with distance, then
+   compact the survivors into the visible arrays and upload just those.
+   Whether a distant particle is kept depends on a fixed per-particle value, so the
+   same particles are kept from frame to frame and the thinning doesn't flicker */
+void points::cull(const glm::mat4& projection, const glm::mat4& modelview)
+{
+	if (gpu_simulation) return;
+
+	glm::mat4 mvp = projection * modelview;
+
+	// Camera position in particle coordinates, so lod_near and lod_far don't depend on the model scale
+	glm::vec3 eye = glm::vec3(glm::inverse(modelview)[3]);
+
+	// Sprites have some size so allow them to overlap the edges of the frustum slightly
+	const GLfloat margin = 1.05f;
+
+	unsigned chunks = parallel_chunks(numpoints, 65536);
+	cull_chunk_offsets.assign(chunks + 1, 0);
+
+	// Visibility test, done twice (count then copy) which is cheaper than storing flags
+	auto visible = [&](size_t i) -> bool
+	{
+		glm::vec4 clip = mvp * glm::vec4(vertices[i], 1.f);
+		if (clip.w <= 0.f) return false;
+		GLfloat limit = clip.w * margin;
+		if (clip.x < -limit || clip.x > limit || clip.y < -limit || clip.y > limit) return false;
+		if (clip.z < -clip.w || clip.z > clip.w) return false;
+
+		// Keep a fraction (lod_near / distance)^2 of the particles beyond lod_near
+		glm::vec3 d = vertices[i] - eye;
+		GLfloat dist2 = glm::dot(d, d);
+		if (dist2 <= lod_near * lod_near) return true;
+		if (dist2 >= lod_far * lod_far) return false;
+		GLfloat keep = (lod_near * lod_near) / dist2;
+		GLuint h = GLuint(i) * 2654435761u;
+		return GLfloat(h >> 8) * (1.f / 16777216.f) < keep;
+	};
+
+	parallel_for(numpoints, chunks, [&](size_t begin, size_t end, unsigned chunk)
+	{
+		GLuint n = 0;
+		for (size_t i = begin; i < end; i++) if (visible(i)) n++;
+		cull_chunk_offsets[chunk + 1] = n;
+	});
+	for (unsigned c = 0; c < chunks; c++) cull_chunk_offsets[c + 1] += cull_chunk_offsets[c];
+
+	parallel_for(numpoints, chunks, [&](size_t begin, size_t end, unsigned chunk)
+	{
+		GLuint out = cull_chunk_offsets[chunk];
+		for (size_t i = begin; i < end; i++)
+		{
+			if (!visible(i)) continue;
+			visible_positions[out] = vertices[i];
+			visible_colours[out] = colours[i];
+			visible_index[out] = GLuint(i);
+			out++;
+		}
+	});
+	numvisible = cull_chunk_offsets[chunks];
+
+	glBindBuffer(GL_ARRAY_BUFFER, visible_vertex_buffer);
+	glBufferData(GL_ARRAY_BUFFER, numvisible * sizeof(glm::vec3), &visible_positions[0], GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, visible_colour_buffer);
+	glBufferData(GL_ARRAY_BUFFER, numvisible * sizeof(glm::vec3), &visible_colours[0], GL_STREAM_DRAW);
+	pending_upload_bytes += numvisible * 2 * sizeof(glm::vec3);
 }
 
 
 void points::draw()
 {
 	/* Bind  vertices. Note that this is in attribute index 0 */
-	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	if (gpu_simulation)
+	{
+		// Draw straight from the compute shader output
+		glBindBuffer(GL_ARRAY_BUFFER, gpu_position_buffer);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), 0);
+	}
+	else
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, culling ? visible_vertex_buffer : vertex_buffer);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	}
 
 	/* Bind cube colours. Note that this is in attribute index 1 */
-	glBindBuffer(GL_ARRAY_BUFFER, colour_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, (culling && !gpu_simulation) ? visible_colour_buffer : colour_buffer);
 	glEnableVertexAttribArray(1);
 	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
 
-	/* Draw our points*/
-	glDrawArrays(GL_POINTS, 0, numpoints);
+	// Only the compacted particles are drawn when culling
+	GLuint count = (culling && !gpu_simulation) ? numvisible : numpoints;
+
+	// Everything uploaded since the last draw went into this one
+	upload_bytes = pending_upload_bytes;
+	pending_upload_bytes = 0;
+
+	/* Draw our points, in depth order if they have been sorted this frame */
+	if (sorted)
+	{
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, order_buffer);
+		glDrawElements(GL_POINTS, count, GL_UNSIGNED_INT, (GLvoid*)(0));
+		sorted = false;
+	}
+	else
+	{
+		glDrawArrays(GL_POINTS, 0, count);
+	}
 }
 
 
 void points::animate()
 {
+	if (gpu_simulation)
+	{
+		// Deposit the last step's landings, which have finished by now so reading them
+		// doesn't wait on the GPU. The snow texture is updated after animate() as before
+		if (ground && snow) depositGPUImpacts();
+
+		// One thread per particle, the state never leaves the GPU
+		glUseProgram(compute_program);
+		glUniform1ui(compute_numpointsID, numpoints);
+
+		glUniform1i(compute_uniforms.has_ground, ground != nullptr);
+		if (ground)
+		{
+			glUniform2i(compute_uniforms.terrain_size, GLint(ground->xsize), GLint(ground->zsize));
+			glUniform2f(compute_uniforms.terrain_extent, ground->width, ground->height);
+		}
+
+		glUniform1i(compute_uniforms.has_snow, snow != nullptr);
+		if (snow)
+		{
+			snow->bind(1);
+			glUniform1i(compute_uniforms.snow_depth, 1);
+			glUniform2i(compute_uniforms.snow_cells, GLint(snow->xcells), GLint(snow->zcells));
+			glUniform2f(compute_uniforms.snow_extent, snow->width, snow->height);
+		}
+
+		glUniform1i(compute_uniforms.has_wind, wind != nullptr);
+		if (wind)
+		{
+			size_t wind_bytes = size_t(wind->nx) * wind->ny * wind->nz * sizeof(glm::vec3);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, gpu_wind_buffer);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, wind_bytes, wind->velocity, GL_STREAM_DRAW);
+			pending_upload_bytes += wind_bytes;
+
+			glUniform3i(compute_uniforms.wind_cells, GLint(wind->nx), GLint(wind->ny), GLint(wind->nz));
+			glUniform3fv(compute_uniforms.wind_min, 1, &wind->box_min[0]);
+			glUniform3fv(compute_uniforms.wind_max, 1, &wind->box_max[0]);
+			glUniform3fv(compute_uniforms.wind_inv_cell, 1, &wind->inv_cell[0]);
+			glUniform1f(compute_uniforms.wind_strength, wind->strength);
+		}
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, gpu_position_buffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, gpu_velocity_buffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, gpu_height_buffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, gpu_wind_buffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, gpu_impact_buffer);
+		glDispatchCompute((numpoints + 255) / 256, 1, 1);
+
+		// Make the writes visible to the next draw and to the read back of the landings
+		glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+		return;
+	}
+
+	// Rebuild the neighbour search from this frame's positions. The update reads
+	// the copy of the positions in the hash so the threads can move the particles safely
+	if (clumping)
+	{
+		if (!neighbours) neighbours = new spatial_hash(clump_radius, numpoints);
+		neighbours->build(vertices, numpoints);
+	}
+
+	// Split the update over threads for large particle counts, each thread
+	// records its terrain impacts in its own bin
+	unsigned chunks = parallel_chunks(numpoints);
+	if (impact_bins.size() < chunks) impact_bins.resize(chunks);
+
+	parallel_for(numpoints, chunks, [this](size_t begin, size_t end, unsigned chunk)
+	{
+		std::vector<GLuint>& bin = impact_bins[chunk];
+		for (size_t i = begin; i < end; i++)
+		{
+			if (clumping)
+			{
+				// Drift towards the centre of the nearby particles (including this one)
+				glm::vec3 sum(0.f);
+				GLuint n = 0;
+				neighbours->forEachNeighbour(vertices[i], clump_radius, [&](GLuint /*j*/, const glm::vec3& q)
+				{
+					sum += q;
+					n++;
+				});
+				if (n > 1) vertices[i] += (sum / GLfloat(n) - vertices[i]) * clump_strength;
+			}
+
+			// Add velocity to the vertices 
+			vertices[i] += velocity[i];
+
+			if (wind)
+			{
+				// Blow the particle along with a lookup into the cached wind grid
+				vertices[i] += wind->sample(vertices[i]);
+
+				// Wrap around the sides so the particles don't get blown out of the scene
+				glm::vec3 size = wind->box_max - wind->box_min;
+				if (vertices[i].x < wind->box_min.x) vertices[i].x += size.x;
+				else if (vertices[i].x > wind->box_max.x) vertices[i].x -= size.x;
+				if (vertices[i].z < wind->box_min.z) vertices[i].z += size.z;
+				else if (vertices[i].z > wind->box_max.z) vertices[i].z -= size.z;
+			}
+
+			if (ground)
+			{
+				// Land on top of the terrain and any snow that has already settled there
+				GLfloat surface = ground->heightAtPosition(vertices[i].x, vertices[i].z);
+				GLuint cell = 0;
+				if (snow)
+				{
+					cell = snow->cellAtPosition(vertices[i].x, vertices[i].z);
+					surface += snow->depth[cell];
+				}
+
+				if (vertices[i].y < surface)
+				{
+					if (snow) bin.push_back(cell);
+					vertices[i].y = 20.f;
+				}
+			}
+			else
+			{
+				// Calculate distance to the origin
+				GLfloat dist = vertices[i].y;
+
+				// If we are near the origin then we introduce a new random direction
+				if (dist < 0.01f) vertices[i].y = 20.f;
+			}
+		}
+	});
+
+	// Merge this frame's impacts into the snow layer in one batch
+	if (snow) snow->deposit(impact_bins);
+
+	// Update the vertex buffer data, when culling cull() uploads just the visible particles instead
+	if (!culling)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+		glBufferData(GL_ARRAY_BUFFER, numpoints * sizeof(glm::vec3), vertices, GL_DYNAMIC_DRAW);
+		pending_upload_bytes += numpoints * sizeof(glm::vec3);
+	}
+}
+
+
+
+/* Build the compute shader and storage buffers for the GPU backend.
+   Returns false if the context doesn't support compute shaders, in which case
+   the CPU update is used */
+bool points::createGPU(GLWrapper* glw)
+{
+	if (!ogl_IsVersionGEQ(4, 3))
+	{
+		std::cout << "OpenGL 4.3 is not available, particles will be updated on the CPU" << std::endl;
+		return false;
+	}
 
-	for (int i = 0; i < numpoints; i++)
+	try
+	{
+		compute_program = glw->LoadComputeShader("..\\ASSIGNMENT_2\\code\\points_update.comp");
+	}
+	catch (std::exception& e)
 	{
-		// Add velocity to the vertices 
-		vertices[i] += velocity[i];
+		std::cout << "Caught exception: " << e.what() << std::endl;
+		return false;
+	}
+	compute_numpointsID = glGetUniformLocation(compute_program, "numpoints");
+	compute_uniforms.has_ground = glGetUniformLocation(compute_program, "has_ground");
+	compute_uniforms.terrain_size = glGetUniformLocation(compute_program, "terrain_size");
+	compute_uniforms.terrain_extent = glGetUniformLocation(compute_program, "terrain_extent");
+	compute_uniforms.has_snow = glGetUniformLocation(compute_program, "has_snow");
+	compute_uniforms.snow_depth = glGetUniformLocation(compute_program, "snow_depth");
+	compute_uniforms.snow_cells = glGetUniformLocation(compute_program, "snow_cells");
+	compute_uniforms.snow_extent = glGetUniformLocation(compute_program, "snow_extent");
+	compute_uniforms.has_wind = glGetUniformLocation(compute_program, "has_wind");
+	compute_uniforms.wind_cells = glGetUniformLocation(compute_program, "wind_cells");
+	compute_uniforms.wind_min = glGetUniformLocation(compute_program, "wind_min");
+	compute_uniforms.wind_max = glGetUniformLocation(compute_program, "wind_max");
+	compute_uniforms.wind_inv_cell = glGetUniformLocation(compute_program, "wind_inv_cell");
+	compute_uniforms.wind_strength = glGetUniformLocation(compute_program, "wind_strength");
 
-		// Calculate distance to the origin
-		GLfloat dist = vertices[i].y;
+	glGenBuffers(1, &gpu_position_buffer);
+	glGenBuffers(1, &gpu_velocity_buffer);
+	glGenBuffers(1, &gpu_height_buffer);
+	glGenBuffers(1, &gpu_wind_buffer);
+	glGenBuffers(1, &gpu_impact_buffer);
 
-		// If we are near the origin then we introduce a new random direction
-		if (dist < 0.01f) vertices[i].y = 20.f;
+	// Every storage buffer needs a data store to be bound, the wind grid gets its real one each step
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, gpu_wind_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+	uploadGPU();
+
+	return true;
+}
+
+
+/* Copy the CPU particle state into the GPU storage buffers */
+void points::uploadGPU()
+{
+	std::vector<glm::vec4> data(numpoints);
+
+	for (GLuint i = 0; i < numpoints; i++) data[i] = glm::vec4(vertices[i], 1.f);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, gpu_position_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, numpoints * sizeof(glm::vec4), &data[0], GL_DYNAMIC_COPY);
+
+	for (GLuint i = 0; i < numpoints; i++) data[i] = glm::vec4(velocity[i], 0.f);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, gpu_velocity_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, numpoints * sizeof(glm::vec4), &data[0], GL_STATIC_DRAW);
+
+	std::vector<GLfloat> heights(1, 0.f);
+	if (ground)
+	{
+		heights.resize(size_t(ground->xsize) * ground->zsize);
+		for (size_t i = 0; i < heights.size(); i++) heights[i] = ground->vertices[i].y;
 	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, gpu_height_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, heights.size() * sizeof(GLfloat), &heights[0], GL_STATIC_DRAW);
 
+	// Room for every particle to land in one step, starting with none
+	std::vector<GLuint> impacts(numpoints + 1, 0);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, gpu_impact_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, impacts.size() * sizeof(GLuint), &impacts[0], GL_DYNAMIC_READ);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
 
-	// Update the vertex buffer data
-	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
-	glBufferData(GL_ARRAY_BUFFER, numpoints * sizeof(glm::vec3), vertices, GL_DYNAMIC_DRAW);
+
+/* Deposit the snow cells the compute shader recorded landings in, in one bin as if
+   from the CPU update, and reset the count for the next step */
+void points::depositGPUImpacts()
+{
+	GLuint count = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, gpu_impact_buffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &count);
+	count = std::min(count, numpoints);
+
+	if (impact_bins.empty()) impact_bins.resize(1);
+	impact_bins[0].resize(count);
+	if (count) glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), count * sizeof(GLuint), &impact_bins[0][0]);
+
+	GLuint zero = 0;
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	snow->deposit(impact_bins);
+}
+
+
+/* Copy the GPU positions back into the CPU array */
+void points::readBackGPU()
+{
+	std::vector<glm::vec4> data(numpoints);
+
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, gpu_position_buffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, numpoints * sizeof(glm::vec4), &data[0]);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	for (GLuint i = 0; i < numpoints; i++) vertices[i] = glm::vec3(data[i]);
 }
 
 
+/* Switch between the CPU and GPU updates, carrying the particle positions across */
+bool points::setGPUSimulation(bool enable)
+{
+	if (enable == gpu_simulation) return true;
+	if (!compute_program) return false;
+
+	// The neighbour search is CPU only
+	if (enable && clumping)
+	{
+		std::cout << "GPU simulation doesn't support clumping, staying on the CPU" << std::endl;
+		return false;
+	}
 
+	if (enable)
+	{
+		uploadGPU();
+	}
+	else
+	{
+		if (ground && snow) depositGPUImpacts();
+		readBackGPU();
+		glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+		glBufferData(GL_ARRAY_BUFFER, numpoints * sizeof(glm::vec3), vertices, GL_DYNAMIC_DRAW);
+	}
+	gpu_simulation = enable;
+	return true;
+}
@@ -5,8 +5,25 @@ November 2018
 #pragma once
 
 #include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
 #include "wrapper_glfw.h"
 
+class terrain_object;
+class snow_cover;
+class wind_field;
+class spatial_hash;
+
+/* Counter based random number (PCG hash), each value only depends on its
+   input so particles can be generated in any order on any thread. Also gives
+   each particle quad its fixed size and starting angle */
+inline GLuint random_hash(GLuint x)
+{
+	GLuint state = x * 747796405u + 2891336453u;
+	GLuint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
 class points
 {
 public:
@@ -14,22 +31,95 @@ public:
 	~points();
 
 	void create();
+	void initialise();
 	void draw();
 	void animate();
 	void updateParams(GLfloat dist, GLfloat sp);
+	void attachTerrain(terrain_object* terrain, snow_cover* snow = nullptr);
+	void attachWind(wind_field* wind);
+	void sortByDepth(const glm::mat4& modelview);
+	void cull(const glm::mat4& projection, const glm::mat4& modelview);
+
+	// GPU simulation backend using a compute shader (OpenGL 4.3)
+	bool createGPU(GLWrapper* glw);
+	// Clumping needs the neighbour search on the CPU, so the switch is refused while
+	// it is on. Returns false then
+	bool setGPUSimulation(bool enable);
+	void uploadGPU();
+	void readBackGPU();
+	void depositGPUImpacts();
 
 	glm::vec3 *vertices;
 	glm::vec3 *colours;
 	glm::vec3 *velocity;
 
 	GLuint numpoints;		// Number of particles
+	GLuint seed;			// Seed for the starting positions, set before create() for a reproducible run
 	GLuint vertex_buffer;
 	GLuint colour_buffer;
+	GLuint order_buffer;	// Element buffer holding the back to front drawing order
+	GLuint visible_vertex_buffer;	// Compacted positions and colours of the particles that passed culling
+	GLuint visible_colour_buffer;
 
 	// Particle speed
 	GLfloat speed;		
 
 	// Particle max distance fomr the origin before we change direction back to the centre
 	GLfloat maxdist;	
+
+	// Optional terrain that the particles land on and the snow layer they build up
+	terrain_object* ground;
+	snow_cover* snow;
+
+	// Optional wind blowing the particles around, they wrap around the sides of its region
+	wind_field* wind;
+
+	// Clumping pulls each particle towards the centre of its neighbours within clump_radius,
+	// found with a spatial hash that is rebuilt every update
+	bool clumping;
+	GLfloat clump_radius;
+	GLfloat clump_strength;
+	spatial_hash* neighbours;
+
+	// Snow cells hit during the last update, one bin per update thread
+	std::vector<std::vector<GLuint>> impact_bins;
+
+	// When culling is set, only the particles inside the view frustum are drawn and their
+	// density falls off beyond lod_near until none are drawn past lod_far (particle space distances).
+	// The survivors are compacted so that only they are uploaded
+	bool culling;
+	GLfloat lod_near, lod_far;
+	std::vector<glm::vec3> visible_positions, visible_colours;
+	std::vector<GLuint> visible_index;		// Particle that each visible entry came from
+	std::vector<GLuint> cull_chunk_offsets;
+
+	// Counters for the last frame
+	GLuint numvisible;		// Particles drawn when culling
+	size_t upload_bytes;	// Particle data sent to the GPU for the last draw
+	size_t pending_upload_bytes;
+
+	// Draw the particles back to front using the order from the last sortByDepth()
+	bool depth_sort;
+	bool sorted;			// Set by sortByDepth() and cleared once the order has been drawn, so an old order is never used
+	double sort_time;		// Time taken by the last sort in milliseconds
+	std::vector<uint32_t> sort_keys, sort_order;
+	std::vector<uint32_t> sort_keys_tmp, sort_order_tmp;
+
+	// When gpu_simulation is set, animate() runs the compute shader and the particle state
+	// only lives in the GPU buffers. The CPU arrays are left as the reference implementation
+	bool gpu_simulation;
+	GLuint gpu_position_buffer;		// vec4 positions, used as both storage and vertex buffer
+	GLuint gpu_velocity_buffer;		// vec4 velocities
+	GLuint gpu_height_buffer;		// Terrain heights, sent by uploadGPU() as the terrain doesn't change
+	GLuint gpu_wind_buffer;			// Wind grid, sent every step as a few slices change each frame
+	GLuint gpu_impact_buffer;		// Count then the snow cells landed in, deposited at the start of the next step
+	GLuint compute_program;
+	GLuint compute_numpointsID;
+	struct
+	{
+		GLint has_ground, terrain_size, terrain_extent;
+		GLint has_snow, snow_depth, snow_cells, snow_extent;
+		GLint has_wind, wind_cells, wind_min, wind_max, wind_inv_cell, wind_strength;
+	} compute_uniforms;
 };
 
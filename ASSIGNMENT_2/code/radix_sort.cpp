@@ -0,0 +1,85 @@
+/* radix_sort.cpp
+   Parallel LSD radix sort, four passes of 8 bits.
+   Each pass counts digits per thread chunk, turns the counts into per-chunk
+   output offsets and then each chunk scatters its own keys, so no two threads
+   ever write to the same place.
+*/
+
+#include "radix_sort.h"
+#include "parallel.h"
+#include <vector>
+#include <utility>
+
+using namespace std;
+
+static const int radix_bits = 8;
+static const int radix_size = 1 << radix_bits;
+
+void radix_sort(uint32_t* keys, uint32_t* values, uint32_t* keys_tmp, uint32_t* values_tmp, size_t count)
+{
+	unsigned chunks = parallel_chunks(count, 65536);
+	vector<size_t> histogram(chunks * radix_size);
+
+	uint32_t* src_keys = keys;
+	uint32_t* src_values = values;
+	uint32_t* dst_keys = keys_tmp;
+	uint32_t* dst_values = values_tmp;
+
+	for (int shift = 0; shift < 32; shift += radix_bits)
+	{
+		// Count the digits in each chunk
+		parallel_for(count, chunks, [&](size_t begin, size_t end, unsigned chunk)
+		{
+			size_t* h = &histogram[chunk * radix_size];
+			fill(h, h + radix_size, 0);
+			for (size_t i = begin; i < end; i++)
+			{
+				h[(src_keys[i] >> shift) & (radix_size - 1)]++;
+			}
+		});
+
+		// Skip this pass if every key has the same digit, common for the high bytes
+		bool skip = false;
+		for (int d = 0; d < radix_size && !skip; d++)
+		{
+			size_t total = 0;
+			for (unsigned c = 0; c < chunks; c++) total += histogram[c * radix_size + d];
+			if (total == count) skip = true;
+		}
+		if (skip) continue;
+
+		// Turn the counts into output offsets, digits in order and chunks in order within a digit
+		size_t offset = 0;
+		for (int d = 0; d < radix_size; d++)
+		{
+			for (unsigned c = 0; c < chunks; c++)
+			{
+				size_t n = histogram[c * radix_size + d];
+				histogram[c * radix_size + d] = offset;
+				offset += n;
+			}
+		}
+
+		// Scatter each chunk to its own slots in the output
+		parallel_for(count, chunks, [&](size_t begin, size_t end, unsigned chunk)
+		{
+			size_t* h = &histogram[chunk * radix_size];
+			for (size_t i = begin; i < end; i++)
+			{
+				size_t pos = h[(src_keys[i] >> shift) & (radix_size - 1)]++;
+				dst_keys[pos] = src_keys[i];
+				dst_values[pos] = src_values[i];
+			}
+		});
+
+		swap(src_keys, dst_keys);
+		swap(src_values, dst_values);
+	}
+
+	// An odd number of passes leaves the result in the temporary arrays
+	if (src_keys != keys)
+	{
+		memcpy(keys, src_keys, count * sizeof(uint32_t));
+		memcpy(values, src_values, count * sizeof(uint32_t));
+	}
+}
@@ -0,0 +1,26 @@
+/* radix_sort.h
+   Parallel least significant digit radix sort of 32-bit keys with a 32-bit value
+   (normally an index) carried along with each key.
+   Floats can be sorted by converting them with float_sort_key() first.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+/* Map a float to an unsigned key that sorts in the same order as the float.
+   Negative floats have all their bits flipped, positive floats just the sign bit */
+inline uint32_t float_sort_key(float f)
+{
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+	uint32_t mask = (bits & 0x80000000u) ? 0xFFFFFFFFu : 0x80000000u;
+	return bits ^ mask;
+}
+
+/* Sort count keys into ascending order, moving the values with them. The sort is stable.
+   keys_tmp and values_tmp must also hold count items, the result always ends up back in
+   keys and values. Passes where every key has the same digit are skipped */
+void radix_sort(uint32_t* keys, uint32_t* values, uint32_t* keys_tmp, uint32_t* values_tmp, size_t count);
@@ -0,0 +1,145 @@
+/* snow_cover.cpp
+   Coarse snow depth heightfield built up from particle impacts.
+   The CPU copy of the depths is the master copy, the texture is refreshed one
+   dirty tile at a time with glTexSubImage2D.
+*/
+
+#include "snow_cover.h"
+#include <algorithm>
+
+using namespace std;
+
+snow_cover::snow_cover(GLuint xcells, GLuint zcells, GLfloat width, GLfloat height, GLuint tilesize)
+{
+	this->xcells = xcells;
+	this->zcells = zcells;
+	this->width = width;
+	this->height = height;
+	this->tilesize = tilesize;
+	xtiles = (xcells + tilesize - 1) / tilesize;
+	ztiles = (zcells + tilesize - 1) / tilesize;
+
+	depth_per_impact = 0.05f;
+	max_depth = 3.f;
+	impacts = 0;
+	tiles_uploaded = 0;
+	texture = 0;
+
+	depth = new GLfloat[xcells * zcells];
+	dirty.resize(xtiles * ztiles);
+	clear();
+}
+
+
+snow_cover::~snow_cover()
+{
+	delete[] depth;
+	if (texture) glDeleteTextures(1, &texture);
+}
+
+
+/* Create the depth texture. Linear filtering smooths out the coarse grid when
+   the terrain shaders sample it */
+void snow_cover::create()
+{
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, xcells, zcells, 0, GL_RED, GL_FLOAT, depth);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// Everything has just been uploaded
+	fill(dirty.begin(), dirty.end(), false);
+}
+
+
+/* Remove all snow. The whole texture is marked for upload */
+void snow_cover::clear()
+{
+	fill(depth, depth + xcells * zcells, 0.f);
+	fill(dirty.begin(), dirty.end(), true);
+}
+
+
+/* Get the snow cell for a world position, positions outside the covered
+   region are clamped to the edge cells */
+GLuint snow_cover::cellAtPosition(GLfloat x, GLfloat z)
+{
+	int cx = int(((x + width / 2.f) / width) * xcells);
+	int cz = int(((z + height / 2.f) / height) * zcells);
+	cx = max(0, min(int(xcells) - 1, cx));
+	cz = max(0, min(int(zcells) - 1, cz));
+
+	return GLuint(cz) * xcells + GLuint(cx);
+}
+
+
+/* Merge a batch of impacts into the depth grid.
+   Each bin holds the cell indices written by one particle update thread, so the
+   threads never touch the grid themselves. The bins are emptied ready for the next frame */
+void snow_cover::deposit(vector<vector<GLuint>>& bins)
+{
+	impacts = 0;
+	for (size_t b = 0; b < bins.size(); b++)
+	{
+		vector<GLuint>& bin = bins[b];
+		for (size_t i = 0; i < bin.size(); i++)
+		{
+			GLuint cell = bin[i];
+			GLfloat& d = depth[cell];
+			if (d >= max_depth) continue;
+
+			d = min(d + depth_per_impact, max_depth);
+
+			GLuint tx = (cell % xcells) / tilesize;
+			GLuint tz = (cell / xcells) / tilesize;
+			dirty[tz * xtiles + tx] = true;
+		}
+		impacts += GLuint(bin.size());
+		bin.clear();
+	}
+}
+
+
+/* Upload the tiles that have changed since the last update */
+void snow_cover::update()
+{
+	tiles_uploaded = 0;
+	glBindTexture(GL_TEXTURE_2D, texture);
+
+	// Rows of a tile are xcells apart in the depth array
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, xcells);
+
+	for (GLuint tz = 0; tz < ztiles; tz++)
+	{
+		for (GLuint tx = 0; tx < xtiles; tx++)
+		{
+			if (!dirty[tz * xtiles + tx]) continue;
+
+			GLuint x0 = tx * tilesize;
+			GLuint z0 = tz * tilesize;
+			GLuint w = min(tilesize, xcells - x0);
+			GLuint h = min(tilesize, zcells - z0);
+
+			glTexSubImage2D(GL_TEXTURE_2D, 0, x0, z0, w, h, GL_RED, GL_FLOAT, depth + z0 * xcells + x0);
+
+			dirty[tz * xtiles + tx] = false;
+			tiles_uploaded++;
+		}
+	}
+
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+
+/* Bind the depth texture to a texture unit, leaves unit 0 active */
+void snow_cover::bind(GLuint unit)
+{
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glActiveTexture(GL_TEXTURE0);
+}
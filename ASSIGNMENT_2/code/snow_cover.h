@@ -0,0 +1,41 @@
+/* snow_cover.h
+   Coarse heightfield of settled snow that builds up where particles land on the terrain.
+   Impacts are collected in per-thread bins by the particle update and merged here in
+   one batch per frame. The depths are stored in a single channel float texture that
+   the terrain shaders read, and only the tiles that changed are uploaded each frame.
+*/
+
+#pragma once
+
+#include "wrapper_glfw.h"
+#include <vector>
+
+class snow_cover
+{
+public:
+	snow_cover(GLuint xcells, GLuint zcells, GLfloat width, GLfloat height, GLuint tilesize = 16);
+	~snow_cover();
+
+	void create();
+	void deposit(std::vector<std::vector<GLuint>>& bins);
+	void update();
+	void bind(GLuint unit);
+	void clear();
+	GLuint cellAtPosition(GLfloat x, GLfloat z);
+
+	GLfloat* depth;				// Snow depth for each cell, xcells * zcells
+	std::vector<bool> dirty;	// One flag per tile, set when a cell in the tile changes
+	GLuint texture;
+
+	GLuint xcells, zcells;		// Resolution of the snow grid
+	GLuint tilesize;			// Width and height of an upload tile in cells
+	GLuint xtiles, ztiles;
+	GLfloat width, height;		// Size of the covered region in world coords (centred on the origin)
+
+	GLfloat depth_per_impact;	// Depth added to a cell each time a particle lands in it
+	GLfloat max_depth;			// Cells stop growing at this depth
+
+	// Counters for the last update
+	GLuint impacts;
+	GLuint tiles_uploaded;
+};
@@ -0,0 +1,110 @@
+/* spatial_hash.cpp
+   Parallel counting sort build for the particle spatial hash, see spatial_hash.h
+*/
+
+#include "spatial_hash.h"
+#include "parallel.h"
+#include <chrono>
+
+using namespace std;
+using namespace glm;
+
+/* The table is sized to at least twice the particle count to keep the
+   number of unrelated cells sharing a bucket low */
+spatial_hash::spatial_hash(GLfloat cell_size, GLuint max_particles)
+{
+	this->cell_size = cell_size;
+	inv_cell_size = 1.f / cell_size;
+	this->max_particles = max_particles;
+	count = 0;
+	build_time = 0;
+
+	table_size = 1024;
+	while (table_size < max_particles * 2) table_size *= 2;
+
+	cell_start = new GLuint[table_size + 1];
+	cell_cursor = new atomic<GLuint>[table_size];
+	particle_cell = new GLuint[max_particles];
+	sorted_index = new GLuint[max_particles];
+	sorted_positions = new vec3[max_particles];
+
+	for (GLuint h = 0; h <= table_size; h++) cell_start[h] = 0;
+}
+
+
+spatial_hash::~spatial_hash()
+{
+	delete[] cell_start;
+	delete[] cell_cursor;
+	delete[] particle_cell;
+	delete[] sorted_index;
+	delete[] sorted_positions;
+}
+
+
+void spatial_hash::build(const vec3* positions, GLuint count)
+{
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+
+	if (count > max_particles) count = max_particles;
+	this->count = count;
+
+	unsigned table_chunks = parallel_chunks(table_size, 65536);
+	unsigned particle_chunks = parallel_chunks(count, 16384);
+
+	// Clear the counts
+	parallel_for(table_size, table_chunks, [&](size_t begin, size_t end, unsigned /*chunk*/)
+	{
+		for (size_t h = begin; h < end; h++) cell_cursor[h].store(0, memory_order_relaxed);
+	});
+
+	// Hash each particle and count the particles in each bucket
+	parallel_for(count, particle_chunks, [&](size_t begin, size_t end, unsigned /*chunk*/)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			const vec3& p = positions[i];
+			GLuint h = hashCell(int(floor(p.x * inv_cell_size)), int(floor(p.y * inv_cell_size)), int(floor(p.z * inv_cell_size)));
+			particle_cell[i] = h;
+			cell_cursor[h].fetch_add(1, memory_order_relaxed);
+		}
+	});
+
+	// Exclusive prefix sum of the counts, first the total for each chunk of the table
+	// then each chunk fills in its own offsets starting from the sum of the chunks before it
+	vector<GLuint> chunk_sum(table_chunks + 1, 0);
+	parallel_for(table_size, table_chunks, [&](size_t begin, size_t end, unsigned chunk)
+	{
+		GLuint sum = 0;
+		for (size_t h = begin; h < end; h++) sum += cell_cursor[h].load(memory_order_relaxed);
+		chunk_sum[chunk + 1] = sum;
+	});
+	for (unsigned c = 0; c < table_chunks; c++) chunk_sum[c + 1] += chunk_sum[c];
+
+	parallel_for(table_size, table_chunks, [&](size_t begin, size_t end, unsigned chunk)
+	{
+		GLuint offset = chunk_sum[chunk];
+		for (size_t h = begin; h < end; h++)
+		{
+			GLuint n = cell_cursor[h].load(memory_order_relaxed);
+			cell_start[h] = offset;
+			cell_cursor[h].store(offset, memory_order_relaxed);
+			offset += n;
+		}
+	});
+	cell_start[table_size] = count;
+
+	// Scatter the particles into bucket order. The order within a bucket depends
+	// on the thread timing, which doesn't matter for neighbour searches
+	parallel_for(count, particle_chunks, [&](size_t begin, size_t end, unsigned /*chunk*/)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			GLuint e = cell_cursor[particle_cell[i]].fetch_add(1, memory_order_relaxed);
+			sorted_index[e] = GLuint(i);
+			sorted_positions[e] = positions[i];
+		}
+	});
+
+	build_time = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
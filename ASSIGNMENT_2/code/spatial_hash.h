@@ -0,0 +1,78 @@
+/* spatial_hash.h
+   Uniform grid spatial hash for neighbour searches between particles.
+   It is rebuilt from scratch every frame with a counting sort: count the
+   particles in each hashed cell, prefix sum the counts into cell start offsets
+   and then scatter the particle indices and positions into cell order.
+   Queries look at the 27 cells around a point, so the search radius should be
+   no bigger than the cell size.
+*/
+
+#pragma once
+
+#include "wrapper_glfw.h"
+#include <glm/glm.hpp>
+#include <atomic>
+#include <cmath>
+
+class spatial_hash
+{
+public:
+	spatial_hash(GLfloat cell_size, GLuint max_particles);
+	~spatial_hash();
+
+	void build(const glm::vec3* positions, GLuint count);
+
+	/* Call fn(index, position) for every particle within radius of p.
+	   Returns the number of particles that were looked at, including the ones
+	   rejected by the distance test */
+	template <typename Func>
+	GLuint forEachNeighbour(const glm::vec3& p, GLfloat radius, Func fn) const
+	{
+		int cx = int(std::floor(p.x * inv_cell_size));
+		int cy = int(std::floor(p.y * inv_cell_size));
+		int cz = int(std::floor(p.z * inv_cell_size));
+		GLfloat r2 = radius * radius;
+		GLuint visited = 0;
+
+		// Two of the 27 cells can hash to the same bucket, only visit each bucket once
+		GLuint seen[27];
+		int numseen = 0;
+
+		for (int z = cz - 1; z <= cz + 1; z++)
+		for (int y = cy - 1; y <= cy + 1; y++)
+		for (int x = cx - 1; x <= cx + 1; x++)
+		{
+			GLuint h = hashCell(x, y, z);
+			bool duplicate = false;
+			for (int s = 0; s < numseen; s++) if (seen[s] == h) duplicate = true;
+			if (duplicate) continue;
+			seen[numseen++] = h;
+
+			for (GLuint e = cell_start[h]; e < cell_start[h + 1]; e++)
+			{
+				glm::vec3 d = sorted_positions[e] - p;
+				visited++;
+				if (glm::dot(d, d) <= r2) fn(sorted_index[e], sorted_positions[e]);
+			}
+		}
+		return visited;
+	}
+
+	inline GLuint hashCell(int x, int y, int z) const
+	{
+		return ((GLuint(x) * 73856093u) ^ (GLuint(y) * 19349663u) ^ (GLuint(z) * 83492791u)) & (table_size - 1);
+	}
+
+	GLfloat cell_size, inv_cell_size;
+	GLuint table_size;			// Number of hash buckets, a power of two
+	GLuint count;				// Number of particles in the last build
+	GLuint max_particles;
+
+	GLuint* cell_start;					// table_size + 1 offsets into the sorted arrays
+	std::atomic<GLuint>* cell_cursor;	// Per bucket counts and then write cursors during the build
+	GLuint* particle_cell;				// Bucket of each particle
+	GLuint* sorted_index;				// Particle indices in bucket order
+	glm::vec3* sorted_positions;		// Copy of the positions in bucket order
+
+	double build_time;			// Time taken by the last build in milliseconds
+};
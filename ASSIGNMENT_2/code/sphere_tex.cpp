@@ -7,6 +7,7 @@
 */
 
 #include "sphere_tex.h"
+#include "mesh_optimize.h"
 
 /* I don't like using namespaces in header files but have less issues with them in
 seperate cpp files */
@@ -30,6 +31,7 @@ Sphere::Sphere(bool useTexture)
 	sphereColours = 0;
 	sphereTexCoords = 0;
 	elementbuffer = 0;
+	numindices = 0;
 	
 	// Turn texture off if you're not handling texture coordinates in your shaders
 	enableTexture = useTexture;
@@ -58,6 +60,7 @@ void Sphere::makeSphere(GLuint numlats, GLuint numlongs)
 	GLfloat* pTexCoords = new GLfloat[numvertices * 2];
 	GLfloat* pColours = new GLfloat[numvertices * 4];
 	makeUnitSphere(pVertices, pTexCoords);
+	bounds = compute_bounds(pVertices, numvertices);
 
 	/* Define colours as the x,y,z components of the sphere vertices */
 	for (i = 0; i < numvertices; i++)
@@ -68,37 +71,9 @@ void Sphere::makeSphere(GLuint numlats, GLuint numlongs)
 		pColours[i * 4 + 3] = 1.f;
 	}
 
-	/* Generate the vertex buffer object */
-	glGenBuffers(1, &sphereBufferObject);
-	glBindBuffer(GL_ARRAY_BUFFER, sphereBufferObject);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)* numvertices * 3, pVertices, GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	/* Store the normals in a buffer object */
-	glGenBuffers(1, &sphereNormals);
-	glBindBuffer(GL_ARRAY_BUFFER, sphereNormals);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)* numvertices * 3, pVertices, GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	/* Store the colours in a buffer object */
-	glGenBuffers(1, &sphereColours);
-	glBindBuffer(GL_ARRAY_BUFFER, sphereColours);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)* numvertices * 4, pColours, GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	/* Store the texture coords in a buffer object */
-	/* Create the texture coordinate  buffer for the cube */
-	if (enableTexture)
-	{
-		glGenBuffers(1, &sphereTexCoords);
-		glBindBuffer(GL_ARRAY_BUFFER, sphereTexCoords);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)* numvertices * 2, pTexCoords, GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-	}
-
 	/* Calculate the number of indices in our index array and allocate memory for it */
-	GLuint numindices = ((numlongs * 2)) * (numlats - 2) + ((numlongs + 1) * 2);
-	GLuint* pindices = new GLuint[numindices];
+	GLuint numstripindices = ((numlongs * 2)) * (numlats - 2) + ((numlongs + 1) * 2);
+	GLuint* pindices = new GLuint[numstripindices];
 
 	// fill "indices" to define triangle strips
 	GLuint index = 0;		// Current index
@@ -126,10 +101,85 @@ void Sphere::makeSphere(GLuint numlats, GLuint numlongs)
 		pindices[index++] = i;
 	}
 
+	/* Turn the fans and strips into a list of triangles so that they can be put in vertex
+	   cache order and drawn with one call. Every other triangle in a strip is wound the
+	   other way round, as OpenGL does when it draws the strip */
+	vector<GLuint> triangles;
+	GLuint fan_end = numlongs + 1;
+	for (i = 1; i + 1 < fan_end; i++)
+	{
+		triangles.insert(triangles.end(), { pindices[0], pindices[i], pindices[i + 1] });
+	}
+	GLuint strip_start = fan_end;
+	for (j = 0; j < numlats - 2; j++)
+	{
+		for (i = 0; i + 2 < numlongs * 2; i++)
+		{
+			GLuint a = pindices[strip_start + i], b = pindices[strip_start + i + 1], c = pindices[strip_start + i + 2];
+			if (i % 2 == 0)
+				triangles.insert(triangles.end(), { a, b, c });
+			else
+				triangles.insert(triangles.end(), { b, a, c });
+		}
+		strip_start += numlongs * 2;
+	}
+	for (i = 1; i + 1 < numlongs + 1; i++)
+	{
+		triangles.insert(triangles.end(), { pindices[strip_start], pindices[strip_start + i], pindices[strip_start + i + 1] });
+	}
+
+	vertex_cache_stats before = analyze_vertex_cache(&triangles[0], triangles.size(), numvertices, sizeof(GLfloat) * 3);
+	optimize_vertex_cache(&triangles[0], triangles.size(), numvertices);
+	optimize_overdraw(&triangles[0], triangles.size(), pVertices, numvertices);
+
+	// Put the vertices in the order they are first used
+	vector<GLuint> remap;
+	GLuint used = optimize_vertex_fetch(&triangles[0], triangles.size(), numvertices, remap);
+	vector<GLfloat> vertices(pVertices, pVertices + numvertices * 3);
+	vector<GLfloat> texcoords(pTexCoords, pTexCoords + numvertices * 2);
+	vector<GLfloat> colours(pColours, pColours + numvertices * 4);
+	remap_vertices(vertices, 3, remap, used);
+	remap_vertices(texcoords, 2, remap, used);
+	remap_vertices(colours, 4, remap, used);
+	numvertices = used;
+	numspherevertices = used;
+	numindices = GLuint(triangles.size());
+
+	vertex_cache_stats after = analyze_vertex_cache(&triangles[0], triangles.size(), numvertices, sizeof(GLfloat) * 3);
+	print_vertex_cache_stats("sphere", before, after);
+
+	/* Generate the vertex buffer object */
+	glGenBuffers(1, &sphereBufferObject);
+	glBindBuffer(GL_ARRAY_BUFFER, sphereBufferObject);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)* numvertices * 3, &vertices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	/* Store the normals in a buffer object */
+	glGenBuffers(1, &sphereNormals);
+	glBindBuffer(GL_ARRAY_BUFFER, sphereNormals);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)* numvertices * 3, &vertices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	/* Store the colours in a buffer object */
+	glGenBuffers(1, &sphereColours);
+	glBindBuffer(GL_ARRAY_BUFFER, sphereColours);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)* numvertices * 4, &colours[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	/* Store the texture coords in a buffer object */
+	/* Create the texture coordinate  buffer for the cube */
+	if (enableTexture)
+	{
+		glGenBuffers(1, &sphereTexCoords);
+		glBindBuffer(GL_ARRAY_BUFFER, sphereTexCoords);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)* numvertices * 2, &texcoords[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
 	// Generate a buffer for the indices
 	glGenBuffers(1, &elementbuffer);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, numindices * sizeof(GLuint), pindices, GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, numindices * sizeof(GLuint), &triangles[0], GL_STATIC_DRAW);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 	delete [] pTexCoords;
@@ -195,8 +245,6 @@ void Sphere::makeUnitSphere(GLfloat *pVertices, GLfloat *pTexCoords)
 /* Draws the sphere form the previously defined vertex and index buffers */
 void Sphere::drawSphere(int drawmode)
 {
-	GLuint i;
-
 	/* Draw the vertices as GL_POINTS */
 	glBindBuffer(GL_ARRAY_BUFFER, sphereBufferObject);
 	glVertexAttribPointer(attribute_v_coord, 3, GL_FLOAT, GL_FALSE, 0, 0);
@@ -240,22 +288,7 @@ void Sphere::drawSphere(int drawmode)
 		/* Bind the indexed vertex buffer */
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
 
-		/* Draw the north pole regions as a triangle  */
-		glDrawElements(GL_TRIANGLE_FAN, numlongs + 1, GL_UNSIGNED_INT, (GLvoid*)(0));
-
-		/* Calculate offsets into the indexed array. Note that we multiply offsets by 4
-		because it is a memory offset the indices are type GLuint which is 4-bytes */
-		GLuint lat_offset_jump = (numlongs * 2);
-		GLuint lat_offset_start = numlongs + 1;
-		GLuint lat_offset_current = lat_offset_start * 4;
-
-		/* Draw the triangle strips of latitudes */
-		for (i = 0; i < numlats - 2; i++)
-		{
-			glDrawElements(GL_TRIANGLE_STRIP, numlongs * 2, GL_UNSIGNED_INT, (GLvoid*)(lat_offset_current));
-			lat_offset_current += (lat_offset_jump * 4);
-		}
-		/* Draw the south pole as a triangle fan */
-		glDrawElements(GL_TRIANGLE_FAN, numlongs + 1, GL_UNSIGNED_INT, (GLvoid*)(lat_offset_current));
+		/* Draw the fans and strips, now one list of triangles */
+		glDrawElements(GL_TRIANGLES, numindices, GL_UNSIGNED_INT, (GLvoid*)(0));
 	}
 }
\ No newline at end of file
@@ -7,6 +7,7 @@
 #pragma once
 
 #include "wrapper_glfw.h"
+#include "bounds.h"
 #include <vector>
 #include <glm/glm.hpp>
 
@@ -32,11 +33,14 @@ public:
 	GLuint attribute_v_texcoord;
 
 	unsigned int numspherevertices;
+	unsigned int numindices;
 	unsigned int numlats;
 	unsigned int numlongs;
 	unsigned int drawmode;
 	bool enableTexture;
 
+	bounding_volume bounds;		// Model space, set by makeSphere()
+
 private:
 	void makeUnitSphere(GLfloat *pVertices, GLfloat *pTexCoords);
 };
@@ -1,10 +1,20 @@
 // Minimal fragment shader
+// Blends in the settled snow cover
 
 #version 400
 
 in vec4 fcolour;
+in vec2 fsnowcoord;
 out vec4 outputColor;
+
+uniform sampler2D snowcover;
+
+// Depth at which the ground is completely covered
+const float snow_full = 0.5;
+const vec4 snow_colour = vec4(0.95, 0.95, 1.0, 1.0);
+
 void main()
 {
-	outputColor = fcolour;
-}
\ No newline at end of file
+	float snow = texture(snowcover, fsnowcoord).r;
+	outputColor = mix(fcolour, snow_colour * fcolour.a, clamp(snow / snow_full, 0.0, 1.0));
+}
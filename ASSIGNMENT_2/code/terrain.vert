@@ -11,8 +11,13 @@ layout(location = 2) in vec3 normal;
 uniform mat4 model, view, projection;
 uniform uint colourmode;
 
+// Settled snow depth over the terrain region, terrainsize is the world size of that region
+uniform sampler2D snowcover;
+uniform vec2 terrainsize;
+
 // Output the vertex colour - to be rasterized into pixel fragments
 out vec4 fcolour;
+out vec2 fsnowcoord;
 vec4 ambient = vec4(0.2, 0.2,0.2,1.0);
 vec3 light_dir = vec3(0.0, 0.0, 10.0);
 
@@ -22,6 +27,10 @@ void main()
 	vec4 diffuse_colour = vec4(colour,1.0);
 	vec4 position_h = vec4(position, 1.0);
 	float shininess = 8.0;
+
+	// Raise the terrain by the depth of snow that has settled on it
+	fsnowcoord = position.xz / terrainsize + 0.5;
+	position_h.y += textureLod(snowcover, fsnowcoord, 0.0).r;
 	
 	// Set colours based on height in vertex terrain
 	if (colourmode == 0)
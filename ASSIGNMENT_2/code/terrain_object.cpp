@@ -10,6 +10,7 @@
 */
 
 #include "terrain_object.h"
+#include "mesh_optimize.h"
 #include <glm/gtc/noise.hpp>
 #include "glm/gtc/random.hpp"
 #include <stdio.h>
@@ -32,6 +33,9 @@ terrain_object::terrain_object(int octaves, GLfloat freq, GLfloat scale)
 	perlin_freq = freq;
 	perlin_scale = scale;
 	height_scale = 1.f;
+	cluster_culling = true;
+	clusters_culled = false;
+	cluster_stats.clear();
 }
 
 
@@ -44,31 +48,75 @@ terrain_object::~terrain_object()
 }
 
 
-/* Copy the vertices, normals and element indices into vertex buffers */
+/* Copy the vertices, normals and element indices into vertex buffers.
+   The triangle strips are turned into a list of triangles that is put in vertex cache
+   order, and the uploaded vertices are put in the order that list first uses them.
+   The vertices, normals and colours arrays stay in grid order for heightAtPosition() */
 void terrain_object::createObject()
 {
+	/* Every other triangle in a strip is wound the other way round, as OpenGL does
+	   when it draws the strip. The strips are clockwise seen from above (see
+	   calculateNormals()) so the list is turned round to be anticlockwise, which the
+	   meshlet normal cones expect. Nothing is culled by OpenGL so this doesn't show */
+	triangles.clear();
+	for (GLuint x = 0; x < xsize - 1; x++)
+	{
+		GLuint strip = x * zsize * 2;
+		for (GLuint tri = 0; tri < zsize * 2 - 2; tri++)
+		{
+			GLuint v1 = elements[strip + tri], v2 = elements[strip + tri + 1], v3 = elements[strip + tri + 2];
+			if (tri % 2 == 0)
+				triangles.insert(triangles.end(), { v1, v3, v2 });
+			else
+				triangles.insert(triangles.end(), { v1, v2, v3 });
+		}
+	}
+
+	GLuint numvertices = xsize * zsize;
+	vertex_cache_stats before = analyze_vertex_cache(&triangles[0], triangles.size(), numvertices, sizeof(vec3));
+	optimize_vertex_cache(&triangles[0], triangles.size(), numvertices);
+	optimize_overdraw(&triangles[0], triangles.size(), &vertices[0].x, numvertices);
+
+	vector<GLuint> remap;
+	GLuint used = optimize_vertex_fetch(&triangles[0], triangles.size(), numvertices, remap);
+	vector<vec3> upload_vertices(vertices, vertices + numvertices);
+	vector<vec3> upload_colours(colours, colours + numvertices);
+	vector<vec3> upload_normals(normals, normals + numvertices);
+	remap_vertices(upload_vertices, 1, remap, used);
+	remap_vertices(upload_colours, 1, remap, used);
+	remap_vertices(upload_normals, 1, remap, used);
+
+	vertex_cache_stats after = analyze_vertex_cache(&triangles[0], triangles.size(), used, sizeof(vec3));
+	print_vertex_cache_stats("terrain", before, after);
+
+	bounds = compute_bounds(&upload_vertices[0].x, used);
+
+	meshlets.clear();
+	material_range whole = { 0, GLuint(triangles.size()), -1 };
+	build_meshlets(&triangles[0], &whole, 1, &upload_vertices[0].x, used, meshlets);
+
 	/* Generate the vertex buffer object */
 	glGenBuffers(1, &vbo_mesh_vertices);
 	glBindBuffer(GL_ARRAY_BUFFER, vbo_mesh_vertices);
-	glBufferData(GL_ARRAY_BUFFER, xsize * zsize  * sizeof(vec3), &(vertices[0]), GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, used * sizeof(vec3), &(upload_vertices[0]), GL_STATIC_DRAW);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 	/* Store the colours in a buffer object */
 	glGenBuffers(1, &vbo_mesh_colours);
 	glBindBuffer(GL_ARRAY_BUFFER, vbo_mesh_colours);
-	glBufferData(GL_ARRAY_BUFFER, xsize * zsize * sizeof(vec3), &(colours[0]), GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, used * sizeof(vec3), &(upload_colours[0]), GL_STATIC_DRAW);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 	/* Store the normals in a buffer object */
 	glGenBuffers(1, &vbo_mesh_normals);
 	glBindBuffer(GL_ARRAY_BUFFER, vbo_mesh_normals);
-	glBufferData(GL_ARRAY_BUFFER, xsize * zsize * sizeof(vec3), &(normals[0]), GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, used * sizeof(vec3), &(upload_normals[0]), GL_STATIC_DRAW);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 	// Generate a buffer for the indices
 	glGenBuffers(1, &ibo_mesh_elements);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_mesh_elements);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, elements.size()* sizeof(GLuint), &(elements[0]), GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, triangles.size()* sizeof(GLuint), &(triangles[0]), GL_STATIC_DRAW);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 }
@@ -125,15 +173,37 @@ void terrain_object::drawObject(int drawmode)
 	else
 		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
-	/* Draw the triangle strips */
-	for (GLuint i = 0; i < xsize - 1; i++)
+	/* Draw the triangle strips, now one list of triangles, or the meshlets that
+	   cull() found to be visible */
+	if (clusters_culled)
+	{
+		if (!visible_counts.empty())
+			glMultiDrawElements(GL_TRIANGLES, &visible_counts[0], GL_UNSIGNED_INT, &visible_offsets[0], GLsizei(visible_counts.size()));
+		clusters_culled = false;
+	}
+	else
 	{
-		GLuint location = sizeof(GLuint) * (i * zsize * 2);
-		glDrawElements(GL_TRIANGLE_STRIP, zsize * 2, GL_UNSIGNED_INT, (GLvoid*)(location));
+		glDrawElements(GL_TRIANGLES, GLsizei(triangles.size()), GL_UNSIGNED_INT, (GLvoid*)(0));
 	}
 }
 
 
+/* Find the visible meshlets for the next drawObject(), see meshlet.h */
+void terrain_object::cull(const mat4& modelview, const mat4& projection)
+{
+	clusters_culled = false;
+	cluster_stats.clear();
+	if (!cluster_culling || meshlets.empty()) return;
+
+	cluster_view view;
+	view.set(modelview, projection);
+	visible_counts.clear();
+	visible_offsets.clear();
+	cull_meshlets(&meshlets[0], GLuint(meshlets.size()), view, visible_counts, visible_offsets, cluster_stats);
+	clusters_culled = true;
+}
+
+
 /* Define the terrian heights */
 /* Uses code adapted from OpenGL Shading Language Cookbook: Chapter 8 */
 void terrain_object::calculateNoise()
@@ -10,6 +10,8 @@
 #pragma once
 
 #include "wrapper_glfw.h"
+#include "bounds.h"
+#include "meshlet.h"
 #include <vector>
 #include <glm/glm.hpp>
 
@@ -33,10 +35,23 @@ public:
 	void createObject();
 	void drawObject(int drawmode);
 
+	// Meshlets of the triangle list, built by createObject(). cull() tests them against
+	// the view and the next drawObject() draws only the visible ones
+	void cull(const glm::mat4& modelview, const glm::mat4& projection);
+	bool cluster_culling;
+	cluster_cull_stats cluster_stats;
+	std::vector<meshlet> meshlets;
+	std::vector<GLsizei> visible_counts;
+	std::vector<const void*> visible_offsets;
+	bool clusters_culled;
+
+	bounding_volume bounds;		// Model space, set by createObject() from the heights at that time
+
 	glm::vec3 *vertices;
 	glm::vec3 *normals;
 	glm::vec3 *colours;
-	std::vector<GLuint> elements;
+	std::vector<GLuint> elements;		// Triangle strips, one for each row of the grid
+	std::vector<GLuint> triangles;		// The strips as a triangle list in vertex cache order, with the uploaded vertex numbering
 	GLfloat* noise;
 
 	GLuint vbo_mesh_vertices;
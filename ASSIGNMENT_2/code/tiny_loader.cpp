@@ -8,8 +8,20 @@ Iain Martin November 2018
 
 #include "wrapper_glfw.h"
 #include "tiny_loader.h"
+#include "mesh_cache.h"
+#include "mesh_simplify.h"
+#include "mesh_optimize.h"
+#include "meshlet.h"
+#include "mesh_codec.h"
 #include <iostream>
 #include <stdio.h>
+#include <cstring>
+#include <cstddef>
+#include <chrono>
+#include <algorithm>
+
+// Declares the tinyobj types, so it has to come before the implementation below
+#include "obj_parser.h"
 
 //Tinyobjloader library used to import models
 #ifndef TINYOBJLOADER_IMPLEMENTATION
@@ -25,6 +37,11 @@ static  void PrintInfo(const tinyobj::attrib_t& attrib,
 	const vector<tinyobj::shape_t>& shapes,
 	const vector<tinyobj::material_t>& materials); 
 
+// Build the arrays that are uploaded from the parsed obj file
+static void BuildMesh(const tinyobj::attrib_t& attrib,
+	const vector<tinyobj::shape_t>& shapes,
+	const vector<tinyobj::material_t>& materials, mesh_data& mesh);
+
 TinyObjLoader::TinyObjLoader()
 {
 	attribute_v_coord = 0;
@@ -35,22 +52,108 @@ TinyObjLoader::TinyObjLoader()
 	numVertices = 0;
 	numNormals = 0;
 	numTexCoords = 0;
+
+	vertexArrayObject = 0;
+	vertexBufferObject = 0;
+	elementBufferObject = 0;
+	colourOverridden = false;
+	draw_calls = 0;
+	texture_binds = 0;
+
+	parallel_parse = true;
+	generate_lods = true;
+	optimize_indices = true;
+	cluster_culling = true;
+	quantize_attributes = true;
+	compress_cache = true;
+	quantized = false;
+	vertex_bytes = 0;
+	decode_program = 0;
+	quantizedID = position_offsetID = position_scaleID = texcoord_transformID = -1;
+	clusters_culled = false;
+	cluster_stats.clear();
+	use_lod = true;
+	lod_pixel_error = 1.f;
+	current_lod = 0;
+	triangles_drawn = 0;
+	use_cache = true;
+	loaded_from_cache = false;
+	load_time = 0;
 }
 
 TinyObjLoader::~TinyObjLoader()
 {
+	if (vertexArrayObject)
+	{
+		glDeleteVertexArrays(1, &vertexArrayObject);
+		glDeleteBuffers(1, &vertexBufferObject);
+		glDeleteBuffers(1, &elementBufferObject);
+	}
 }
 
 
 void TinyObjLoader::load_obj(string inputfile, bool debugPrint)
 {
+	prepared_mesh prepared;
+	prepare(inputfile, prepared, debugPrint);
+	if (!finish(prepared)) exit(1);
+}
+
+
+uint32_t TinyObjLoader::cacheOptions() const
+{
+	return (generate_lods ? MESH_CACHE_LODS : 0) | (optimize_indices ? MESH_CACHE_OPTIMIZED : 0)
+		| ((compress_cache && quantize_attributes) ? MESH_CACHE_COMPRESSED : 0);
+}
+
+
+/* Everything in loading a mesh up to the upload. Only reads the settings of the
+   object, so it can run on another thread while the object is being drawn */
+void TinyObjLoader::prepare(const string& inputfile, prepared_mesh& out, bool debugPrint, bool read_cache) const
+{
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	out.inputfile = inputfile;
+	out.debugPrint = debugPrint;
+	out.ok = false;
+	out.from_cache = false;
+	out.cache.close();
+	out.mesh = mesh_data();
+
+	// Use the binary cache from an earlier run if the OBJ hasn't changed since
+	uint32_t cache_options = cacheOptions();
+	string cache_path = mesh_cache::cachePath(inputfile, cache_options);
+	if (use_cache && read_cache)
+	{
+		if (out.cache.open(cache_path, inputfile, cache_options))
+		{
+			out.ok = out.from_cache = true;
+			out.prepare_time = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+			return;
+		}
+		cout << "Mesh cache not used for " << inputfile << ": " << out.cache.reason << endl;
+	}
+
 	tinyobj::attrib_t attrib;
 	vector<tinyobj::shape_t> shapes;
 	vector<tinyobj::material_t> materials;
 
 
 	string err, warn;
-	bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, &warn, inputfile.c_str());
+	bool ret;
+	if (parallel_parse)
+	{
+		obj_parse_stats stats;
+		ret = load_obj_parallel(inputfile, &attrib, &shapes, &materials, &warn, &err, &stats);
+		if (ret)
+		{
+			cout << "Parsed " << inputfile << " (" << stats.bytes / 1024 << " KB) in " << stats.chunks << " chunks: read "
+				<< stats.read_time << " ms, parse " << stats.parse_time << " ms, merge " << stats.merge_time << " ms" << endl;
+		}
+	}
+	else
+	{
+		ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, &warn, inputfile.c_str());
+	}
 
 	if (!err.empty()) { // `err` may contain error messages.
 		cerr << err << endl;
@@ -61,47 +164,142 @@ void TinyObjLoader::load_obj(string inputfile, bool debugPrint)
 	}
 
 	if (!ret) {
-		exit(1);
+		return;
 	}
 
-	numVertices = attrib.vertices.size() / 3;
-	numNormals = attrib.normals.size() / 3;
-	numTexCoords = attrib.texcoords.size() / 2;
-
 	// Sanity checks
-	if (numVertices <= 0)
+	if (attrib.vertices.size() == 0)
 	{
 		cout << "Warning: there were no vertices in this Obj file." << endl;
 	}
 
-	if (numNormals <= 0)
+	if (attrib.normals.size() == 0)
 	{
-		cout << "Warning: there were no normals in this Obj file. " << endl;
-		cout << "\tEither create an Obj file with normals or add code to calculate the normals. " << endl;
+		cout << "Warning: there were no normals in this Obj file, they will be generated. " << endl;
 	}
 
-	vector<tinyobj::real_t> pVertices = attrib.vertices;
-	vector<tinyobj::real_t> pNormals = attrib.normals;
-	vector<tinyobj::real_t> pColors = attrib.colors;
-	vector<tinyobj::real_t> pTexCoords = attrib.texcoords;
+	// Debug print if requested to
+	if (debugPrint)	PrintInfo(attrib, shapes, materials);
 
-	// Create an array of normals, the same size as the vertices so that we can
-	// define one normal per vertex to copy into the VBOs
-	vector<tinyobj::real_t> pNormals_per_vertex;
-	pNormals_per_vertex.resize(pVertices.size());
+	cout << "Read " << inputfile << ": " << shapes.size() << " shapes, " << attrib.vertices.size() / 3 << " vertices" << endl;
 
-	numPIndexes = 0;
-	for (size_t s = 0; s < shapes.size(); s++) {
-		numPIndexes += shapes[s].mesh.num_face_vertices.size() * 3;//3 vertexes for each face
+	mesh_data& mesh = out.mesh;
+	BuildMesh(attrib, shapes, materials, mesh);
+
+	if (generate_lods)
+	{
+		chrono::high_resolution_clock::time_point lod_start = chrono::high_resolution_clock::now();
+		build_lod_chain(mesh);
+		cout << "Built " << mesh.lods.size() << " levels of detail in "
+			<< chrono::duration<double, milli>(chrono::high_resolution_clock::now() - lod_start).count() << " ms:";
+		for (size_t l = 0; l < mesh.lods.size(); l++) cout << " " << mesh.lods[l].num_indices / 3;
+		cout << " triangles" << endl;
 	}
-	GLuint* pIndices = new GLuint[numPIndexes];
-	
-	// Debug print if requested to
-	if (debugPrint)	PrintInfo(attrib, shapes, materials);
 
-	cout << shapes.size() << endl;
-	cout << attrib.vertices.size() << endl;
-	int ind = 0;
+	if (optimize_indices && !mesh.indices.empty())
+	{
+		vertex_cache_stats before = analyze_vertex_cache(&mesh.indices[0], mesh.lods[0].num_indices, mesh.numVertices(), sizeof(mesh_vertex));
+		optimize_mesh(mesh);
+		vertex_cache_stats after = analyze_vertex_cache(&mesh.indices[0], mesh.lods[0].num_indices, mesh.numVertices(), sizeof(mesh_vertex));
+		print_vertex_cache_stats(inputfile.c_str(), before, after);
+	}
+
+	// After the reordering, as a meshlet is a run of the final index order
+	if (!mesh.indices.empty())
+	{
+		build_meshlets(&mesh.indices[0], &mesh.ranges[0], GLuint(mesh.ranges.size()), &mesh.positions[0], mesh.numVertices(), mesh.meshlets);
+		cout << "Built " << mesh.meshlets.size() << " meshlets" << endl;
+	}
+
+	out.ok = true;
+	out.prepare_time = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+	if (use_cache && !mesh_cache::write(cache_path, inputfile, mesh.view(), cache_options))
+	{
+		cout << "Warning: could not write the mesh cache " << cache_path << endl;
+	}
+}
+
+
+bool TinyObjLoader::finish(prepared_mesh& prepared)
+{
+	if (!prepared.ok) return false;
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+
+	if (prepared.from_cache)
+	{
+		if (upload(prepared.cache.view))
+		{
+			loaded_from_cache = true;
+			load_time = prepared.prepare_time + chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+			cout << "Loaded " << mesh_cache::cachePath(prepared.inputfile, cacheOptions()) << " in " << load_time << " ms"
+				<< (prepared.cache.rehashed ? " (source file time changed, contents checked)" : "") << endl;
+			prepared.cache.close();
+			return true;
+		}
+
+		// Parse the obj file after all, which also writes a good cache over the corrupt one
+		cout << "Mesh cache not used for " << prepared.inputfile << ": compressed mesh data is corrupt" << endl;
+		string inputfile = prepared.inputfile;
+		prepare(inputfile, prepared, prepared.debugPrint, false);
+		if (!prepared.ok) return false;
+		start = chrono::high_resolution_clock::now();
+	}
+
+	upload(prepared.mesh.view());
+	loaded_from_cache = false;
+	cout << materials.size() << " materials in " << lods[0].num_ranges << " index ranges, " << lod_batches[0].size() << " draw batches" << endl;
+	if (quantized) cout << "Vertex buffer " << vertex_bytes / 1024 << " KB quantized, " << numVertices * sizeof(mesh_vertex) / 1024 << " KB as floats" << endl;
+	load_time = prepared.prepare_time + chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+	return true;
+}
+
+
+/* Turn the parsed OBJ into the arrays that are uploaded. Each distinct
+   (position, normal, texcoord) index triple used by a face corner becomes one
+   vertex, found with an open addressing hash table, so corners that share all
+   three share a vertex and corners on hard edges or UV seams get their own.
+   When the file has no normals they are generated, and the smoothing group takes
+   the place of the normal index in the triple so vertices split where the
+   smoothing groups change */
+static void BuildMesh(const tinyobj::attrib_t& attrib, const vector<tinyobj::shape_t>& shapes,
+	const vector<tinyobj::material_t>& materials, mesh_data& mesh)
+{
+	GLuint nv = GLuint(attrib.vertices.size() / 3);
+	bool has_normals = attrib.normals.size() > 0;
+	bool has_texcoords = attrib.texcoords.size() > 0;
+	bool has_colours = attrib.colors.size() == nv * 3;
+
+	// Without vertex colours each vertex takes the diffuse colour of its material, so
+	// a corner shared by faces with different materials has to become two vertices
+	bool material_colours = !has_colours && !materials.empty();
+
+	// Smoothing group 0 ("s off") is flat shading, so every face gets its own normal.
+	// Files without any smoothing groups at all, like most scans, are smoothed all over
+	bool generate_normals = !has_normals;
+	bool any_smoothing = false;
+	for (size_t s = 0; s < shapes.size() && generate_normals && !any_smoothing; s++)
+	{
+		const vector<unsigned int>& ids = shapes[s].mesh.smoothing_group_ids;
+		any_smoothing = find_if(ids.begin(), ids.end(), [](unsigned int id) { return id != 0; }) != ids.end();
+	}
+	GLint face_number = 0;
+
+	size_t numIndices = 0;
+	for (size_t s = 0; s < shapes.size(); s++) {
+		numIndices += shapes[s].mesh.num_face_vertices.size() * 3;//3 vertexes for each face
+	}
+	mesh.indices.reserve(numIndices);
+	vector<GLint> triangle_materials;
+	triangle_materials.reserve(numIndices / 3);
+
+	// Hash table of the vertices made so far, at most half full
+	size_t table_size = 1024;
+	while (table_size < numIndices * 2) table_size *= 2;
+	vector<GLuint> table(table_size, GLuint(-1));
+	vector<tinyobj::index_t> keys;		// Index triple of each new vertex
+	vector<GLint> key_materials;		// and its material when material_colours is set
+	keys.reserve(nv);
 
 	// Loop over shapes
 	for (size_t s = 0; s < shapes.size(); s++) {
@@ -109,95 +307,433 @@ void TinyObjLoader::load_obj(string inputfile, bool debugPrint)
 		// Loop over faces(polygon)
 		size_t index_offset = 0;
 		for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
-	
+
 			int fv = shapes[s].mesh.num_face_vertices[f];//number of vertices per face
+			GLint material = shapes[s].mesh.material_ids[f];
+			if (material >= GLint(materials.size())) material = -1;
+			GLint key_material = material_colours ? material : -1;
+
+			// Key used in place of the normal index: the smoothing group, or a different
+			// negative number for each flat face
+			GLint smoothing_key = -1;
+			if (generate_normals)
+			{
+				unsigned int group = f < shapes[s].mesh.smoothing_group_ids.size() ? shapes[s].mesh.smoothing_group_ids[f] : 0;
+				if (!any_smoothing) smoothing_key = 0;
+				else if (group != 0) smoothing_key = GLint(group);
+				else smoothing_key = -2 - face_number;
+			}
+			face_number++;
 
 			// Loop over vertices in the face.
 			for (size_t v = 0; v < fv; v++) {
-				
-				// access to vertex
-				tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-				pIndices[ind] = idx.vertex_index;
-
-				// Define the per-vertex normals so that each vertex has it's own normal
-				// defined in the same index of the array (i.e. pNormals[x] si the normal for pVertices[x]
-				pNormals_per_vertex[idx.vertex_index*3] = pNormals[idx.normal_index*3];
-				pNormals_per_vertex[idx.vertex_index * 3+1] = pNormals[idx.normal_index * 3+1];
-				pNormals_per_vertex[idx.vertex_index * 3+2] = pNormals[idx.normal_index * 3+2];
 
-				ind++;
+				// access to vertex, without the attributes the mesh doesn't have
+				tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
+				if (!has_normals) idx.normal_index = smoothing_key;
+				if (!has_texcoords) idx.texcoord_index = -1;
+
+				uint32_t h = uint32_t(idx.vertex_index) * 73856093u ^ uint32_t(idx.normal_index) * 19349663u ^
+					uint32_t(idx.texcoord_index) * 83492791u ^ uint32_t(key_material) * 2654435761u;
+				size_t slot = (h ^ (h >> 15)) & (table_size - 1);
+				while (true)
+				{
+					GLuint e = table[slot];
+					if (e == GLuint(-1))
+					{
+						// First time this triple has been seen
+						e = GLuint(keys.size());
+						keys.push_back(idx);
+						key_materials.push_back(key_material);
+						table[slot] = e;
+						mesh.indices.push_back(e);
+						break;
+					}
+					const tinyobj::index_t& k = keys[e];
+					if (k.vertex_index == idx.vertex_index && k.normal_index == idx.normal_index &&
+						k.texcoord_index == idx.texcoord_index && key_materials[e] == key_material)
+					{
+						mesh.indices.push_back(e);
+						break;
+					}
+					slot = (slot + 1) & (table_size - 1);
+				}
 			}
 			index_offset += fv;
 
 			// per-face material
-			shapes[s].mesh.material_ids[f];
+			triangle_materials.push_back(material);
 		}
 	}
 
+	// Gather the attributes of each vertex
+	GLuint count = GLuint(keys.size());
+	mesh.positions.resize(count * 3);
+	mesh.colours.assign(count * 4, 1.f);
+	if (has_normals) mesh.normals.assign(count * 3, 0.f);
+	if (has_texcoords) mesh.texcoords.assign(count * 2, 0.f);
+	for (GLuint i = 0; i < count; i++)
+	{
+		const tinyobj::index_t& k = keys[i];
+		for (int c = 0; c < 3; c++) mesh.positions[i * 3 + c] = attrib.vertices[k.vertex_index * 3 + c];
+		if (has_colours)
+		{
+			for (int c = 0; c < 3; c++) mesh.colours[i * 4 + c] = attrib.colors[k.vertex_index * 3 + c];
+		}
+		else if (key_materials[i] >= 0)
+		{
+			for (int c = 0; c < 3; c++) mesh.colours[i * 4 + c] = materials[key_materials[i]].diffuse[c];
+		}
+		if (has_normals && k.normal_index >= 0)
+		{
+			for (int c = 0; c < 3; c++) mesh.normals[i * 3 + c] = attrib.normals[k.normal_index * 3 + c];
+		}
+		if (k.texcoord_index >= 0)
+		{
+			for (int c = 0; c < 2; c++) mesh.texcoords[i * 2 + c] = attrib.texcoords[k.texcoord_index * 2 + c];
+		}
+	}
 
-	glGenBuffers(1, &positionBufferObject);
-	glBindBuffer(GL_ARRAY_BUFFER, positionBufferObject);
-	glBufferData(GL_ARRAY_BUFFER, pVertices.size() * sizeof(tinyobj::real_t), &pVertices.front(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	cout << "Welded " << numIndices << " face corners into " << count << " vertices (" << nv << " positions in the obj file)" << endl;
 
-	// Note: we're copying in the normals_per_Vertex array, not the normals directly loading from the OBJ file
-	glGenBuffers(1, &normalBufferObject);
-	glBindBuffer(GL_ARRAY_BUFFER, normalBufferObject);
-	glBufferData(GL_ARRAY_BUFFER, pNormals_per_vertex.size() * sizeof(tinyobj::real_t), &pNormals_per_vertex.front(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	if (generate_normals)
+	{
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+
+		// Vertices at the same position in the same smoothing group share a normal, even
+		// when their texture coordinates are different
+		vector<GLuint> order(count), slots(count);
+		for (GLuint i = 0; i < count; i++) order[i] = i;
+		sort(order.begin(), order.end(), [&](GLuint a, GLuint b)
+		{
+			if (keys[a].vertex_index != keys[b].vertex_index) return keys[a].vertex_index < keys[b].vertex_index;
+			return keys[a].normal_index < keys[b].normal_index;
+		});
+		GLuint num_slots = 0;
+		for (GLuint i = 0; i < count; i++)
+		{
+			if (i > 0 && (keys[order[i]].vertex_index != keys[order[i - 1]].vertex_index ||
+						  keys[order[i]].normal_index != keys[order[i - 1]].normal_index)) num_slots++;
+			slots[order[i]] = num_slots;
+		}
+		if (count) num_slots++;
 
-	glGenBuffers(1, &colourBufferObject);
-	glBindBuffer(GL_ARRAY_BUFFER, colourBufferObject);
-	glBufferData(GL_ARRAY_BUFFER, pColors.size() * sizeof(tinyobj::real_t), &pColors.front(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+		mesh.computeNormals(slots, num_slots);
+		cout << "Generated " << num_slots << " normals " << (any_smoothing ? "from the smoothing groups" : "(no smoothing groups, smooth shading)")
+			<< " in " << chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count() << " ms" << endl;
+	}
+
+	mesh.materials.resize(materials.size());
+	for (size_t m = 0; m < materials.size(); m++)
+	{
+		mesh_material& mat = mesh.materials[m];
+		memset(&mat, 0, sizeof(mat));
+		// Names that don't fit are cut short, the struct was zeroed so they stay terminated
+		memcpy(mat.name, materials[m].name.c_str(), std::min(materials[m].name.size(), sizeof(mat.name) - 1));
+		memcpy(mat.diffuse_texname, materials[m].diffuse_texname.c_str(),
+			std::min(materials[m].diffuse_texname.size(), sizeof(mat.diffuse_texname) - 1));
+		for (int c = 0; c < 3; c++) mat.diffuse[c] = materials[m].diffuse[c];
+	}
+
+	// Needs the material texture names to order the ranges
+	mesh.computeRanges(triangle_materials);
+	mesh.computeBounds();
+}
+
+
+/* Create the vertex buffer from a mesh, either just built or mapped from the cache.
+   The attributes are interleaved into one buffer, packed into integers when
+   quantize_attributes is set, and the attribute layout is recorded once in a VAO of
+   its own, so drawing only has to bind the VAO.
+   A mesh from a compressed cache is already quantized. It is decoded straight into
+   the mapped buffers, and false is returned if the coded data turns out to be corrupt */
+bool TinyObjLoader::upload(const mesh_view& mesh)
+{
+	// Loading again replaces the old buffers
+	glDeleteVertexArrays(1, &vertexArrayObject);
+	glDeleteBuffers(1, &vertexBufferObject);
+	glDeleteBuffers(1, &elementBufferObject);
+
+	numVertices = mesh.num_vertices;
+	numNormals = (mesh.normals || mesh.packed_normals) ? mesh.num_vertices : 0;
+	numTexCoords = (mesh.texcoords || mesh.packed_texcoords) ? mesh.num_vertices : 0;
+	numPIndexes = mesh.num_indices;
+
+	ranges.assign(mesh.ranges, mesh.ranges + mesh.num_ranges);
+	materials.assign(mesh.materials, mesh.materials + mesh.num_materials);
+	if (mesh.num_lods)
+	{
+		lods.assign(mesh.lods, mesh.lods + mesh.num_lods);
+	}
+	else
+	{
+		mesh_lod full = { 0, mesh.num_indices, 0, mesh.num_ranges, 0.f };
+		lods.assign(1, full);
+	}
+	current_lod = 0;
+	bounds = mesh.bounds;
+	meshlets.assign(mesh.meshlets, mesh.meshlets + mesh.num_meshlets);
+	material_textures.assign(materials.size(), 0);
+	buildBatches();
+
+	vector<mesh_vertex> vertices;
+	vector<quantized_vertex> packed;
+	quantized = quantize_attributes || mesh.packed_vertices;
+	if (mesh.packed_vertices)
+	{
+		quantize = mesh.packed_params;
+		vertex_bytes = numVertices * sizeof(quantized_vertex);
+	}
+	else if (quantized)
+	{
+		quantize = quantize_vertices(mesh, packed);
+		vertex_bytes = numVertices * sizeof(quantized_vertex);
+	}
+	else
+	{
+		vertices.resize(numVertices);
+		for (GLuint i = 0; i < numVertices; i++)
+		{
+			mesh_vertex& v = vertices[i];
+			for (int c = 0; c < 3; c++) v.position[c] = mesh.positions[i * 3 + c];
+			for (int c = 0; c < 3; c++) v.normal[c] = mesh.normals ? mesh.normals[i * 3 + c] : 0.f;
+			for (int c = 0; c < 2; c++) v.texcoord[c] = mesh.texcoords ? mesh.texcoords[i * 2 + c] : 0.f;
+			for (int c = 0; c < 4; c++) v.colour[c] = mesh.colours[i * 4 + c];
+		}
+		vertex_bytes = numVertices * sizeof(mesh_vertex);
+	}
+
+	// Leave whichever VAO the caller was using bound
+	GLint previous_vao;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous_vao);
+
+	glGenVertexArrays(1, &vertexArrayObject);
+	glBindVertexArray(vertexArrayObject);
+
+	glGenBuffers(1, &vertexBufferObject);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBufferObject);
+	bool decoded = true;
+	if (mesh.packed_vertices)
+	{
+		glBufferData(GL_ARRAY_BUFFER, vertex_bytes, NULL, GL_STATIC_DRAW);
+		if (numVertices)
+		{
+			void* mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, vertex_bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+			decoded = mapped && decode_vertices(mesh.packed_vertices, mesh.packed_vertex_bytes, (quantized_vertex*)mapped, numVertices);
+			if (mapped) glUnmapBuffer(GL_ARRAY_BUFFER);
+		}
+	}
+	else if (quantized)
+		glBufferData(GL_ARRAY_BUFFER, vertex_bytes, numVertices ? &packed[0] : NULL, GL_STATIC_DRAW);
+	else
+		glBufferData(GL_ARRAY_BUFFER, vertex_bytes, numVertices ? &vertices[0] : NULL, GL_STATIC_DRAW);
 
+	if (quantized)
+	{
+		GLsizei stride = sizeof(quantized_vertex);
+		glVertexAttribPointer(attribute_v_coord, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(quantized_vertex, position));
+		glVertexAttribPointer(attribute_v_normal, 2, GL_SHORT, GL_TRUE, stride, (void*)offsetof(quantized_vertex, normal));
+		glVertexAttribPointer(attribute_v_colours, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)offsetof(quantized_vertex, colour));
+		glVertexAttribPointer(attribute_v_texcoord, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(quantized_vertex, texcoord));
+	}
+	else
+	{
+		GLsizei stride = sizeof(mesh_vertex);
+		glVertexAttribPointer(attribute_v_coord, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(mesh_vertex, position));
+		glVertexAttribPointer(attribute_v_normal, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(mesh_vertex, normal));
+		glVertexAttribPointer(attribute_v_colours, 4, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(mesh_vertex, colour));
+		glVertexAttribPointer(attribute_v_texcoord, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(mesh_vertex, texcoord));
+	}
+	glEnableVertexAttribArray(attribute_v_coord);
+	if (numNormals > 0) glEnableVertexAttribArray(attribute_v_normal);
+	if (!colourOverridden) glEnableVertexAttribArray(attribute_v_colours);
+	if (numTexCoords > 0) glEnableVertexAttribArray(attribute_v_texcoord);
+
+	// The element buffer binding is part of the VAO
 	glGenBuffers(1, &elementBufferObject);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBufferObject);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, numPIndexes * sizeof(GLuint), pIndices, GL_STATIC_DRAW);
+	if (mesh.packed_indices)
+	{
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, numPIndexes * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+		if (numPIndexes && decoded)
+		{
+			void* mapped = glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, numPIndexes * sizeof(GLuint), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+			decoded = mapped && decode_indices(mesh.packed_indices, mesh.packed_index_bytes, (GLuint*)mapped, numPIndexes, numVertices);
+			if (mapped) glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+		}
+	}
+	else
+	{
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, numPIndexes * sizeof(GLuint), mesh.indices, GL_STATIC_DRAW);
+	}
+
+	glBindVertexArray(previous_vao);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return decoded;
+}
+
 
-	if (numTexCoords > 0)
+/* Group the material runs of each level of detail by texture. The batch that uses the
+   caller's texture is drawn first so the texture only has to be put back once, after
+   the last batch */
+void TinyObjLoader::buildBatches()
+{
+	lod_batches.assign(lods.size(), vector<draw_batch>());
+	clusters_culled = false;
+	for (size_t l = 0; l < lods.size(); l++)
 	{
-		glGenBuffers(1, &texCoordsObject);
-		glBindBuffer(GL_ARRAY_BUFFER, texCoordsObject);
-		glBufferData(GL_ARRAY_BUFFER, pTexCoords.size() * sizeof(tinyobj::real_t), &pTexCoords.front(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		vector<draw_batch>& batches = lod_batches[l];
+		for (GLuint r = lods[l].first_range; r < lods[l].first_range + lods[l].num_ranges; r++)
+		{
+			const material_range& range = ranges[r];
+			if (range.count == 0) continue;
+
+			GLuint texture = range.material >= 0 ? material_textures[range.material] : 0;
+			size_t b = 0;
+			while (b < batches.size() && batches[b].texture != texture) b++;
+			if (b == batches.size())
+			{
+				draw_batch batch;
+				batch.texture = texture;
+				if (texture == 0)
+				{
+					batches.insert(batches.begin(), batch);
+					b = 0;
+				}
+				else
+				{
+					batches.push_back(batch);
+				}
+			}
+
+			draw_batch& batch = batches[b];
+			GLuint first_meshlet = find_meshlet(meshlets, range.first), end_meshlet = first_meshlet;
+			while (end_meshlet < meshlets.size() && meshlets[end_meshlet].first_index < range.first + range.count) end_meshlet++;
+			if (end_meshlet > first_meshlet)
+			{
+				batch.meshlet_first.push_back(first_meshlet);
+				batch.meshlet_count.push_back(end_meshlet - first_meshlet);
+			}
+
+			const void* offset = (const void*)(size_t(range.first) * sizeof(GLuint));
+			if (!batch.counts.empty() &&
+				(const char*)batch.offsets.back() + batch.counts.back() * sizeof(GLuint) == (const char*)offset)
+			{
+				batch.counts.back() += range.count;
+			}
+			else
+			{
+				batch.counts.push_back(range.count);
+				batch.offsets.push_back(offset);
+			}
+		}
 	}
+}
 
-	delete [] pIndices;
+
+/* Pick the coarsest level of detail whose error, projected onto the screen at the
+   distance of the mesh, is below lod_pixel_error pixels. The distance is taken to
+   the nearest point of the bounding sphere so a large mesh close to the camera
+   stays detailed. viewport_height is in pixels */
+void TinyObjLoader::selectLod(const mat4& modelview, const mat4& projection, GLfloat viewport_height)
+{
+	current_lod = 0;
+	if (!use_lod || lods.size() < 2) return;
+
+	// The view matrix has no scale so the model scale is the length of the axes
+	GLfloat scale = max(length(vec3(modelview[0])), max(length(vec3(modelview[1])), length(vec3(modelview[2]))));
+	vec3 centre = vec3(modelview * vec4(bounds.centre, 1.f));
+	GLfloat radius = bounds.radius * scale;
+	GLfloat distance = length(centre) - radius;
+	if (distance <= 0.f) return;
+
+	// Pixels covered by one unit at that distance, projection[1][1] is 1 / tan(fovy / 2)
+	GLfloat pixels_per_unit = viewport_height * 0.5f * projection[1][1] / distance;
+	for (GLuint l = GLuint(lods.size()) - 1; l > 0; l--)
+	{
+		if (lods[l].error * scale * pixels_per_unit <= lod_pixel_error)
+		{
+			current_lod = l;
+			return;
+		}
+	}
 }
 
 
-void TinyObjLoader::drawObject(int drawmode)
+/* Cull the meshlets of the current level of detail against the view and fill in the
+   visible lists of its batches. Leaves the lists alone and draws everything when
+   culling is off or the mesh has no meshlets, such as a cache from before they were added */
+void TinyObjLoader::cullClusters(const mat4& modelview, const mat4& projection)
 {
+	clusters_culled = false;
+	cluster_stats.clear();
+	if (!cluster_culling || meshlets.empty()) return;
+
+	cluster_view view;
+	view.set(modelview, projection);
+	GLuint lod = current_lod < lod_batches.size() ? current_lod : 0;
+	vector<draw_batch>& batches = lod_batches[lod];
+	for (size_t b = 0; b < batches.size(); b++)
+	{
+		draw_batch& batch = batches[b];
+		batch.visible_counts.clear();
+		batch.visible_offsets.clear();
+		for (size_t s = 0; s < batch.meshlet_first.size(); s++)
+		{
+			cull_meshlets(&meshlets[batch.meshlet_first[s]], batch.meshlet_count[s], view,
+						  batch.visible_counts, batch.visible_offsets, cluster_stats);
+		}
+	}
+	clusters_culled = true;
+}
 
-	/* Draw the object as GL_POINTS */
-	glBindBuffer(GL_ARRAY_BUFFER, positionBufferObject);
-	glVertexAttribPointer(attribute_v_coord, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(attribute_v_coord);
 
-	/* Bind the object normals */
-	glBindBuffer(GL_ARRAY_BUFFER, normalBufferObject);
-	glVertexAttribPointer(attribute_v_normal, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-	glEnableVertexAttribArray(attribute_v_normal);
+void TinyObjLoader::setMaterialTextures(const vector<GLuint>& textures)
+{
+	material_textures = textures;
+	material_textures.resize(materials.size(), 0);
+	buildBatches();
+}
 
-	/* Bind the object colours */
-	glBindBuffer(GL_ARRAY_BUFFER, colourBufferObject);
-	glVertexAttribPointer(attribute_v_colours, 4, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(attribute_v_colours);
 
-	if (numTexCoords > 0)
+void TinyObjLoader::drawObject(int drawmode)
+{
+	draw_calls = 0;
+	texture_binds = 0;
+	triangles_drawn = 0;
+	if (!vertexArrayObject) return;
+
+	GLint previous_vao;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous_vao);
+	glBindVertexArray(vertexArrayObject);
+
+	// The colour array is turned off in the VAO when it is overridden, so this
+	// constant value is used for every vertex instead
+	if (colourOverridden) glVertexAttrib4fv(attribute_v_colours, &colourOverride[0]);
+
+	// Look the decode uniforms up again only when drawn with a different program
+	GLint program = 0;
+	if (quantized) glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+	if (program)
 	{
-		/* Bind the object texture coords if they exist */
-		glEnableVertexAttribArray(attribute_v_texcoord);
-		glBindBuffer(GL_ARRAY_BUFFER, texCoordsObject);
-		glVertexAttribPointer(attribute_v_texcoord, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+		if (GLuint(program) != decode_program)
+		{
+			decode_program = GLuint(program);
+			quantizedID = glGetUniformLocation(decode_program, "quantized");
+			position_offsetID = glGetUniformLocation(decode_program, "position_offset");
+			position_scaleID = glGetUniformLocation(decode_program, "position_scale");
+			texcoord_transformID = glGetUniformLocation(decode_program, "texcoord_transform");
+			if (quantizedID < 0) cout << "Warning: the shader drawing a quantized mesh has no quantized uniform" << endl;
+		}
+		glUniform1ui(quantizedID, 1);
+		glUniform3fv(position_offsetID, 1, &quantize.position_offset[0]);
+		glUniform3fv(position_scaleID, 1, &quantize.position_scale[0]);
+		glUniform4f(texcoord_transformID, quantize.texcoord_offset.x, quantize.texcoord_offset.y,
+					quantize.texcoord_scale.x, quantize.texcoord_scale.y);
 	}
 
 	glPointSize(3.f);
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBufferObject);
-
 	// Enable this line to show model in wireframe
 	if (drawmode == 1)
 		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
@@ -207,11 +743,61 @@ void TinyObjLoader::drawObject(int drawmode)
 	if (drawmode == 2)
 	{
 		glDrawArrays(GL_POINTS, 0, numVertices);
+		draw_calls++;
 	}
 	else
 	{
-		glDrawElements(GL_TRIANGLES, numPIndexes, GL_UNSIGNED_INT, (GLvoid*)(0));
+		GLuint lod = current_lod < lod_batches.size() ? current_lod : 0;
+		const vector<draw_batch>& batches = lod_batches[lod];
+
+		GLint caller_texture = 0;
+		for (size_t b = 0; b < batches.size(); b++)
+		{
+			const draw_batch& batch = batches[b];
+			const vector<GLsizei>& counts = clusters_culled ? batch.visible_counts : batch.counts;
+			const vector<const void*>& offsets = clusters_culled ? batch.visible_offsets : batch.offsets;
+			if (counts.empty()) continue;
+			for (size_t i = 0; i < counts.size(); i++) triangles_drawn += counts[i] / 3;
+
+			if (batch.texture != 0)
+			{
+				if (texture_binds == 0) glGetIntegerv(GL_TEXTURE_BINDING_2D, &caller_texture);
+				glBindTexture(GL_TEXTURE_2D, batch.texture);
+				texture_binds++;
+			}
+
+			if (counts.size() == 1)
+				glDrawElements(GL_TRIANGLES, counts[0], GL_UNSIGNED_INT, offsets[0]);
+			else
+				glMultiDrawElements(GL_TRIANGLES, &counts[0], GL_UNSIGNED_INT, &offsets[0], GLsizei(counts.size()));
+			draw_calls++;
+		}
+		if (texture_binds) glBindTexture(GL_TEXTURE_2D, caller_texture);
 	}
+
+	// The culling was for this frame's view only
+	clusters_culled = false;
+	if (program) glUniform1ui(quantizedID, 0);
+	glBindVertexArray(previous_vao);
+}
+
+
+size_t TinyObjLoader::memoryUsage() const
+{
+	size_t bytes = vertex_bytes + size_t(numPIndexes) * sizeof(GLuint);
+	bytes += ranges.size() * sizeof(material_range) + materials.size() * sizeof(mesh_material);
+	bytes += lods.size() * sizeof(mesh_lod) + meshlets.size() * sizeof(meshlet);
+	for (size_t l = 0; l < lod_batches.size(); l++)
+	{
+		for (size_t b = 0; b < lod_batches[l].size(); b++)
+		{
+			const draw_batch& batch = lod_batches[l][b];
+			bytes += sizeof(draw_batch) + batch.counts.size() * (sizeof(GLsizei) + sizeof(const void*));
+			bytes += batch.meshlet_first.size() * 2 * sizeof(GLuint);
+			bytes += batch.visible_counts.capacity() * sizeof(GLsizei) + batch.visible_offsets.capacity() * sizeof(const void*);
+		}
+	}
+	return bytes;
 }
 
 
@@ -221,16 +807,17 @@ void TinyObjLoader::drawObject(int drawmode)
  */
 void TinyObjLoader::overrideColour(glm::vec4 c)
 {
-	vec4 *pColours = new vec4[numVertices];
-	for (int i = 0; i < numVertices; i++)
+	colourOverride = c;
+	colourOverridden = true;
+
+	if (vertexArrayObject)
 	{
-		pColours[i] = c;
+		GLint previous_vao;
+		glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous_vao);
+		glBindVertexArray(vertexArrayObject);
+		glDisableVertexAttribArray(attribute_v_colours);
+		glBindVertexArray(previous_vao);
 	}
-
-	glBindBuffer(GL_ARRAY_BUFFER, colourBufferObject);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vec4) * numVertices, pColours, GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
 }
 
 
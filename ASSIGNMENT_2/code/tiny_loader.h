@@ -9,6 +9,11 @@ Iain Martin November 2018
 #pragma once
 
 #include "wrapper_glfw.h"
+#include "mesh_data.h"
+#include "meshlet.h"
+#include "mesh_quantize.h"
+#include "mesh_cache.h"
+#include <string>
 #include <vector>
 #include <glm/glm.hpp>
 
@@ -16,19 +21,127 @@ class TinyObjLoader
 {
 public:
 	TinyObjLoader();
-	~TinyObjLoader();
+	~TinyObjLoader();		// Deletes the GPU buffers, so it needs the GL context
 
 	void load_obj(std::string inputfile, bool debugPrint = false);
 	void drawObject(int drawmode);
+	bool loaded() const { return vertexArrayObject != 0; }	// drawObject() draws nothing until then
 	void overrideColour(glm::vec4 c);
 
+	// Use the multi-threaded parser in obj_parser.h instead of tinyobj::LoadObj
+	bool parallel_parse;
+
+	// Load from the binary mesh cache next to the obj file when it is up to date,
+	// and write the cache after parsing the obj file. Each combination of the settings
+	// that change the mesh has its own cache, cacheOptions() gives the one these select
+	bool use_cache;
+	uint32_t cacheOptions() const;
+	bool loaded_from_cache;
+	double load_time;		// Milliseconds taken by the last load_obj()
+
+	// Runs of indices for each material and the materials they use. The faces are
+	// sorted by material at load time so each material is a single run in each level of detail
+	std::vector<material_range> ranges;
+	std::vector<mesh_material> materials;
+	std::vector<mesh_lod> lods;
+	bounding_volume bounds;		// Model space, from the mesh or its cache
+
+	// Levels of detail are built with mesh_simplify.h when the obj file is parsed and
+	// stored in the mesh cache. selectLod() picks the level for the next drawObject()
+	// from the size of the mesh on the screen
+	bool generate_lods;
+
+	// Reorder the triangles and vertices with mesh_optimize.h when the obj file is parsed
+	bool optimize_indices;
+	bool use_lod;
+	GLfloat lod_pixel_error;	// Largest error allowed on the screen, in pixels
+	GLuint current_lod;
+	void selectLod(const glm::mat4& modelview, const glm::mat4& projection, GLfloat viewport_height);
+
+	// Texture for each material, 0 draws the material with the texture that the
+	// caller has bound. Setting them regroups the runs into draw batches
+	void setMaterialTextures(const std::vector<GLuint>& textures);
+	std::vector<GLuint> material_textures;
+
+	// Meshlets are built with meshlet.h when the obj file is parsed and stored in the
+	// mesh cache. cullClusters() tests them against the view for the next drawObject(),
+	// which then draws only the visible ones. Call it after selectLod()
+	bool cluster_culling;
+	cluster_cull_stats cluster_stats;
+	std::vector<meshlet> meshlets;
+	void cullClusters(const glm::mat4& modelview, const glm::mat4& projection);
+
+	// Upload the vertices packed by mesh_quantize.h, set before load_obj(). The shader
+	// that draws the mesh decodes them: drawObject() sets its quantized, position_offset,
+	// position_scale and texcoord_transform uniforms and puts quantized back to 0 after
+	bool quantize_attributes;
+
+	// Write the mesh cache compressed with mesh_codec.h, when quantize_attributes is set
+	bool compress_cache;
+	GLuint vertex_bytes;		// Size of the vertex buffer
+
+	// Bytes of the GPU buffers and the arrays kept for drawing
+	size_t memoryUsage() const;
+
+	// Counters for the last drawObject()
+	GLuint draw_calls;
+	GLuint texture_binds;
+	GLuint triangles_drawn;
+
+	// Create the GPU buffers for a mesh, finish() calls this
+	bool upload(const mesh_view& mesh);
+
+	// load_obj() in two halves, so that the slow half can run on a loader thread
+	// (asset_loader.h). prepare() opens the cache or parses the obj file and builds the
+	// mesh, writing the cache, without any GL calls or changes to the object. finish()
+	// uploads the result on the GL thread and returns false if the load failed
+	struct prepared_mesh
+	{
+		std::string inputfile;
+		bool debugPrint;
+		bool ok;
+		bool from_cache;		// cache is open and its view is uploaded, otherwise mesh is
+		mesh_cache cache;
+		mesh_data mesh;
+		double prepare_time;	// Milliseconds
+	};
+	void prepare(const std::string& inputfile, prepared_mesh& out, bool debugPrint = false, bool read_cache = true) const;
+	bool finish(prepared_mesh& prepared);
+
 private:
-	// Define vertex buffer object names (e.g as globals)
-	GLuint positionBufferObject;
-	GLuint colourBufferObject;
-	GLuint normalBufferObject;
+	// Runs that are drawn with the same texture, drawn with one glMultiDrawElements.
+	// Runs that follow on from each other in the index array are joined up.
+	// There is a list of batches for each level of detail.
+	// The meshlets of each run are kept as spans of the meshlet array, and
+	// cullClusters() fills in the visible lists from them
+	struct draw_batch
+	{
+		GLuint texture;
+		std::vector<GLsizei> counts;
+		std::vector<const void*> offsets;
+		std::vector<GLuint> meshlet_first, meshlet_count;
+		std::vector<GLsizei> visible_counts;
+		std::vector<const void*> visible_offsets;
+	};
+	std::vector<std::vector<draw_batch>> lod_batches;
+	void buildBatches();
+	bool clusters_culled;		// The visible lists are for the next drawObject()
+
+	// One interleaved vertex buffer and the VAO that describes it
+	GLuint vertexArrayObject;
+	GLuint vertexBufferObject;
 	GLuint elementBufferObject;
-	GLuint texCoordsObject;
+
+	// Decoding of the quantized vertices, and the uniforms for it in the last program
+	// drawObject() was called with
+	bool quantized;
+	quantize_params quantize;
+	GLuint decode_program;
+	GLint quantizedID, position_offsetID, position_scaleID, texcoord_transformID;
+
+	// Set by overrideColour()
+	bool colourOverridden;
+	glm::vec4 colourOverride;
 
 	GLuint attribute_v_coord;
 	GLuint attribute_v_normal;
@@ -0,0 +1,90 @@
+/* wind_field.cpp
+   Curl noise wind grid, see wind_field.h
+   The curl of a vector potential made from three offset Perlin noise fields
+   gives a velocity field with no sources or sinks, so the particles swirl
+   rather than bunching up.
+*/
+
+#include "wind_field.h"
+#include <glm/gtc/noise.hpp>
+
+using namespace glm;
+
+wind_field::wind_field(GLuint nx, GLuint ny, GLuint nz, vec3 box_min, vec3 box_max)
+{
+	this->nx = nx;
+	this->ny = ny;
+	this->nz = nz;
+	this->box_min = box_min;
+	this->box_max = box_max;
+	inv_cell = vec3(float(nx - 1), float(ny - 1), float(nz - 1)) / (box_max - box_min);
+
+	strength = 0.01f;
+	frequency = 0.05f;
+	time = 0;
+	time_step = 0.002f;
+	slices_per_update = 2;
+	next_slice = 0;
+
+	velocity = new vec3[nx * ny * nz];
+}
+
+
+wind_field::~wind_field()
+{
+	delete[] velocity;
+}
+
+
+/* Fill the whole grid */
+void wind_field::create()
+{
+	for (GLuint z = 0; z < nz; z++) refreshSlice(z);
+	next_slice = 0;
+}
+
+
+/* Move the noise on in time and recompute the next few slices of the grid.
+   The whole grid is refreshed every nz / slices_per_update frames */
+void wind_field::update()
+{
+	time += time_step;
+	for (GLuint s = 0; s < slices_per_update; s++)
+	{
+		refreshSlice(next_slice);
+		next_slice = (next_slice + 1) % nz;
+	}
+}
+
+
+/* Curl of the noise potential at p by central differences */
+vec3 wind_field::curlNoise(vec3 p, GLfloat t)
+{
+	const GLfloat e = 0.1f;
+	p *= frequency;
+
+	// Three potential components, offset so that they are uncorrelated
+	const vec3 o1(31.4f, 17.7f, 5.3f), o2(-12.1f, 43.9f, 27.2f);
+
+	#define POTENTIAL(q) vec3(perlin(vec4(q, t)), perlin(vec4((q) + o1, t)), perlin(vec4((q) + o2, t)))
+	vec3 dx = POTENTIAL(p + vec3(e, 0, 0)) - POTENTIAL(p - vec3(e, 0, 0));
+	vec3 dy = POTENTIAL(p + vec3(0, e, 0)) - POTENTIAL(p - vec3(0, e, 0));
+	vec3 dz = POTENTIAL(p + vec3(0, 0, e)) - POTENTIAL(p - vec3(0, 0, e));
+	#undef POTENTIAL
+
+	return vec3(dy.z - dz.y, dz.x - dx.z, dx.y - dy.x) / (2.f * e);
+}
+
+
+void wind_field::refreshSlice(GLuint z)
+{
+	vec3 cell = (box_max - box_min) / vec3(float(nx - 1), float(ny - 1), float(nz - 1));
+	for (GLuint y = 0; y < ny; y++)
+	{
+		for (GLuint x = 0; x < nx; x++)
+		{
+			vec3 p = box_min + vec3(float(x), float(y), float(z)) * cell;
+			velocity[(z * ny + y) * nx + x] = curlNoise(p, time);
+		}
+	}
+}
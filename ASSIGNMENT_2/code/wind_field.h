@@ -0,0 +1,57 @@
+/* wind_field.h
+   Curl noise wind for the particles. The divergence free velocity field is
+   sampled into a coarse 3D grid so that the particle update only needs a
+   trilinear lookup per particle instead of evaluating noise. A few slices of
+   the grid are recomputed every frame with the noise moving through time, so
+   the wind keeps changing without the cost of refreshing the whole grid at once.
+*/
+
+#pragma once
+
+#include "wrapper_glfw.h"
+#include <glm/glm.hpp>
+
+class wind_field
+{
+public:
+	wind_field(GLuint nx, GLuint ny, GLuint nz, glm::vec3 box_min, glm::vec3 box_max);
+	~wind_field();
+
+	void create();
+	void update();
+	glm::vec3 curlNoise(glm::vec3 p, GLfloat t);
+
+	/* Trilinear lookup of the wind at a world position, clamped to the grid */
+	inline glm::vec3 sample(const glm::vec3& p) const
+	{
+		glm::vec3 g = (p - box_min) * inv_cell;
+		g = glm::clamp(g, glm::vec3(0.f), glm::vec3(float(nx - 1), float(ny - 1), float(nz - 1)) - 0.001f);
+
+		int x = int(g.x), y = int(g.y), z = int(g.z);
+		glm::vec3 f = g - glm::vec3(float(x), float(y), float(z));
+
+		const glm::vec3* c = &velocity[(z * ny + y) * nx + x];
+		const GLuint sy = nx, sz = nx * ny;
+
+		glm::vec3 c00 = glm::mix(c[0], c[1], f.x);
+		glm::vec3 c10 = glm::mix(c[sy], c[sy + 1], f.x);
+		glm::vec3 c01 = glm::mix(c[sz], c[sz + 1], f.x);
+		glm::vec3 c11 = glm::mix(c[sz + sy], c[sz + sy + 1], f.x);
+
+		return glm::mix(glm::mix(c00, c10, f.y), glm::mix(c01, c11, f.y), f.z) * strength;
+	}
+
+	glm::vec3* velocity;		// Grid of wind velocities, nx * ny * nz, x fastest
+	GLuint nx, ny, nz;
+	glm::vec3 box_min, box_max;			// World space region covered by the grid
+	glm::vec3 inv_cell;			// Grid cells per world unit in each axis
+
+	GLfloat strength;			// Wind velocity scale (world units per frame)
+	GLfloat frequency;			// Noise frequency in world units
+	GLfloat time, time_step;	// Noise time and how far it moves each frame
+	GLuint slices_per_update;	// Number of z slices recomputed each update
+	GLuint next_slice;
+
+private:
+	void refreshSlice(GLuint z);
+};
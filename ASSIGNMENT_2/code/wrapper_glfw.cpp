@@ -167,6 +167,7 @@ GLuint GLWrapper::BuildShader(GLenum eShaderType, const string &shaderText)
 			case GL_VERTEX_SHADER: strShaderType = "vertex"; break;
 			case GL_GEOMETRY_SHADER: strShaderType = "geometry"; break;
 			case GL_FRAGMENT_SHADER: strShaderType = "fragment"; break;
+			case GL_COMPUTE_SHADER: strShaderType = "compute"; break;
 		}
 
 		cerr << "Compile error in " << strShaderType << "\n\t" << strInfoLog << endl;
@@ -232,6 +233,32 @@ GLuint GLWrapper::LoadShader(const char *vertex_path, const char *fragment_path)
 	return program;
 }
 
+/* Load a compute shader and return the compiled program (needs OpenGL 4.3) */
+GLuint GLWrapper::LoadComputeShader(const char *compute_path)
+{
+	string compShaderStr = readFile(compute_path);
+
+	GLint result = GL_FALSE;
+	int logLength;
+
+	GLuint compShader = BuildShader(GL_COMPUTE_SHADER, compShaderStr);
+
+	cout << "Linking compute program" << endl;
+	GLuint program = glCreateProgram();
+	glAttachShader(program, compShader);
+	glLinkProgram(program);
+
+	glGetProgramiv(program, GL_LINK_STATUS, &result);
+	glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
+	vector<char> programError((logLength > 1) ? logLength : 1);
+	glGetProgramInfoLog(program, logLength, NULL, &programError[0]);
+	cout << &programError[0] << endl;
+
+	glDeleteShader(compShader);
+
+	return program;
+}
+
 /* Load vertex and fragment shader and return the compiled program */
 GLuint GLWrapper::BuildShaderProgram(string vertShaderStr, string fragShaderStr)
 {
@@ -8,7 +8,8 @@ Iain Martin August 2014
 #include <string>
 
 /* Inlcude GL_Load and GLFW */
-#include <glload/gl_4_0.h>
+/* The 4.3 header is needed for compute shaders, check ogl_IsVersionGEQ(4, 3) before using them */
+#include <glload/gl_4_3.h>
 #include <glload/gl_load.h>
 #include <GLFW/glfw3.h>
 
@@ -41,6 +42,7 @@ public:
 
 	/* Shader load and build support functions */
 	GLuint LoadShader(const char *vertex_path, const char *fragment_path);
+	GLuint LoadComputeShader(const char *compute_path);
 	GLuint BuildShader(GLenum eShaderType, const std::string &shaderText);
 	GLuint BuildShaderProgram(std::string vertShaderStr, std::string fragShaderStr);
 	std::string readFile(const char *filePath);